@@ -0,0 +1,46 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "engine.hh"
+
+#include "thunk/ggutils.hh"
+
+using namespace std;
+using namespace gg::thunk;
+
+void WorkerBlobs::update( const ExecutionResponse & response )
+{
+  if ( response.blob_summary.length() ) {
+    summary_.reset( BloomFilter::from_bytes( response.blob_summary ) );
+  }
+}
+
+void WorkerBlobs::add( const string & hash )
+{
+  if ( summary_.initialized() ) {
+    summary_->insert( hash );
+  }
+}
+
+void WorkerBlobs::add_inputs( const Thunk & thunk )
+{
+  for ( const Thunk::DataList * dep_list : { &thunk.values(), &thunk.executables() } ) {
+    for ( const auto & dep : *dep_list ) {
+      add( dep.first );
+    }
+  }
+}
+
+uint64_t WorkerBlobs::missing_bytes( const Thunk & thunk ) const
+{
+  uint64_t missing = 0;
+
+  for ( const Thunk::DataList * dep_list : { &thunk.values(), &thunk.executables() } ) {
+    for ( const auto & dep : *dep_list ) {
+      if ( not summary_.initialized() or not summary_->contains( dep.first ) ) {
+        missing += gg::hash::size( dep.first );
+      }
+    }
+  }
+
+  return missing;
+}
@@ -9,6 +9,26 @@
 #include "loop.hh"
 #include "response.hh"
 #include "thunk/thunk.hh"
+#include "util/bloom_filter.hh"
+#include "util/optional.hh"
+
+/* what a worker has in its blob store, as far as we know: its last summary,
+   plus whatever we've sent it or it has produced since then */
+class WorkerBlobs
+{
+private:
+  Optional<BloomFilter> summary_ {};
+
+public:
+  void update( const ExecutionResponse & response );
+
+  void add( const std::string & hash );
+  void add_inputs( const gg::thunk::Thunk & thunk );
+
+  /* the number of bytes of the thunk's inputs that the worker would have
+     to fetch; without a summary, that's all of them */
+  uint64_t missing_bytes( const gg::thunk::Thunk & thunk ) const;
+};
 
 class ExecutionEngine
 {
@@ -44,6 +64,16 @@ public:
   virtual std::string label() const = 0;
   virtual bool can_execute( const gg::thunk::Thunk & thunk ) const = 0;
 
+  /* the number of bytes of the thunk's inputs that the engine would have
+     to fetch before executing it */
+  virtual uint64_t missing_input_bytes( const gg::thunk::Thunk & thunk ) const
+  {
+    return WorkerBlobs {}.missing_bytes( thunk );
+  }
+
+  /* false if the engine can't take another job right now */
+  virtual bool has_capacity() const { return true; }
+
   virtual ~ExecutionEngine() {}
 };
 
@@ -3,9 +3,12 @@
 #include "engine_gg.hh"
 
 #include <stdexcept>
+#include <algorithm>
+#include <limits>
 
 #include "response.hh"
 #include "net/http_response.hh"
+#include "thunk/blobs.hh"
 #include "thunk/ggutils.hh"
 #include "util/optional.hh"
 #include "util/system_runner.hh"
@@ -14,6 +17,25 @@
 using namespace std;
 using namespace gg::thunk;
 
+double GGExecutionEngine::Runner::load() const
+{
+  return static_cast<double>( running_jobs ) / max<size_t>( max_jobs, 1 );
+}
+
+GGExecutionEngine::GGExecutionEngine( const vector<gg::remote::RunnerServer> & servers,
+                                      SuccessCallbackFunc success_callback,
+                                      FailureCallbackFunc failure_callback )
+  : ExecutionEngine( success_callback, failure_callback )
+{
+  for ( const auto & server : servers ) {
+    runners_.emplace_back( server );
+  }
+
+  if ( runners_.empty() ) {
+    throw runtime_error( "no runners were given" );
+  }
+}
+
 HTTPRequest GGExecutionEngine::generate_request( const Thunk & thunk )
 {
   string payload = Thunk::execution_payload( thunk );
@@ -29,16 +51,105 @@ HTTPRequest GGExecutionEngine::generate_request( const Thunk & thunk )
   return request;
 }
 
-void GGExecutionEngine::force_thunk( const Thunk & thunk,
-                                     ExecutionLoop & exec_loop )
+vector<size_t> GGExecutionEngine::available_runners() const
 {
-  HTTPRequest request = generate_request( thunk );
+  const auto now = Clock::now();
+
+  vector<size_t> available;
+  size_t first_back = 0;
+
+  for ( size_t i = 0; i < runners_.size(); i++ ) {
+    if ( runners_[ i ].drained_until < runners_[ first_back ].drained_until ) {
+      first_back = i;
+    }
+
+    if ( runners_[ i ].drained_until <= now and not runners_[ i ].is_full() ) {
+      available.push_back( i );
+    }
+  }
+
+  /* one job at a time, to see if it's back */
+  if ( available.empty() and runners_[ first_back ].drained_until > now and
+       runners_[ first_back ].running_jobs == 0 ) {
+    available.push_back( first_back );
+  }
+
+  return available;
+}
+
+void GGExecutionEngine::record_result( Runner & runner, const bool success )
+{
+  if ( success ) {
+    runner.consecutive_failures = 0;
+    runner.drain_period = chrono::seconds { 0 };
+    return;
+  }
+
+  runner.failures++;
+  runner.consecutive_failures++;
+
+  if ( runner.consecutive_failures >= MAX_CONSECUTIVE_FAILURES ) {
+    /* back off a little more every time it fails again */
+    runner.drain_period = min( chrono::seconds { 60 },
+                               max( chrono::seconds { 1 }, runner.drain_period * 2 ) );
+    runner.drained_until = Clock::now() + runner.drain_period;
+    runner.consecutive_failures = 0;
+
+    cerr << "[warning] runner " << runner.address.str() << " failed "
+         << MAX_CONSECUTIVE_FAILURES << " times in a row, draining it for "
+         << runner.drain_period.count() << "s" << endl;
+  }
+}
+
+void GGExecutionEngine::finish_job( const uint64_t id, const bool success )
+{
+  const Job job = jobs_.at( id );
+  jobs_.erase( id );
+
+  Runner & runner = runners_.at( job.runner );
+  runner.running_jobs--;
+  running_jobs_--;
+
+  if ( success ) {
+    const double latency = chrono::duration<double>( Clock::now() - job.start ).count();
+    runner.average_latency = ( runner.finished_jobs == 0 )
+                             ? latency
+                             : 0.8 * runner.average_latency + 0.2 * latency;
+    runner.finished_jobs++;
+  }
+
+  record_result( runner, success );
+}
+
+uint64_t GGExecutionEngine::connection_to( Runner & runner, ExecutionLoop & exec_loop )
+{
+  /* forget about the connections that were closed */
+  runner.connections.erase(
+    remove_if( runner.connections.begin(), runner.connections.end(),
+               [&exec_loop] ( const uint64_t id ) { return not exec_loop.connection_is_open( id ); } ),
+    runner.connections.end() );
+
+  Optional<uint64_t> best;
+
+  for ( const uint64_t id : runner.connections ) {
+    if ( not best.initialized() or
+         exec_loop.waiting_requests( id ) < exec_loop.waiting_requests( *best ) ) {
+      best.reset( id );
+    }
+  }
+
+  const size_t max_connections = runner.max_jobs ? runner.max_jobs : DEFAULT_CONNECTIONS;
+
+  if ( best.initialized() and ( exec_loop.waiting_requests( *best ) == 0 or
+                                runner.connections.size() >= max_connections ) ) {
+    return *best;
+  }
 
   TCPSocket socket;
   socket.set_blocking( false );
 
   try {
-    socket.connect( address_ );
+    socket.connect( runner.address );
     throw runtime_error( "nonblocking connect unexpectedly succeeded immediately" );
   } catch ( const unix_error & e ) {
     if ( e.error_code() == EINPROGRESS ) {
@@ -48,46 +159,114 @@ void GGExecutionEngine::force_thunk( const Thunk & thunk,
     }
   }
 
-  exec_loop.add_connection(
-    thunk.hash(),
-    [this] ( const uint64_t, const string & thunk_hash,
+  runner.connections.push_back( exec_loop.open_connection( move( socket ) ) );
+  return runner.connections.back();
+}
+
+void GGExecutionEngine::force_thunk( const Thunk & thunk,
+                                     ExecutionLoop & exec_loop )
+{
+  /* the runner where the job costs the least: the inputs it would have to
+     fetch, plus its load. on a tie, the faster one. */
+  const vector<size_t> available = available_runners();
+
+  if ( available.empty() ) {
+    throw runtime_error( "all runners are busy" );
+  }
+
+  auto cost =
+    [this, &thunk] ( const size_t i )
+    {
+      return runners_[ i ].blobs.missing_bytes( thunk ) + runners_[ i ].load() * LOAD_COST;
+    };
+
+  size_t runner_index = available.front();
+  double runner_cost = cost( runner_index );
+
+  for ( const size_t i : available ) {
+    const double candidate_cost = cost( i );
+
+    if ( candidate_cost != runner_cost
+         ? candidate_cost < runner_cost
+         : runners_[ i ].average_latency < runners_[ runner_index ].average_latency ) {
+      runner_index = i;
+      runner_cost = candidate_cost;
+    }
+  }
+
+  Runner & runner = runners_[ runner_index ];
+
+  auto socket_failure =
+    [this] ( const uint64_t id, const string & thunk_hash )
+    {
+      finish_job( id, false );
+      failure_callback_( thunk_hash, JobStatus::SocketFailure );
+    };
+
+  auto on_response =
+    [this] ( const uint64_t id, const string & thunk_hash,
              const HTTPResponse & http_response )
     {
-      running_jobs_--;
+      const size_t runner_index = jobs_.at( id ).runner;
 
       if ( http_response.status_code() != "200" ) {
-        throw runtime_error( "HTTP failure: " + http_response.status_code() );
+        finish_job( id, false );
+        return failure_callback_( thunk_hash, JobStatus::InvocationFailure );
       }
 
       ExecutionResponse response = ExecutionResponse::parse_message( http_response.body() );
+      runners_.at( runner_index ).blobs.update( response );
 
-      if ( response.status != JobStatus::Success ) {
-        throw runtime_error( "execution failed." );
+      if ( response.status == JobStatus::Success and response.thunk_hash != thunk_hash ) {
+        cerr << "[warning] expected output for " << thunk_hash << ", got output for "
+             << response.thunk_hash << endl;
+        response.status = JobStatus::OperationalFailure;
       }
+      else if ( response.status == JobStatus::Success and response.outputs.empty() ) {
+        cerr << "[warning] no outputs for " << thunk_hash << endl;
+        response.status = JobStatus::OperationalFailure;
+      }
+
+      /* a thunk that fails to execute isn't the runner's fault */
+      finish_job( id, response.status == JobStatus::Success or
+                      response.status == JobStatus::ExecutionFailure );
 
-      if ( response.thunk_hash != thunk_hash ) {
-        cerr << http_response.str() << endl;
-        throw runtime_error( "expected output for " + thunk_hash + ", got output for " + response.thunk_hash );
+      if ( response.status != JobStatus::Success ) {
+        return failure_callback_( thunk_hash, response.status );
       }
 
       for ( const auto & output : response.outputs ) {
         gg::cache::insert( gg::hash::for_output( response.thunk_hash, output.tag ), output.hash );
 
         if ( output.data.length() ) {
-          roost::atomic_create( output.data, gg::paths::blob_path( output.hash ) );
+          gg::blobs::write( output.hash, output.data );
         }
+
+        runners_.at( runner_index ).blobs.add( output.hash );
       }
 
       gg::cache::insert( response.thunk_hash, response.outputs.at( 0 ).hash );
       success_callback_( response.thunk_hash, response.outputs.at( 0 ).hash, 0 );
-    },
-    [this] ( const uint64_t, const string & thunk_hash )
-    {
-      failure_callback_( thunk_hash, JobStatus::SocketFailure );
-    },
-    socket, request
-  );
+    };
 
+  uint64_t exec_id = 0;
+
+  try {
+    exec_id = exec_loop.send_request( connection_to( runner, exec_loop ), thunk.hash(),
+                                      on_response, socket_failure,
+                                      generate_request( thunk ) );
+
+    /* the runner will have fetched the inputs by the time it's done */
+    runner.blobs.add_inputs( thunk );
+  }
+  catch ( const unix_error & ) {
+    /* the attempt counts as a job until the loop fails it, so a drained
+       runner isn't tried over and over in the meantime */
+    exec_id = exec_loop.fail_request( thunk.hash(), socket_failure );
+  }
+
+  jobs_.insert( { exec_id, { runner_index, Clock::now() } } );
+  runner.running_jobs++;
   running_jobs_++;
 }
 
@@ -95,3 +274,19 @@ size_t GGExecutionEngine::job_count() const
 {
   return running_jobs_;
 }
+
+uint64_t GGExecutionEngine::missing_input_bytes( const Thunk & thunk ) const
+{
+  uint64_t missing = numeric_limits<uint64_t>::max();
+
+  for ( const size_t i : available_runners() ) {
+    missing = min( missing, runners_[ i ].blobs.missing_bytes( thunk ) );
+  }
+
+  return missing;
+}
+
+bool GGExecutionEngine::has_capacity() const
+{
+  return not available_runners().empty();
+}
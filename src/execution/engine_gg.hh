@@ -3,26 +3,91 @@
 #ifndef ENGINE_GG_HH
 #define ENGINE_GG_HH
 
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+
 #include "engine.hh"
+#include "net/address.hh"
 #include "net/http_request.hh"
+#include "thunk/ggutils.hh"
 #include "thunk/thunk.hh"
 
+/* Sends the jobs to a pool of gg runners. Each job goes to the runner that
+   has the least of its inputs to fetch, unless that one is much busier than
+   the others; a runner that fails a few times in a row is drained for a
+   while, and gets another chance after that.
+
+   The requests go over keep-alive connections, about as many per runner as
+   it runs jobs at once: an idle connection is used if there is one, and
+   requests are only pipelined behind others when there isn't. */
 class GGExecutionEngine : public ExecutionEngine
 {
 private:
-  Address address_;
+  typedef std::chrono::steady_clock Clock;
+
+  /* a runner is drained after this many failures in a row */
+  static constexpr size_t MAX_CONSECUTIVE_FAILURES = 3;
+
+  /* for runners that don't have a job limit */
+  static constexpr size_t DEFAULT_CONNECTIONS = 8;
+
+  /* when picking a runner, a full one (or, without a limit, each job that
+     it's running) counts as much as having this many bytes to fetch */
+  static constexpr uint64_t LOAD_COST = 64 * 1024 * 1024;
+
+  struct Runner
+  {
+    Address address;
+    size_t max_jobs; /* 0 if there's no limit */
+    size_t running_jobs { 0 };
+    WorkerBlobs blobs {};
+
+    size_t finished_jobs { 0 };
+    size_t failures { 0 };
+    size_t consecutive_failures { 0 };
+    double average_latency { 0.0 }; /* in seconds, over recent jobs */
+
+    Clock::time_point drained_until {};
+    std::chrono::seconds drain_period { 0 };
 
+    std::vector<uint64_t> connections {};
+
+    Runner( const gg::remote::RunnerServer & server )
+      : address( server.ip, server.port ), max_jobs( server.max_jobs )
+    {}
+
+    double load() const;
+    bool is_full() const { return max_jobs > 0 and running_jobs >= max_jobs; }
+  };
+
+  struct Job
+  {
+    size_t runner;
+    Clock::time_point start;
+  };
+
+  std::vector<Runner> runners_ {};
+  std::unordered_map<uint64_t, Job> jobs_ {};
   size_t running_jobs_ { 0 };
 
   HTTPRequest generate_request( const gg::thunk::Thunk & thunk );
 
+  /* the runners that can be sent a job now. if they're all drained, the
+     one that comes back first is tried anyway, with a single job. */
+  std::vector<size_t> available_runners() const;
+
+  /* an open connection to the runner, with as few requests waiting on it
+     as possible */
+  uint64_t connection_to( Runner & runner, ExecutionLoop & exec_loop );
+
+  void record_result( Runner & runner, const bool success );
+  void finish_job( const uint64_t id, const bool success );
+
 public:
-  GGExecutionEngine( const std::string & address, const uint16_t port,
+  GGExecutionEngine( const std::vector<gg::remote::RunnerServer> & servers,
                      SuccessCallbackFunc success_callback,
-                     FailureCallbackFunc failure_callback )
-    : ExecutionEngine( success_callback, failure_callback ),
-      address_( address, port )
-  {}
+                     FailureCallbackFunc failure_callback );
 
   void force_thunk( const gg::thunk::Thunk & thunk,
                     ExecutionLoop & exec_loop ) override;
@@ -31,6 +96,9 @@ public:
   bool is_remote() const { return true; }
   std::string label() const override { return "gg-remote"; }
   bool can_execute( const gg::thunk::Thunk & ) const { return true; }
+
+  uint64_t missing_input_bytes( const gg::thunk::Thunk & thunk ) const override;
+  bool has_capacity() const override;
 };
 
 #endif /* ENGINE_GG_HH */
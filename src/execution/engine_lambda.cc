@@ -6,6 +6,7 @@
 #include <cmath>
 
 #include "response.hh"
+#include "thunk/blobs.hh"
 #include "thunk/ggutils.hh"
 #include "net/http_response.hh"
 #include "util/base64.hh"
@@ -94,8 +95,7 @@ void AWSLambdaExecutionEngine::force_thunk( const Thunk & thunk,
           gg::cache::insert( gg::hash::for_output( response.thunk_hash, output.tag ), output.hash );
 
           if ( output.data.length() ) {
-            roost::atomic_create( base64::decode( output.data ),
-                                  gg::paths::blob_path( output.hash ) );
+            gg::blobs::write( output.hash, base64::decode( output.data ) );
           }
         }
 
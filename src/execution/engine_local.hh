@@ -20,6 +20,7 @@ public:
   bool is_remote() const override { return false; }
   std::string label() const override { return "local"; }
   bool can_execute( const gg::thunk::Thunk & ) const override { return true; }
+  uint64_t missing_input_bytes( const gg::thunk::Thunk & ) const override { return 0; }
 };
 
 #endif /* ENGINE_LOCAL_HH */
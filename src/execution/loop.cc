@@ -2,6 +2,10 @@
 
 #include "loop.hh"
 
+#include <csignal>
+#include <iostream>
+#include <stdexcept>
+
 #include "thunk/ggutils.hh"
 #include "util/exception.hh"
 #include "util/optional.hh"
@@ -26,13 +30,30 @@ ExecutionLoop::ExecutionLoop()
       [&]() { return handle_signal( signal_fd_.read_signal() ); },
       [&]() { return ( child_processes_.size() > 0 or
                        connection_contexts_.size() > 0 or
-                       ssl_connection_contexts_.size() > 0 ); }
+                       ssl_connection_contexts_.size() > 0 or
+                       keep_alive_connections_.size() > 0 ); }
     )
   );
+
+  /* a keep-alive connection can be closed by the server at any time; that's
+     noticed when writing to it, and shouldn't kill us */
+  signal( SIGPIPE, SIG_IGN );
 }
 
 Poller::Result ExecutionLoop::loop_once( const int timeout_ms )
 {
+  if ( not failed_requests_.empty() ) {
+    /* the callbacks might fail more requests; those wait for the next round */
+    const auto failed = move( failed_requests_ );
+    failed_requests_.clear();
+
+    for ( const auto & request : failed ) {
+      get<2>( request )( get<0>( request ), get<1>( request ) );
+    }
+
+    return Poller::Result::Type::Success;
+  }
+
   return poller_.poll( timeout_ms );
 }
 
@@ -203,6 +224,193 @@ uint64_t ExecutionLoop::add_connection( const string & tag,
   return connection_id;
 }
 
+uint64_t ExecutionLoop::open_connection( TCPSocket && socket )
+{
+  const uint64_t connection_id = current_id_++;
+  auto connection_it = keep_alive_connections_.emplace( keep_alive_connections_.end(),
+                                                        move( socket ) );
+  keep_alive_index_.emplace( connection_id, connection_it );
+
+  poller_.add_action(
+    Poller::Action(
+      connection_it->socket, Direction::Out,
+      [connection_it, connection_id, this] ()
+      {
+        /* closed by the other action in this round */
+        if ( not connection_is_open( connection_id ) ) {
+          return ResultType::CancelAll;
+        }
+
+        try {
+          connection_it->socket.verify_no_errors();
+          connection_it->connected = true;
+
+          if ( connection_it->write_buffer.length() ) {
+            auto last_write = connection_it->socket.write( connection_it->write_buffer, false );
+            connection_it->write_buffer.erase( connection_it->write_buffer.cbegin(), last_write );
+          }
+        }
+        catch ( const unix_error & ) {
+          close_connection( connection_id );
+          return ResultType::CancelAll;
+        }
+
+        return ResultType::Continue;
+      },
+      [connection_it] { return ( not connection_it->connected ) or
+                               connection_it->write_buffer.length(); },
+      [connection_id, this] { close_connection( connection_id ); }
+    )
+  );
+
+  poller_.add_action(
+    Poller::Action(
+      connection_it->socket, Direction::In,
+      [connection_it, connection_id, this] ()
+      {
+        if ( not connection_is_open( connection_id ) ) {
+          return ResultType::CancelAll;
+        }
+
+        /* the responses that came in before the connection was closed, or
+           went bad, are still delivered */
+        bool server_closed = false;
+
+        try {
+          connection_it->responses.parse( connection_it->socket.read() );
+          server_closed = connection_it->socket.eof();
+        }
+        catch ( const unix_error & ) {
+          close_connection( connection_id );
+          return ResultType::CancelAll;
+        }
+        catch ( const exception & e ) {
+          /* a response that doesn't parse, or that nobody asked for */
+          cerr << "[warning] bad response, closing the connection: " << e.what() << endl;
+          server_closed = true;
+        }
+
+        while ( not connection_it->responses.empty() ) {
+          if ( connection_it->pending.empty() ) {
+            cerr << "[warning] response without a request, closing the connection" << endl;
+            server_closed = true;
+            break;
+          }
+
+          const HTTPResponse & response = connection_it->responses.front();
+          const KeepAliveConnection::PendingRequest request = move( connection_it->pending.front() );
+          connection_it->pending.pop_front();
+
+          const bool last_response = response.has_header( "Connection" ) and
+                                     response.get_header_value( "Connection" ) == "close";
+
+          request.callback( request.id, request.tag, response );
+          connection_it->responses.pop();
+
+          if ( last_response ) {
+            server_closed = true;
+            break;
+          }
+        }
+
+        if ( server_closed ) {
+          close_connection( connection_id );
+          return ResultType::CancelAll;
+        }
+
+        return ResultType::Continue;
+      },
+      [connection_it] { return connection_it->connected; },
+      [connection_id, this] { close_connection( connection_id ); }
+    )
+  );
+
+  return connection_id;
+}
+
+uint64_t ExecutionLoop::send_request( const uint64_t connection_id,
+                                      const string & tag,
+                                      RemoteCallbackFunc callback,
+                                      FailureCallbackFunc failure_callback,
+                                      const HTTPRequest & request )
+{
+  KeepAliveConnection & connection = *keep_alive_index_.at( connection_id );
+  const uint64_t request_id = current_id_++;
+
+  connection.write_buffer.append( request.str() );
+  connection.responses.new_request_arrived( request );
+  connection.pending.push_back( { request_id, tag, callback, failure_callback } );
+
+  return request_id;
+}
+
+uint64_t ExecutionLoop::fail_request( const string & tag,
+                                      FailureCallbackFunc failure_callback )
+{
+  const uint64_t request_id = current_id_++;
+  failed_requests_.emplace_back( request_id, tag, failure_callback );
+  return request_id;
+}
+
+bool ExecutionLoop::connection_is_open( const uint64_t connection_id ) const
+{
+  return keep_alive_index_.count( connection_id ) > 0;
+}
+
+size_t ExecutionLoop::waiting_requests( const uint64_t connection_id ) const
+{
+  return keep_alive_index_.at( connection_id )->pending.size();
+}
+
+void ExecutionLoop::close_connection( const uint64_t connection_id )
+{
+  auto index_entry = keep_alive_index_.find( connection_id );
+
+  if ( index_entry == keep_alive_index_.end() ) {
+    return;
+  }
+
+  /* the callbacks might want to send the requests again, so the connection
+     is gone by the time they run */
+  const deque<KeepAliveConnection::PendingRequest> pending = move( index_entry->second->pending );
+  keep_alive_connections_.erase( index_entry->second );
+  keep_alive_index_.erase( index_entry );
+
+  for ( const auto & request : pending ) {
+    request.failure_callback( request.id, request.tag );
+  }
+}
+
+void ExecutionLoop::add_transfer_agent( TransferAgent & agent )
+{
+  poller_.add_action(
+    Poller::Action(
+      agent.fd(), Direction::In,
+      [&agent] ()
+      {
+        agent.process_completions();
+        return ResultType::Continue;
+      },
+      [&agent] () { return agent.pending() > 0; }
+    )
+  );
+}
+
+void ExecutionLoop::add_reader( FileDescriptor & fd,
+                                function<void( const string & )> && callback )
+{
+  poller_.add_action(
+    Poller::Action(
+      fd, Direction::In,
+      [&fd, callback] ()
+      {
+        callback( fd.read() );
+        return fd.eof() ? ResultType::CancelAll : ResultType::Continue;
+      }
+    )
+  );
+}
+
 Poller::Action::Result ExecutionLoop::handle_signal( const signalfd_siginfo & sig )
 {
   switch ( sig.ssi_signo ) {
@@ -4,6 +4,7 @@
 #define LOOP_HH
 
 #include <list>
+#include <deque>
 #include <vector>
 #include <functional>
 #include <unordered_map>
@@ -11,6 +12,7 @@
 #include "connection_context.hh"
 #include "net/socket.hh"
 #include "net/secure_socket.hh"
+#include "storage/transfer_agent.hh"
 #include "util/signalfd.hh"
 #include "util/child_process.hh"
 #include "util/poller.hh"
@@ -37,6 +39,38 @@ private:
   std::list<ConnectionContext> connection_contexts_;
   std::list<SSLConnectionContext> ssl_connection_contexts_;
 
+  /* a keep-alive connection, and the requests sent over it that are still
+     waiting for their responses, in order */
+  struct KeepAliveConnection
+  {
+    struct PendingRequest
+    {
+      uint64_t id;
+      std::string tag;
+      RemoteCallbackFunc callback;
+      FailureCallbackFunc failure_callback;
+    };
+
+    TCPSocket socket;
+    bool connected { false };
+    HTTPResponseParser responses {};
+    std::string write_buffer {};
+    std::deque<PendingRequest> pending {};
+
+    KeepAliveConnection( TCPSocket && sock ) : socket( std::move( sock ) ) {}
+  };
+
+  typedef std::list<KeepAliveConnection>::iterator KeepAliveIterator;
+
+  std::list<KeepAliveConnection> keep_alive_connections_ {};
+  std::unordered_map<uint64_t, KeepAliveIterator> keep_alive_index_ {};
+
+  /* requests that failed before they were sent, waiting to be failed from
+     the loop */
+  std::deque<std::tuple<uint64_t, std::string, FailureCallbackFunc>> failed_requests_ {};
+
+  void close_connection( const uint64_t connection_id );
+
   Poller::Action::Result handle_signal( const signalfd_siginfo & );
 
 public:
@@ -56,6 +90,34 @@ public:
                            SocketType & socket,
                            const HTTPRequest & request );
 
+  /* keep-alive connections: a request is written out as soon as it's sent,
+     without waiting for the responses to the earlier ones, and responses are
+     matched to requests in order. if the connection fails, the server
+     closes it or it sends something that isn't a response to them, every
+     request still waiting for a response fails. */
+  uint64_t open_connection( TCPSocket && socket );
+  uint64_t send_request( const uint64_t connection_id,
+                         const std::string & tag,
+                         RemoteCallbackFunc callback,
+                         FailureCallbackFunc failure_callback,
+                         const HTTPRequest & request );
+
+  /* a request that couldn't even be sent; it fails the next time around
+     the loop, as if its connection had failed */
+  uint64_t fail_request( const std::string & tag,
+                         FailureCallbackFunc failure_callback );
+
+  bool connection_is_open( const uint64_t connection_id ) const;
+  size_t waiting_requests( const uint64_t connection_id ) const;
+
+  /* runs the agent's callbacks as its transfers finish */
+  void add_transfer_agent( TransferAgent & agent );
+
+  /* calls back with whatever is read from the fd, until it reaches EOF (the
+     callback is then called with an empty string) */
+  void add_reader( FileDescriptor & fd,
+                   std::function<void( const std::string & )> && callback );
+
   Poller::Result loop_once( const int timeout_ms = -1 );
 };
 
@@ -8,10 +8,13 @@
 #include <cmath>
 #include <numeric>
 #include <chrono>
+#include <algorithm>
 
 #include "engine_local.hh"
 #include "engine_lambda.hh"
 #include "engine_gg.hh"
+#include "thunk/blobs.hh"
+#include "thunk/bundle.hh"
 #include "thunk/ggutils.hh"
 #include "net/s3.hh"
 #include "tui/status_bar.hh"
@@ -107,6 +110,13 @@ Reductor::Reductor( const vector<string> & target_hashes, const size_t max_jobs,
       switch ( failure_reason ) {
       /* this is the only fatal failure */
       case JobStatus::ExecutionFailure:
+        if ( speculating_ ) {
+          /* the real reduction will run into it too, and report it */
+          print_gg_message( "warning", "execution failed, dropping: " + old_hash );
+          running_jobs_.erase( old_hash );
+          return;
+        }
+
         throw runtime_error( "execution failed: " + old_hash );
 
       /* for all of the following cases, except default, we will push the failed
@@ -167,16 +177,12 @@ Reductor::Reductor( const vector<string> & target_hashes, const size_t max_jobs,
       break;
 
     case ExecutionEnvironment::GG_RUNNER:
-      {
-        auto runner_server = gg::remote::runner_server();
-
-        exec_engines_.emplace_back(
-          make_unique<GGExecutionEngine>(
-            runner_server.first, runner_server.second, success_callback,
-            failure_callback
-          )
-        );
-      }
+      exec_engines_.emplace_back(
+        make_unique<GGExecutionEngine>(
+          gg::remote::runner_servers(), success_callback, failure_callback
+        )
+      );
+
       break;
     }
   }
@@ -184,6 +190,11 @@ Reductor::Reductor( const vector<string> & target_hashes, const size_t max_jobs,
   if ( exec_engines_.size() == 0 ) {
     throw runtime_error( "no execution engines are available" );
   }
+
+  if ( storage_backend_ != nullptr ) {
+    transfer_agent_ = make_unique<TransferAgent>( *storage_backend_ );
+    exec_loop_.add_transfer_agent( *transfer_agent_ );
+  }
 }
 
 size_t Reductor::running_jobs() const
@@ -197,7 +208,8 @@ size_t Reductor::running_jobs() const
 
 bool Reductor::is_finished() const
 {
-  return remaining_targets_.size() == 0;
+  return remaining_targets_.size() == 0 and
+         ( transfer_agent_ == nullptr or transfer_agent_->pending() == 0 );
 }
 
 void Reductor::finalize_execution( const string & old_hash,
@@ -212,59 +224,153 @@ void Reductor::finalize_execution( const string & old_hash,
   if ( new_o1s.initialized() ) {
     job_queue_.insert( job_queue_.end(), new_o1s->begin(), new_o1s->end() );
 
-    if ( gg::hash::type( new_hash ) == gg::ObjectType::Value ) {
-      remaining_targets_.erase( dep_graph_.original_hash( old_hash ) );
+    if ( gg::hash::type( new_hash ) == gg::ObjectType::Value and
+         remaining_targets_.erase( dep_graph_.original_hash( old_hash ) ) ) {
+      download_output( new_hash );
     }
 
     finished_jobs_++;
   }
 }
 
-vector<string> Reductor::reduce()
+void Reductor::finalize_upload( const string & hash )
 {
-  while ( true ) {
-    while ( not job_queue_.empty() and running_jobs() < max_jobs_ ) {
-      const string thunk_hash { move( job_queue_.front() ) };
-      job_queue_.pop_front();
+  gg::remote::set_available( hash );
+  uploading_.erase( hash );
 
-      /* don't bother executing gg-execute if it's in the cache */
-      Optional<ReductionResult> cache_entry;
+  auto blocked = blocked_jobs_.find( hash );
 
-      while ( true ) {
-        auto temp_cache_entry = gg::cache::check( cache_entry.initialized() ? cache_entry->hash
-                                                                            : thunk_hash );
+  if ( blocked == blocked_jobs_.end() ) {
+    return;
+  }
 
-        if ( temp_cache_entry.initialized() ) {
-          cache_entry = move( temp_cache_entry );
-        }
-        else {
-          break;
-        }
+  for ( const string & thunk_hash : blocked->second ) {
+    if ( --missing_uploads_.at( thunk_hash ) == 0 ) {
+      missing_uploads_.erase( thunk_hash );
+      job_queue_.push_back( thunk_hash );
+    }
+  }
+
+  blocked_jobs_.erase( blocked );
+}
+
+/* returns true if the thunk has to wait for some of its dependencies to be
+   uploaded first */
+bool Reductor::wait_for_uploads( const Thunk & thunk )
+{
+  if ( uploading_.empty() ) {
+    return false;
+  }
+
+  if ( missing_uploads_.count( thunk.hash() ) ) {
+    /* already waiting */
+    return true;
+  }
+
+  size_t missing = 0;
+
+  for ( const Thunk::DataList * dep_list : { &thunk.values(), &thunk.executables() } ) {
+    for ( const auto & dep : *dep_list ) {
+      if ( uploading_.count( dep.first ) ) {
+        blocked_jobs_[ dep.first ].push_back( thunk.hash() );
+        missing++;
       }
+    }
+  }
+
+  if ( missing ) {
+    missing_uploads_[ thunk.hash() ] = missing;
+  }
 
-      if ( cache_entry.initialized() ) {
-        finalize_execution( thunk_hash, cache_entry->hash, 0 );
+  return missing > 0;
+}
+
+void Reductor::download_output( const string & hash )
+{
+  if ( transfer_agent_ == nullptr or gg::blobs::exists( hash ) ) {
+    return;
+  }
+
+  transfer_agent_->download( { hash, gg::paths::blob_path( hash ) } );
+}
+
+void Reductor::schedule_jobs()
+{
+  while ( not job_queue_.empty() and running_jobs() < max_jobs_ ) {
+    const string thunk_hash { move( job_queue_.front() ) };
+    job_queue_.pop_front();
+
+    /* don't bother executing gg-execute if it's in the cache */
+    Optional<ReductionResult> cache_entry;
+
+    while ( true ) {
+      auto temp_cache_entry = gg::cache::check( cache_entry.initialized() ? cache_entry->hash
+                                                                          : thunk_hash );
+
+      if ( temp_cache_entry.initialized() ) {
+        cache_entry = move( temp_cache_entry );
       }
       else {
-        const Thunk & thunk = dep_graph_.get_thunk( thunk_hash );
+        break;
+      }
+    }
 
-        bool executing = false;
+    if ( cache_entry.initialized() ) {
+      finalize_execution( thunk_hash, cache_entry->hash, 0 );
+    }
+    else {
+      const Thunk & thunk = dep_graph_.get_thunk( thunk_hash );
+
+      if ( wait_for_uploads( thunk ) ) {
+        continue;
+      }
+
+      /* send the job where the fewest bytes have to be fetched for it; on
+         a tie, the engine that was asked for first wins */
+      ExecutionEngine * best_engine = nullptr;
+      uint64_t best_missing_bytes = 0;
+      bool executable = false;
 
-        for ( auto & exec_engine : exec_engines_ ) {
-          if ( exec_engine->can_execute( thunk ) ) {
-            exec_engine->force_thunk( thunk, exec_loop_ );
-            executing = true;
-            break;
-          }
+      for ( auto & exec_engine : exec_engines_ ) {
+        if ( not exec_engine->can_execute( thunk ) ) {
+          continue;
         }
 
-        if ( not executing ) {
-          throw runtime_error( "no execution engine could execute " + thunk_hash );
+        executable = true;
+
+        if ( not exec_engine->has_capacity() ) {
+          continue;
         }
 
-        running_jobs_.insert( thunk_hash );
+        const uint64_t missing_bytes = exec_engine->missing_input_bytes( thunk );
+
+        if ( best_engine == nullptr or missing_bytes < best_missing_bytes ) {
+          best_engine = exec_engine.get();
+          best_missing_bytes = missing_bytes;
+        }
       }
+
+      if ( not executable ) {
+        throw runtime_error( "no execution engine could execute " + thunk_hash );
+      }
+
+      if ( best_engine == nullptr ) {
+        /* the engines that can run it are all busy; try again later */
+        job_queue_.push_front( thunk_hash );
+        break;
+      }
+
+      best_engine->force_thunk( thunk, exec_loop_ );
+
+      running_jobs_.insert( thunk_hash );
     }
+  }
+}
+
+vector<string> Reductor::reduce()
+{
+  while ( true ) {
+    schedule_jobs();
 
     if ( status_bar_ ) {
       print_status();
@@ -311,30 +417,36 @@ vector<string> Reductor::reduce()
   }
 }
 
-void Reductor::upload_dependencies() const
+/* the objects that still have to be uploaded, out of `deps` */
+vector<storage::PutRequest>
+Reductor::missing_objects( const unordered_set<string> & deps ) const
 {
-  if ( storage_backend_ == nullptr ) {
-    return;
-  }
+  vector<storage::PutRequest> requests;
 
-  vector<storage::PutRequest> upload_requests;
-
-  for ( const string & dep : dep_graph_.value_dependencies() ) {
-    if ( gg::remote::is_available( dep ) ) {
+  for ( const string & dep : deps ) {
+    if ( gg::remote::is_available( dep ) or uploading_.count( dep ) ) {
       continue;
     }
 
-    upload_requests.push_back( { gg::paths::blob_path( dep ), dep,
-                                 gg::hash::to_hex( dep ) } );
+    requests.push_back( { gg::blobs::materialize( dep ), dep,
+                          gg::hash::to_hex( dep ) } );
   }
 
-  for ( const string & dep : dep_graph_.executable_dependencies() ) {
-    if ( gg::remote::is_available( dep ) ) {
-      continue;
-    }
+  return requests;
+}
 
-    upload_requests.push_back( { gg::paths::blob_path( dep ), dep,
-                                 gg::hash::to_hex( dep ) } );
+void Reductor::upload_dependencies()
+{
+  if ( transfer_agent_ == nullptr ) {
+    return;
+  }
+
+  vector<storage::PutRequest> upload_requests =
+    missing_objects( dep_graph_.value_dependencies() );
+
+  for ( storage::PutRequest & request :
+          missing_objects( dep_graph_.executable_dependencies() ) ) {
+    upload_requests.push_back( move( request ) );
   }
 
   if ( upload_requests.size() == 0 ) {
@@ -343,20 +455,108 @@ void Reductor::upload_dependencies() const
   }
 
   const string plural = upload_requests.size() == 1 ? "" : "s";
-  cerr << "\u2197 Uploading " << upload_requests.size() << " file" << plural << "... ";
+  cerr << "\u2197 Uploading " << upload_requests.size() << " file" << plural
+       << " in the background." << endl;
+
+  const auto upload_start = steady_clock::now();
+  const size_t upload_count = upload_requests.size();
+
+  for ( const storage::PutRequest & request : upload_requests ) {
+    uploading_.insert( request.object_key );
+
+    transfer_agent_->upload( request,
+      [this, upload_start, upload_count, plural] ( const string & hash )
+      {
+        finalize_upload( hash );
+
+        if ( uploading_.empty() ) {
+          print_gg_message( "info", "uploaded " + to_string( upload_count )
+                            + " file" + plural + " in "
+                            + to_string( duration_cast<milliseconds>(
+                                steady_clock::now() - upload_start ).count() )
+                            + " ms" );
+        }
+      } );
+  }
+}
+
+void Reductor::collect_dependencies( const string & hash,
+                                     unordered_set<string> & deps ) const
+{
+  const Thunk & thunk = dep_graph_.get_thunk( hash );
+
+  for ( const Thunk::DataList * dep_list : { &thunk.values(), &thunk.executables() } ) {
+    for ( const auto & dep : *dep_list ) {
+      if ( deps.insert( dep.first ).second and FileBundle::is_bundle( dep ) ) {
+        for ( const auto & entry : FileBundle::read( dep.first ).entries() ) {
+          deps.insert( entry.second );
+        }
+      }
+    }
+  }
 
-  auto upload_time = time_it<chrono::milliseconds>(
-    [&upload_requests, this]()
+  for ( const Thunk::DataItem & item : thunk.thunks() ) {
+    collect_dependencies( item.first, deps );
+  }
+}
+
+void Reductor::add_speculative_thunk( const string & thunk_hash )
+{
+  const string hash = dep_graph_.add_thunk( thunk_hash );
+
+  if ( transfer_agent_ != nullptr ) {
+    unordered_set<string> deps;
+    collect_dependencies( hash, deps );
+
+    for ( const storage::PutRequest & request : missing_objects( deps ) ) {
+      uploading_.insert( request.object_key );
+      transfer_agent_->upload( request,
+        [this] ( const string & uploaded ) { finalize_upload( uploaded ); } );
+    }
+  }
+
+  /* the thunks it shares with the earlier ones may be on their way already */
+  for ( const string & o1_hash : dep_graph_.order_one_dependencies( hash ) ) {
+    if ( running_jobs_.count( o1_hash ) or missing_uploads_.count( o1_hash ) or
+         find( job_queue_.begin(), job_queue_.end(), o1_hash ) != job_queue_.end() ) {
+      continue;
+    }
+
+    job_queue_.push_back( o1_hash );
+  }
+}
+
+void Reductor::speculate( FileDescriptor & notifications )
+{
+  bool accepting = true;
+  speculating_ = true;
+
+  exec_loop_.add_reader( notifications,
+    [this, &accepting] ( const string & thunk_hash )
     {
-      storage_backend_->put(
-        upload_requests,
-        [] ( const storage::PutRequest & upload_request )
-        { gg::remote::set_available( upload_request.object_key ); }
-      );
+      if ( thunk_hash.empty() ) {
+        accepting = false;
+        return;
+      }
+
+      try {
+        add_speculative_thunk( thunk_hash );
+      }
+      catch ( const exception & e ) {
+        print_gg_message( "warning", "not speculating on " + thunk_hash + ": "
+                          + e.what() );
+      }
+    } );
+
+  while ( accepting or running_jobs() > 0 ) {
+    if ( accepting ) {
+      schedule_jobs();
     }
-  );
 
-  cerr << "done (" << upload_time.count() << " ms)." << endl;
+    if ( exec_loop_.loop_once( -1 ).result == Poller::Result::Type::Exit ) {
+      break;
+    }
+  }
 }
 
 void Reductor::download_targets( const vector<string> & hashes ) const
@@ -365,9 +565,16 @@ void Reductor::download_targets( const vector<string> & hashes ) const
     return;
   }
 
+  /* most of the targets were fetched as soon as they were ready */
   vector<storage::GetRequest> download_requests;
   for ( const string & hash : hashes ) {
-    download_requests.push_back( { hash, gg::paths::blob_path( hash ) } );
+    if ( not gg::blobs::exists( hash ) ) {
+      download_requests.push_back( { hash, gg::paths::blob_path( hash ) } );
+    }
+  }
+
+  if ( download_requests.size() == 0 ) {
+    return;
   }
 
   cerr << "\u2198 Downloading output files... ";
@@ -8,11 +8,13 @@
 #include <deque>
 #include <memory>
 #include <unordered_set>
+#include <unordered_map>
 
 #include "loop.hh"
 #include "engine.hh"
 #include "thunk/graph.hh"
 #include "storage/backend.hh"
+#include "storage/transfer_agent.hh"
 
 enum class ExecutionEnvironment { LOCAL, GG_RUNNER, LAMBDA };
 
@@ -31,6 +33,9 @@ private:
   size_t finished_jobs_ { 0 };
   float estimated_cost_ { 0.0 };
 
+  /* jobs that fail to execute are dropped, rather than fatal */
+  bool speculating_ { false };
+
   int base_poller_timeout_ { -1 };
   int poller_timeout_ { -1 };
 
@@ -38,11 +43,30 @@ private:
   std::vector<std::unique_ptr<ExecutionEngine>> exec_engines_ {};
 
   std::unique_ptr<StorageBackend> storage_backend_;
+  std::unique_ptr<TransferAgent> transfer_agent_ {};
+
+  /* dependencies that are being uploaded, and the jobs waiting on them */
+  std::unordered_set<std::string> uploading_ {};
+  std::unordered_map<std::string, std::vector<std::string>> blocked_jobs_ {};
+  std::unordered_map<std::string, size_t> missing_uploads_ {};
 
   void finalize_execution( const std::string & old_hash,
                            const std::string & new_hash,
                            const float cost = 0.0 );
 
+  void finalize_upload( const std::string & hash );
+  bool wait_for_uploads( const gg::thunk::Thunk & thunk );
+  void download_output( const std::string & hash );
+
+  void schedule_jobs();
+
+  std::vector<storage::PutRequest>
+  missing_objects( const std::unordered_set<std::string> & deps ) const;
+
+  void collect_dependencies( const std::string & hash,
+                             std::unordered_set<std::string> & deps ) const;
+  void add_speculative_thunk( const std::string & thunk_hash );
+
   size_t running_jobs() const;
   bool is_finished() const;
 
@@ -55,8 +79,19 @@ public:
             const bool status_bar = false );
 
   std::vector<std::string> reduce();
-  void upload_dependencies() const;
+
+  /* starts uploading the dependencies in the background; each job is sent
+     out as soon as its own dependencies are uploaded, and the targets are
+     downloaded as soon as they are ready */
+  void upload_dependencies();
   void download_targets( const std::vector<std::string> & hashes ) const;
+
+  /* reduces the thunks that are read from `notifications` (one hash per
+     read), as they come: their inputs are uploaded and their order-one
+     dependencies are executed right away. it stops taking new jobs at EOF,
+     and returns once the running ones are done. a thunk that fails to
+     execute is dropped, along with everything that depends on it. */
+  void speculate( FileDescriptor & notifications );
   void print_status() const;
 };
 
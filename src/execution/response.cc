@@ -26,13 +26,18 @@ ExecutionResponse ExecutionResponse::parse_message( const std::string & message
   }
 
   response.status = static_cast<JobStatus>( response_proto.return_code() );
+  response.blob_summary = response_proto.blob_summary();
 
   if ( response.status != JobStatus::Success ) {
     return response;
   }
 
+  /* the current implementation only supports one thunk execution per response */
   if ( response_proto.executed_thunks_size() != 1 ) {
-    throw runtime_error( "current implementation only supports one thunk execution per response" );
+    cerr << "invalid response: " << response_proto.executed_thunks_size()
+         << " thunks executed" << endl;
+    response.status = JobStatus::OperationalFailure;
+    return response;
   }
 
   for ( const auto & output_proto : response_proto.executed_thunks( 0 ).outputs() ) {
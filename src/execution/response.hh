@@ -51,6 +51,10 @@ public:
 
   std::string stdout {};
 
+  /* a Bloom filter over the hashes of the blobs the worker holds, if it
+     sent one (see util/bloom_filter.hh) */
+  std::string blob_summary {};
+
   static ExecutionResponse parse_message( const std::string & message );
 };
 
@@ -0,0 +1,448 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <cstdlib>
+#include <csignal>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#include "net/socket.hh"
+#include "net/http_request.hh"
+#include "storage/backend_chunked.hh"
+#include "thunk/ggutils.hh"
+#include "util/compression.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/mmap.hh"
+#include "util/path.hh"
+#include "util/sha256.hh"
+#include "util/temp_file.hh"
+#include "util/tokenize.hh"
+#include "util/units.hh"
+
+using namespace std;
+
+const string ZSTD_SUFFIX = ".zst";
+
+/* the request line and the headers have to fit in this much */
+const size_t MAX_HEAD_SIZE = 64_KiB;
+
+/* how much of a blob is kept around to check whether it's a chunk manifest;
+   the manifest of even a very large object is smaller than this */
+const size_t MAX_MANIFEST_SIZE = 1_MiB;
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [-a ADDRESS] [-p PORT] DIRECTORY" << endl;
+}
+
+/* keys are gg hashes (or other simple names), never paths */
+bool valid_key( const string & key )
+{
+  if ( key.length() == 0 or key[ 0 ] == '.' ) {
+    return false;
+  }
+
+  for ( const char c : key ) {
+    if ( not ( isalnum( c ) or c == '.' or c == '_' or c == '-' ) ) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* the blobs are spread over subdirectories named after the first characters
+   of their hash (skipping the type character) */
+roost::path shard_dir( const roost::path & root, const string & key )
+{
+  return root / ( key.length() > 2 ? key.substr( 1, 2 ) : "_" );
+}
+
+string response_header( const string & status, const size_t content_length,
+                        const string & content_encoding = {} )
+{
+  string output = "HTTP/1.1 " + status + "\r\n"
+                  "Content-Length: " + to_string( content_length ) + "\r\n";
+
+  if ( content_encoding.length() ) {
+    output += "Content-Encoding: " + content_encoding + "\r\n";
+  }
+
+  return output + "\r\n";
+}
+
+void send_file( TCPSocket & connection, const roost::path & path,
+                const string & content_encoding )
+{
+  FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                         open( path.string().c_str(), O_RDONLY ) ) };
+
+  struct stat info;
+  CheckSystemCall( "fstat", fstat( file.fd_num(), &info ) );
+
+  connection.write( response_header( "200 OK", info.st_size, content_encoding ) );
+
+  off_t offset = 0;
+  while ( offset < info.st_size ) {
+    CheckSystemCall( "sendfile", sendfile( connection.fd_num(), file.fd_num(),
+                                           &offset, info.st_size - offset ) );
+  }
+}
+
+void handle_get( TCPSocket & connection, const roost::path & root, const string & key )
+{
+  const roost::path plain_path = shard_dir( root, key ) / key;
+  const roost::path compressed_path = shard_dir( root, key ) / ( key + ZSTD_SUFFIX );
+
+  /* the blob can go away between the check and the open, but never
+     comes back different */
+  try {
+    if ( roost::exists( plain_path ) ) {
+      send_file( connection, plain_path, {} );
+      return;
+    }
+    else if ( roost::exists( compressed_path ) ) {
+      send_file( connection, compressed_path, "zstd" );
+      return;
+    }
+  }
+  catch ( const unix_error & e ) {
+    if ( e.error_code() != ENOENT ) { throw; }
+  }
+
+  connection.write( response_header( "404 Not Found", 0 ) );
+}
+
+/* moves the next `length` bytes of the request body (starting with the
+   ones that were already read) to `output`, or drops them if there's no
+   output. the body is never held in memory as a whole. */
+void receive_body( TCPSocket & connection, string & buffer, size_t length,
+                   FileDescriptor * output )
+{
+  while ( length > 0 ) {
+    if ( buffer.empty() ) {
+      buffer = connection.read();
+
+      if ( connection.eof() ) {
+        throw runtime_error( "connection closed in the middle of a body" );
+      }
+    }
+
+    const size_t piece = min( length, buffer.length() );
+
+    if ( output ) {
+      output->write( buffer.cbegin(), buffer.cbegin() + piece );
+    }
+
+    buffer.erase( 0, piece );
+    length -= piece;
+  }
+}
+
+/* hands the contents of a blob to `consume`, a window at a time */
+void read_blob( const roost::path & path, const bool is_compressed,
+                const function<void( const char *, size_t )> & consume )
+{
+  FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                         open( path.string().c_str(), O_RDONLY ) ) };
+  const size_t size = roost::file_size( path );
+
+  if ( size == 0 ) {
+    return;
+  }
+
+  const MappedFile contents { file, size };
+
+  if ( is_compressed ) {
+    compression::zstd_decompress( contents.data(), contents.size(), consume );
+    return;
+  }
+
+  for ( size_t offset = 0; offset < size; offset += BUFFER_SIZE ) {
+    consume( contents.data() + offset, min( BUFFER_SIZE, size - offset ) );
+  }
+}
+
+/* does the blob hash to its key? the key of a chunked object names its
+   manifest instead, which is fine if the chunks it lists (they're stored
+   before the manifest) add up to the object. */
+bool matches_key( const roost::path & root, const string & key,
+                  const roost::path & path, const bool is_compressed )
+{
+  digest::SHA256 hasher;
+  string head;
+
+  read_blob( path, is_compressed,
+    [&] ( const char * data, const size_t length )
+    {
+      if ( hasher.length() < MAX_MANIFEST_SIZE ) {
+        head.append( data, min<size_t>( length, MAX_MANIFEST_SIZE - hasher.length() ) );
+      }
+
+      hasher.update( data, length );
+    } );
+
+  const uint64_t size = hasher.length();
+
+  if ( gg::hash::from_digest( hasher.digest(), gg::hash::type( key ), size ) == key ) {
+    return true;
+  }
+
+  if ( size > MAX_MANIFEST_SIZE ) {
+    return false;
+  }
+
+  vector<string> chunks;
+
+  try {
+    chunks = ChunkedStorageBackend::parse_manifest( key, head );
+  }
+  catch ( const runtime_error & ) {
+    return false;
+  }
+
+  digest::SHA256 object_hasher;
+  const auto consume = [&object_hasher] ( const char * data, const size_t length )
+    {
+      object_hasher.update( data, length );
+    };
+
+  for ( const string & chunk : chunks ) {
+    const roost::path dir = shard_dir( root, chunk );
+
+    if ( roost::exists( dir / chunk ) ) {
+      read_blob( dir / chunk, false, consume );
+    }
+    else if ( roost::exists( dir / ( chunk + ZSTD_SUFFIX ) ) ) {
+      read_blob( dir / ( chunk + ZSTD_SUFFIX ), true, consume );
+    }
+    else {
+      return false;
+    }
+  }
+
+  return gg::hash::from_digest( object_hasher.digest(), gg::hash::type( key ),
+                                object_hasher.length() ) == key;
+}
+
+void handle_put( TCPSocket & connection, string & buffer, const roost::path & root,
+                 const string & key, const HTTPRequest & request,
+                 const size_t body_length )
+{
+  const bool is_compressed = request.has_header( "Content-Encoding" ) and
+                             request.get_header_value( "Content-Encoding" ) == "zstd";
+
+  if ( request.has_header( "Content-Encoding" ) and not is_compressed ) {
+    receive_body( connection, buffer, body_length, nullptr );
+    connection.write( response_header( "415 Unsupported Media Type", 0 ) );
+    return;
+  }
+
+  /* only content-addressed blobs can be checked, so they're all we take */
+  if ( not gg::hash::to_binary( key ).initialized() ) {
+    receive_body( connection, buffer, body_length, nullptr );
+    connection.write( response_header( "400 Bad Request", 0 ) );
+    return;
+  }
+
+  const roost::path dir = shard_dir( root, key );
+
+  /* blobs are content-addressed, so there's nothing to do if we have this
+     one already, in either form */
+  if ( roost::exists( dir / key ) or roost::exists( dir / ( key + ZSTD_SUFFIX ) ) ) {
+    receive_body( connection, buffer, body_length, nullptr );
+    connection.write( response_header( "200 OK", 0 ) );
+    return;
+  }
+
+  if ( not roost::exists( dir ) ) {
+    roost::create_directories( dir );
+  }
+
+  UniqueFile incoming { ( dir / ( "." + key ) ).string() };
+  receive_body( connection, buffer, body_length, &incoming.fd() );
+  incoming.fd().close();
+
+  bool matches = false;
+
+  try {
+    matches = matches_key( root, key, incoming.name(), is_compressed );
+  }
+  catch ( const runtime_error & ) {
+    /* not a valid zstd stream */
+  }
+
+  if ( not matches ) {
+    roost::remove( incoming.name() );
+    connection.write( response_header( "400 Bad Request", 0 ) );
+    return;
+  }
+
+  roost::rename( incoming.name(), dir / ( is_compressed ? key + ZSTD_SUFFIX : key ) );
+
+  connection.write( response_header( "200 OK", 0 ) );
+}
+
+/* answers the requests on a connection in order, as they come in. only the
+   request lines and the headers are parsed here; the bodies are streamed
+   by the handlers. */
+void serve( TCPSocket connection, const roost::path root )
+{
+  try {
+    connection.set_nodelay();
+
+    string buffer;
+
+    while ( true ) {
+      size_t head_end;
+
+      while ( ( head_end = buffer.find( CRLF + CRLF ) ) == string::npos ) {
+        if ( buffer.length() > MAX_HEAD_SIZE ) {
+          connection.write( response_header( "400 Bad Request", 0 ) );
+          return;
+        }
+
+        const string data = connection.read();
+
+        if ( connection.eof() ) {
+          return;
+        }
+
+        buffer += data;
+      }
+
+      const vector<string> lines = split( buffer.substr( 0, head_end ), CRLF );
+      buffer.erase( 0, head_end + 2 * CRLF.length() );
+
+      HTTPRequest request;
+      request.set_first_line( lines.at( 0 ) );
+
+      for ( size_t i = 1; i < lines.size(); i++ ) {
+        request.add_header( lines[ i ] );
+      }
+
+      const string & first_line = request.first_line();
+
+      const size_t method_end = first_line.find( ' ' );
+      const size_t url_end = first_line.find( ' ', method_end + 1 );
+      const string method = first_line.substr( 0, method_end );
+      const string url = first_line.substr( method_end + 1, url_end - method_end - 1 );
+
+      /* anything before the last slash is a prefix chosen by the client */
+      const string key = url.substr( url.rfind( '/' ) + 1 );
+
+      const bool has_length = request.has_header( "Content-Length" );
+      const size_t body_length = has_length
+                                 ? stoull( request.get_header_value( "Content-Length" ) )
+                                 : 0;
+
+      if ( method_end == string::npos or url_end == string::npos or not valid_key( key ) ) {
+        receive_body( connection, buffer, body_length, nullptr );
+        connection.write( response_header( "400 Bad Request", 0 ) );
+      }
+      else if ( method == "GET" ) {
+        receive_body( connection, buffer, body_length, nullptr );
+        handle_get( connection, root, key );
+      }
+      else if ( method == "PUT" and not has_length ) {
+        /* there's no telling where the next request starts */
+        connection.write( response_header( "411 Length Required", 0 ) );
+        return;
+      }
+      else if ( method == "PUT" ) {
+        handle_put( connection, buffer, root, key, request, body_length );
+      }
+      else {
+        receive_body( connection, buffer, body_length, nullptr );
+        connection.write( response_header( "405 Method Not Allowed", 0 ) );
+      }
+
+      if ( request.has_header( "Connection" ) and
+           request.get_header_value( "Connection" ) == "close" ) {
+        return;
+      }
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( "connection", e );
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    string listen_address = "0.0.0.0";
+    uint16_t listen_port = 8080;
+
+    const option command_line_options[] = {
+      { "address", required_argument, nullptr, 'a' },
+      { "port",    required_argument, nullptr, 'p' },
+      { nullptr,   0,                 nullptr,  0  },
+    };
+
+    while ( true ) {
+      const int opt = getopt_long( argc, argv, "a:p:", command_line_options, nullptr );
+
+      if ( opt == -1 ) {
+        break;
+      }
+
+      switch ( opt ) {
+      case 'a':
+        listen_address = optarg;
+        break;
+
+      case 'p':
+        listen_port = stoul( optarg );
+        break;
+
+      default:
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+
+    if ( optind != argc - 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const roost::path root { argv[ optind ] };
+
+    if ( not roost::exists( root ) ) {
+      roost::create_directories( root );
+    }
+
+    /* a client going away shouldn't take the server down */
+    signal( SIGPIPE, SIG_IGN );
+
+    TCPSocket listener;
+    listener.set_reuseaddr();
+    listener.bind( { listen_address, listen_port } );
+    listener.listen( 128 );
+
+    cerr << "Serving " << root.string() << " on "
+         << listener.local_address().str() << endl;
+
+    while ( true ) {
+      thread { serve, listener.accept(), root }.detach();
+    }
+  }
+  catch ( const exception &  e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,9 +1,12 @@
 /* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
 
 #include <iostream>
+#include <vector>
 
+#include "thunk/blobs.hh"
 #include "thunk/ggutils.hh"
 #include "util/exception.hh"
+#include "util/parallel.hh"
 #include "util/path.hh"
 
 using namespace std;
@@ -28,16 +31,17 @@ int main( int argc, char * argv[] )
 
     gg::paths::blobs(); // Trigger the exception if GG_DIR is not set.
 
-    for ( int i = 1; i < argc; i++ ) {
-      roost::path src { argv[ i ] };
-      string hash = gg::hash::file( src );
-      roost::path dst = gg::paths::blob_path( hash );
+    const vector<roost::path> sources { argv + 1, argv + argc };
+    const vector<string> hashes = gg::hash::files( sources );
 
-      if ( not roost::exists( dst ) ) {
-        roost::copy_then_rename( src, dst );
-      }
+    parallel_for( sources.size(),
+      [&sources, &hashes] ( const size_t i )
+      {
+        gg::blobs::insert( hashes[ i ], sources[ i ] );
+      } );
 
-      cerr << "Collected " << src.string() << " as " << hash << "." << endl;
+    for ( size_t i = 0; i < sources.size(); i++ ) {
+      cerr << "Collected " << sources[ i ].string() << " as " << hashes[ i ] << "." << endl;
     }
 
     return EXIT_SUCCESS;
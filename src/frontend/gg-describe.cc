@@ -7,6 +7,7 @@
 #include <glob.h>
 #include <google/protobuf/util/json_util.h>
 
+#include "thunk/blobs.hh"
 #include "thunk/thunk.hh"
 #include "thunk/thunk_reader.hh"
 #include "thunk/ggutils.hh"
@@ -61,7 +62,7 @@ int main( int argc, char * argv[] )
     roost::path thunk_path { argv[ optind ] };
 
     if ( not roost::exists( thunk_path ) ) {
-      thunk_path = gg::paths::blob_path( argv[ optind ] );
+      thunk_path = gg::blobs::materialize( argv[ optind ] );
 
       if ( not roost::exists( thunk_path ) ) {
         roost::path pattern { thunk_path.string() + "*" };
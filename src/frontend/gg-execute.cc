@@ -10,7 +10,10 @@
 
 #include "execution/response.hh"
 #include "net/requests.hh"
+#include "sandbox/namespaced_process.hh"
 #include "storage/backend.hh"
+#include "thunk/blobs.hh"
+#include "thunk/bundle.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/factory.hh"
 #include "thunk/thunk_reader.hh"
@@ -19,6 +22,7 @@
 #include "util/child_process.hh"
 #include "util/digest.hh"
 #include "util/exception.hh"
+#include "util/optional.hh"
 #include "util/path.hh"
 #include "util/temp_dir.hh"
 #include "util/temp_file.hh"
@@ -30,10 +34,14 @@ using namespace gg::thunk;
 using ReductionResult = gg::cache::ReductionResult;
 
 const bool sandboxed = ( getenv( "GG_SANDBOXED" ) != NULL );
-const string temp_dir_template = "/tmp/thunk-execute";
-const string temp_file_template = "/tmp/thunk-file";
 
-vector<string> execute_thunk( const Thunk & original_thunk )
+/* GG_SANDBOX_MODE=namespace enforces the sandbox with namespaces instead of
+   tracing, where the kernel allows it */
+const bool namespace_sandbox = sandboxed and ( getenv( "GG_SANDBOX_MODE" ) != NULL )
+                               and ( string( getenv( "GG_SANDBOX_MODE" ) ) == "namespace" );
+
+/* the outputs are added to `pin`, if there's one, before they're stored */
+vector<string> execute_thunk( const Thunk & original_thunk, blobs::Pin * pin )
 {
   Thunk thunk = original_thunk;
 
@@ -59,12 +67,31 @@ vector<string> execute_thunk( const Thunk & original_thunk )
          << "thunk:" << thunk.hash() << "." << endl;
   }
 
+  /* the function gets to see the files in the bundles, not the bundles */
+  if ( FileBundle::has_bundles( thunk ) ) {
+    thunk = FileBundle::expand( thunk );
+    thunk.set_hash( ThunkWriter::write( thunk ) );
+  }
+
   /* when executing the thunk, we create a temp directory, and execute the thunk
      in that directory. then we take the outfile, compute the hash, and move it
      to the .gg directory. */
 
   // PREPARING THE ENV
-  TempDirectory exec_dir { temp_dir_template };
+  /* the function gets to its inputs through the file system */
+  blobs::materialize( thunk.hash() );
+
+  for ( const Thunk::DataItem & item : thunk.values() ) {
+    blobs::materialize( item.first );
+  }
+
+  for ( const Thunk::DataItem & item : thunk.executables() ) {
+    roost::make_executable( blobs::materialize( item.first ) );
+  }
+
+  /* the execution directory is on the same file system as the blobs, so
+     that the outputs can be moved in with a rename */
+  TempDirectory exec_dir { ( gg::paths::scratch() / "thunk-execute" ).string() };
   roost::path exec_dir_path { exec_dir.name() };
   roost::path outfile_path { "output" };
 
@@ -92,6 +119,25 @@ vector<string> execute_thunk( const Thunk & original_thunk )
       }
     }
   }
+  else if ( namespace_sandbox and NamespacedProcess::supported() ) {
+    roost::create_directories( exec_dir_path );
+
+    NamespacedProcess process {
+      "execute(" + thunk.hash().substr( 0, 5 ) + ")",
+      thunk.get_allowed_files(),
+      exec_dir_path.string(),
+      [thunk]() {
+        return thunk.execute();
+      }
+    };
+
+    try {
+      process.execute();
+    }
+    catch( const exception & ex ) {
+      throw_with_nested( ExecutionError {} );
+    }
+  }
   else {
     auto allowed_files = thunk.get_allowed_files();
 
@@ -125,16 +171,14 @@ vector<string> execute_thunk( const Thunk & original_thunk )
       throw ExecutionError {};
     }
 
-    /* let's check if the output is a thunk or not */
     string outfile_hash = gg::hash::file( outfile );
-    roost::path outfile_gg = gg::paths::blob_path( outfile_hash );
 
-    if ( not roost::exists( outfile_gg ) ) {
-      roost::move_file( outfile, outfile_gg );
-    } else {
-      roost::remove( outfile );
+    if ( pin ) {
+      pin->add( { outfile_hash } );
     }
 
+    blobs::insert( outfile_hash, outfile, true );
+
     output_hashes.emplace_back( move( outfile_hash ) );
   }
 
@@ -158,7 +202,7 @@ vector<string> execute_thunk( const Thunk & original_thunk )
   return output_hashes;
 }
 
-void do_cleanup( const Thunk & thunk )
+unordered_set<string> input_hashes( const Thunk & thunk )
 {
   unordered_set<string> infile_hashes;
 
@@ -166,22 +210,26 @@ void do_cleanup( const Thunk & thunk )
 
   for ( const Thunk::DataItem & item : thunk.values() ) {
     infile_hashes.emplace( item.first );
+
+    /* if we don't have the bundle yet, we can't know what's in it */
+    if ( FileBundle::is_bundle( item ) and blobs::exists( item.first ) ) {
+      for ( const auto & entry : FileBundle::read( item.first ).entries() ) {
+        infile_hashes.emplace( entry.second );
+      }
+    }
   }
 
   for ( const Thunk::DataItem & item : thunk.executables() ) {
     infile_hashes.emplace( item.first );
   }
 
-  for ( const string & blob : roost::list_directory( gg::paths::blobs() ) ) {
-    const roost::path path = gg::paths::blob_path( blob );
-    if ( ( not roost::is_directory( path ) ) and infile_hashes.count( blob ) == 0 ) {
-      roost::remove( path );
-    }
-  }
+  return infile_hashes;
 }
 
+/* the files in the bundles are added to `pin`, if there's one, as soon as
+   the bundles are there to say what they are */
 void fetch_dependencies( unique_ptr<StorageBackend> & storage_backend,
-                         const Thunk & thunk )
+                         const Thunk & thunk, blobs::Pin * pin )
 {
   try {
     vector<storage::GetRequest> download_items;
@@ -191,8 +239,9 @@ void fetch_dependencies( unique_ptr<StorageBackend> & storage_backend,
       {
         const auto target_path = gg::paths::blob_path( item.first );
 
-        if ( not roost::exists( target_path )
-             or roost::file_size( target_path ) != gg::hash::size( item.first ) ) {
+        if ( roost::exists( target_path ) ?
+             roost::file_size( target_path ) != gg::hash::size( item.first ) :
+             not blobs::exists( item.first ) ) {
           download_items.push_back( { item.first, target_path } );
         }
       };
@@ -207,8 +256,25 @@ void fetch_dependencies( unique_ptr<StorageBackend> & storage_backend,
       storage_backend->get( download_items );
     }
 
-    for ( const Thunk::DataItem & item : thunk.executables() ) {
-      roost::make_executable( gg::paths::blob_path( item.first ) );
+    /* now that we have the bundles, the files in them */
+    download_items.clear();
+
+    if ( pin ) {
+      pin->add( input_hashes( thunk ) );
+    }
+
+    for ( const Thunk::DataItem & item : thunk.values() ) {
+      if ( not FileBundle::is_bundle( item ) ) {
+        continue;
+      }
+
+      for ( const auto & entry : FileBundle::read( item.first ).entries() ) {
+        check_dep( { entry.second, entry.first } );
+      }
+    }
+
+    if ( download_items.size() > 0 ) {
+      storage_backend->get( download_items );
     }
   }
   catch ( const exception & ex ) {
@@ -222,7 +288,7 @@ void upload_output( unique_ptr<StorageBackend> & storage_backend,
   try {
     vector<storage::PutRequest> requests;
     for ( const string & output_hash : output_hashes ) {
-      requests.push_back( { gg::paths::blob_path( output_hash ), output_hash,
+      requests.push_back( { blobs::materialize( output_hash ), output_hash,
                             gg::hash::to_hex( output_hash ) } );
     }
     storage_backend->put( requests );
@@ -240,6 +306,8 @@ void usage( const char * argv0 )
   << " -g, --get-dependencies  Fetch the missing dependencies from the remote storage" << endl
   << " -p, --put-output        Upload the output to the remote storage" << endl
   << " -C, --cleanup           Remove unnecessary blobs in .gg dir" << endl
+  << " -R, --retain=SIZE       Keep up to SIZE bytes (K, M or G) of blobs in .gg dir," << endl
+  << "                         removing the least recently used ones first" << endl
   << endl;
 }
 
@@ -258,17 +326,19 @@ int main( int argc, char * argv[] )
     bool get_dependencies = false;
     bool put_output = false;
     bool cleanup = false;
+    Optional<uint64_t> retain_budget;
     unique_ptr<StorageBackend> storage_backend;
 
     const option command_line_options[] = {
       { "get-dependencies", no_argument, nullptr, 'g' },
       { "put-output",       no_argument, nullptr, 'p' },
       { "cleanup",          no_argument, nullptr, 'C' },
+      { "retain",           required_argument, nullptr, 'R' },
       { nullptr, 0, nullptr, 0 },
     };
 
     while ( true ) {
-      const int opt = getopt_long( argc, argv, "gpc", command_line_options, nullptr );
+      const int opt = getopt_long( argc, argv, "gpCR:", command_line_options, nullptr );
 
       if ( opt == -1 ) {
         break;
@@ -278,6 +348,7 @@ int main( int argc, char * argv[] )
       case 'g': get_dependencies = true; break;
       case 'p': put_output = true; break;
       case 'C': cleanup = true; break;
+      case 'R': retain_budget.reset( parse_size( optarg ) ); break;
 
       default:
         throw runtime_error( "invalid option: " + string { argv[ optind - 1 ] } );
@@ -297,10 +368,34 @@ int main( int argc, char * argv[] )
 
     gg::models::init();
 
+    /* the pin keeps other gg-execute processes from evicting the inputs and
+       the outputs of this batch while we're using them. there's only one
+       round of eviction (or cleanup) for the whole batch, so we don't throw
+       away the outputs of one thunk while running the next. */
+    unique_ptr<blobs::Pin> pin;
+
+    if ( cleanup or retain_budget.initialized() ) {
+      unordered_set<string> batch_inputs;
+
+      for ( const string & thunk_hash : thunk_hashes ) {
+        const Thunk thunk = ThunkReader::read( blobs::materialize( thunk_hash ) );
+        const unordered_set<string> inputs = input_hashes( thunk );
+        batch_inputs.insert( inputs.begin(), inputs.end() );
+      }
+
+      if ( cleanup ) {
+        blobs::retain_only( batch_inputs );
+      }
+      else {
+        pin.reset( new blobs::Pin( batch_inputs ) );
+        blobs::evict( *retain_budget );
+      }
+    }
+
     for ( const string & thunk_hash : thunk_hashes ) {
       /* take out an advisory lock on the thunk, in case
          other gg-execute processes are running at the same time */
-      const string thunk_path = gg::paths::blob_path( thunk_hash ).string();
+      const string thunk_path = blobs::materialize( thunk_hash ).string();
       FileDescriptor raw_thunk { CheckSystemCall( "open( " + thunk_path + " )",
                                                   open( thunk_path.c_str(), O_RDONLY ) ) };
       raw_thunk.block_for_exclusive_lock();
@@ -311,15 +406,11 @@ int main( int argc, char * argv[] )
         storage_backend = StorageBackend::create_backend( gg::remote::storage_backend_uri() );
       }
 
-      if ( cleanup ) {
-        do_cleanup( thunk );
-      }
-
       if ( get_dependencies ) {
-        fetch_dependencies( storage_backend, thunk );
+        fetch_dependencies( storage_backend, thunk, pin.get() );
       }
 
-      vector<string> output_hashes = execute_thunk( thunk );
+      vector<string> output_hashes = execute_thunk( thunk, pin.get() );
 
       if ( put_output ) {
         upload_output( storage_backend, output_hashes );
@@ -9,8 +9,10 @@
 
 #include "execution/reductor.hh"
 #include "net/s3.hh"
+#include "net/socket.hh"
 #include "storage/backend_local.hh"
 #include "storage/backend_s3.hh"
+#include "thunk/blobs.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/placeholder.hh"
 #include "thunk/thunk_reader.hh"
@@ -29,15 +31,22 @@ using namespace gg::thunk;
 void usage( const char * argv0 )
 {
   cerr << "Usage: " << argv0 << " [options] THUNKS..." << endl
+       << "       " << argv0 << " [options] --speculate SOCKET" << endl
        << endl
        << "Options:" << endl
-       << " -j, --jobs    maximum number of jobs to run in parallel" << endl
-       << " -s, --status  show the status bar for the job" << endl
-       << " -T, --timeout number of seconds before duplicating running jobs" << endl
+       << " -j, --jobs      maximum number of jobs to run in parallel" << endl
+       << " -s, --status    show the status bar for the job" << endl
+       << " -T, --timeout   number of seconds before duplicating running jobs" << endl
+       << " -S, --speculate reduce the thunks whose hashes are sent to SOCKET, as" << endl
+       << "                 they come, until an empty message (used by gg-infer)" << endl
        << endl
        << "Useful environment variables:" << endl
        << "  GG_SANDBOXED => if set, forces the thunks in a sandbox" << endl
-       << "  GG_REMOTE    => execute the thunks on AWS Lambda" << endl
+       << "  GG_SANDBOX_MODE=namespace => build the sandbox with namespaces instead" << endl
+       << "                  of tracing the thunk, if the kernel allows it" << endl
+       << "  GG_LAMBDA    => execute the thunks on AWS Lambda" << endl
+       << "  GG_REMOTE    => execute the thunks on the gg runners in GG_RUNNER_SERVER," << endl
+       << "                  a comma-separated list of ip:port[/max-jobs]" << endl
        << endl;
 }
 
@@ -74,16 +83,18 @@ int main( int argc, char * argv[] )
     size_t max_jobs = thread::hardware_concurrency();
     bool status_bar = false;
     int timeout = -1;
+    string speculate_socket;
 
     struct option long_options[] = {
       { "status", no_argument, nullptr, 's' },
       { "jobs", required_argument, nullptr, 'j' },
       { "timeout", required_argument, nullptr, 'T' },
+      { "speculate", required_argument, nullptr, 'S' },
       { nullptr, 0, nullptr, 0 },
     };
 
     while ( true ) {
-      const int opt = getopt_long( argc, argv, "sj:T:", long_options, NULL );
+      const int opt = getopt_long( argc, argv, "sj:T:S:", long_options, NULL );
 
       if ( opt == -1 ) {
         break;
@@ -103,11 +114,19 @@ int main( int argc, char * argv[] )
         timeout = stoi( optarg );
         break;
 
+      case 'S':
+        speculate_socket = optarg;
+        break;
+
       default:
         throw runtime_error( "invalid option" );
       }
     }
 
+    if ( not speculate_socket.empty() and optind < argc ) {
+      throw runtime_error( "--speculate doesn't take any thunks" );
+    }
+
     check_rlimit_nofile( max_jobs );
 
     gg::models::init();
@@ -159,6 +178,17 @@ int main( int argc, char * argv[] )
       storage_backend = StorageBackend::create_backend( gg::remote::storage_backend_uri() );
     }
 
+    if ( not speculate_socket.empty() ) {
+      UnixSocket notifications { SOCK_DGRAM };
+      notifications.bind( speculate_socket );
+
+      Reductor reductor { {}, max_jobs, execution_environments,
+                          move( storage_backend ) };
+      reductor.speculate( notifications );
+
+      return EXIT_SUCCESS;
+    }
+
     Reductor reductor { target_hashes, max_jobs,
                         execution_environments,
                         move( storage_backend ),
@@ -170,7 +200,7 @@ int main( int argc, char * argv[] )
     reductor.download_targets( reduced_hashes );
 
     for ( size_t i = 0; i < reduced_hashes.size(); i++ ) {
-      roost::copy_then_rename( gg::paths::blob_path( reduced_hashes[ i ] ), target_filenames[ i ] );
+      roost::copy_then_rename( gg::blobs::materialize( reduced_hashes[ i ] ), target_filenames[ i ] );
 
       /* HACK this is a just a dirty hack... it's not always right */
       roost::make_executable( target_filenames[ i ] );
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include <cstdlib>
 #include <fcntl.h>
 
@@ -11,13 +12,14 @@
 #include "thunk/thunk.hh"
 #include "util/exception.hh"
 #include "util/file_descriptor.hh"
+#include "util/path.hh"
 
 using namespace std;
 using namespace gg;
 
 void usage( const char * argv0 )
 {
-  cerr << argv0 << " FILENAME" << endl;
+  cerr << argv0 << " FILENAME..." << endl;
 }
 
 int main( int argc, char * argv[] )
@@ -27,12 +29,16 @@ int main( int argc, char * argv[] )
       abort();
     }
 
-    if ( argc != 2 ) {
+    if ( argc < 2 ) {
       usage( argv[ 0 ] );
       return EXIT_FAILURE;
     }
 
-    cout << gg::hash::file( argv[ 1 ] ) << endl;
+    const vector<roost::path> filenames { argv + 1, argv + argc };
+
+    for ( const string & hash : gg::hash::files( filenames ) ) {
+      cout << hash << endl;
+    }
   }
   catch ( const exception &  e ) {
     print_exception( argv[ 0 ], e );
@@ -1,12 +1,18 @@
 /* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
 
 #include <unistd.h>
+#include <sys/prctl.h>
+#include <csignal>
 #include <cstdlib>
 #include <iostream>
 #include <string>
 
 #include "thunk/ggutils.hh"
+#include "util/child_process.hh"
 #include "util/exception.hh"
+#include "util/optional.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
 #include "util/util.hh"
 
 using namespace std;
@@ -16,6 +22,18 @@ void usage( const char * argv0 )
   cerr << argv0 << " command [args...]" << endl;
 }
 
+void wait_for_socket( Optional<ChildProcess> & helper, const string & socket_path )
+{
+  if ( not helper.initialized() ) {
+    return;
+  }
+
+  for ( int i = 0; i < 100 and not roost::exists( socket_path ) and
+                   not helper->waitable(); i++ ) {
+    usleep( 10 * 1000 );
+  }
+}
+
 int main( int argc, char * argv[] )
 {
   try {
@@ -41,7 +59,85 @@ int main( int argc, char * argv[] )
     setenv( "PATH", new_path.c_str(), true );
     setenv( "GG_REALPATH", system_path.c_str(), true );
 
-    CheckSystemCall( "execvp", execvp( argv[ 1 ], argv + 1 ) );
+    const bool use_modeld = ( getenv( "GG_NO_MODELD" ) == nullptr );
+    const bool speculate = ( getenv( "GG_SPECULATE" ) != nullptr );
+
+    if ( not use_modeld and not speculate ) {
+      CheckSystemCall( "execvp", execvp( argv[ 1 ], argv + 1 ) );
+    }
+
+    /* the helpers listen on sockets in here, for as long as the command runs */
+    TempDirectory socket_dir { "/tmp/gg-infer" };
+    const string modeld_socket = socket_dir.name() + "/modeld";
+    const string speculate_socket = socket_dir.name() + "/speculate";
+
+    Optional<ChildProcess> modeld;
+    Optional<ChildProcess> speculator;
+
+    /* the models are served by a gg-modeld */
+    if ( use_modeld ) {
+      modeld.initialize( "gg-modeld",
+        [&modeld_socket] ()
+        {
+          return execlp( "gg-modeld", "gg-modeld", modeld_socket.c_str(), nullptr );
+        } );
+    }
+
+    /* and the thunks are reduced while they are being created */
+    if ( speculate ) {
+      speculator.initialize( "gg-force",
+        [&speculate_socket] ()
+        {
+          /* it shouldn't outlive us, even if we're killed */
+          CheckSystemCall( "prctl", prctl( PR_SET_PDEATHSIG, SIGKILL ) );
+          return execlp( "gg-force", "gg-force", "--speculate",
+                         speculate_socket.c_str(), nullptr );
+        } );
+    }
+
+    /* until they're up, the models just run on their own */
+    wait_for_socket( modeld, modeld_socket );
+    wait_for_socket( speculator, speculate_socket );
+
+    if ( use_modeld ) {
+      setenv( "GG_MODELD_SOCKET", modeld_socket.c_str(), true );
+    }
+
+    if ( speculate ) {
+      setenv( "GG_SPECULATE_SOCKET", speculate_socket.c_str(), true );
+    }
+
+    ChildProcess command { argv[ 1 ],
+      [&argv] () { return execvp( argv[ 1 ], argv + 1 ); } };
+
+    while ( not command.terminated() ) {
+      command.wait();
+    }
+
+    if ( modeld.initialized() ) {
+      modeld->signal( SIGTERM );
+
+      while ( not modeld->terminated() ) {
+        modeld->wait();
+      }
+    }
+
+    /* the speculator finishes the jobs it has started; the rest are left
+       for gg-force */
+    if ( speculator.initialized() ) {
+      gg::speculation::finish( speculate_socket );
+
+      while ( not speculator->terminated() ) {
+        speculator->wait();
+      }
+
+      if ( roost::exists( speculate_socket ) ) {
+        roost::remove( speculate_socket );
+      }
+    }
+
+    return command.died_on_signal() ? 128 + command.exit_status()
+                                    : command.exit_status();
   }
   catch ( const exception &  e ) {
     print_exception( argv[ 0 ], e );
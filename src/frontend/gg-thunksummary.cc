@@ -4,6 +4,7 @@
 #include <cstring>
 #include <iostream>
 
+#include "thunk/blobs.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/thunk_reader.hh"
 #include "thunk/thunk.hh"
@@ -48,7 +49,7 @@ struct ThunkStats
 
 ThunkStats print_thunk_info( const string & hash, unsigned int indent )
 {
-  const Thunk thunk { move( ThunkReader::read( gg::paths::blob_path( hash ) ) ) };
+  const Thunk thunk { move( ThunkReader::parse( gg::blobs::read( hash ), hash ) ) };
   const string indentation( indent, ' ' );
 
   const string display_name = shortn( hash );
@@ -33,6 +33,7 @@ int main( int argc, char * argv[] )
                      [&argv]() {
                        CheckSystemCall( "ptrace(TRACEME)", ptrace( PTRACE_TRACEME ) );
                        raise( SIGSTOP );
+                       install_syscall_filter( syscalls_with_flags( TRACE_FILE ) );
                        return execvp( argv[ 1 ], &argv[ 1 ] ); } );
 
     cerr << "Direct child: " << tp.pid() << endl;
@@ -49,7 +50,8 @@ int main( int argc, char * argv[] )
                     tcb.syscall_invocation->retval().initialized() );
             cerr << " = " << *tcb.syscall_invocation->retval() << endl;
             */
-          } };
+          },
+        true /* only the file-related syscalls stop the tracee */ };
 
     tracers.insert( tp.pid() );
 
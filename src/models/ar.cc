@@ -9,6 +9,7 @@
 #include "thunk/thunk.hh"
 #include "util/path.hh"
 
+#include "models.hh"
 #include "toolchain.hh"
 
 using namespace std;
@@ -17,7 +18,7 @@ using namespace gg::thunk;
 const int PLUGIN_FLAG = 1000;
 
 /* this function is based on ar source code */
-void generate_thunk( int argc, char * argv[] )
+static void generate_thunk( int argc, char * argv[] )
 {
   if ( argc < 2 ) {
     throw runtime_error( "not enough arguments" );
@@ -146,7 +147,7 @@ void generate_thunk( int argc, char * argv[] )
   );
 }
 
-int main( int argc, char * argv[] )
+int gg::models::ar_main( int argc, char * argv[] )
 {
   gg::models::init();
   generate_thunk( argc, argv );
@@ -242,6 +242,10 @@ GCCArguments::GCCArguments( const int argc, char ** argv, const bool force_strip
         include_dirs_.emplace_back( optarg );
         break;
 
+      case GCCOption::include:
+        include_files_.emplace_back( optarg );
+        break;
+
       case GCCOption::nostdlib:
         no_stdlib_ = true;
         break;
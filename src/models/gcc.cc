@@ -1,6 +1,7 @@
 /* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
 
 #include "gcc.hh"
+#include "models.hh"
 
 #include <vector>
 #include <string>
@@ -16,6 +17,8 @@
 #include <libgen.h>
 #include <sys/ioctl.h>
 
+#include "thunk/blobs.hh"
+#include "thunk/bundle.hh"
 #include "thunk/factory.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/thunk.hh"
@@ -28,10 +31,29 @@
 using namespace std;
 using namespace gg::thunk;
 
-void dump_gcc_specs( TempFile & target_file )
+/* the specs only depend on the compiler driver, so they are dumped once per
+   toolchain and kept as a blob; the cache entry holds the blob's hash */
+ThunkFactory::Data gcc_specs_data()
 {
-  target_file.write( run( "gcc-7", { "gcc-7", "-dumpspecs" },
-                                   {}, true, true, true ) );
+  const string & toolchain_hash = program_hash( GCC );
+  const roost::path cache_entry_path = gg::paths::specs_cache_entry( toolchain_hash );
+
+  const Optional<string> cached_hash = gg::cache_entries::read( cache_entry_path );
+
+  if ( cached_hash.initialized() and gg::blobs::exists( *cached_hash ) ) {
+    return { "/__gg__/gcc-specs", gg::paths::blob_path( *cached_hash ).string(),
+             gg::ObjectType::Value, *cached_hash };
+  }
+
+  const string specs = run( "gcc-7", { "gcc-7", "-dumpspecs" },
+                            {}, true, true, true );
+  const string specs_hash = gg::hash::compute( specs, gg::ObjectType::Value );
+
+  gg::blobs::write( specs_hash, specs );
+  gg::cache_entries::write( specs_hash, cache_entry_path );
+
+  return { "/__gg__/gcc-specs", gg::paths::blob_path( specs_hash ).string(),
+           gg::ObjectType::Value, specs_hash };
 }
 
 vector<string> prune_makedep_flags( const vector<string> & args )
@@ -53,6 +75,35 @@ vector<string> prune_makedep_flags( const vector<string> & args )
   return result;
 }
 
+/* options that the traced preprocess can't emulate when writing the make
+   dependencies file */
+bool has_unsupported_makedep_flags( const vector<string> & args )
+{
+  return find_if( args.begin(), args.end(),
+                  [] ( const string & arg ) {
+                    return ( arg == "-MM" ) or ( arg == "-MMD" ) or
+                           ( arg == "-MG" ) or ( arg == "-MQ" );
+                  } ) != end( args );
+}
+
+/* with debug info, the preprocessed output names the working directory,
+   which isn't the same when the thunk is executed */
+bool output_has_working_directory( const vector<string> & args )
+{
+  bool debug_info = false;
+
+  for ( const string & arg : args ) {
+    if ( arg == "-fno-working-directory" ) {
+      return false;
+    }
+    else if ( arg.compare( 0, 2, "-g" ) == 0 ) {
+      debug_info = ( arg != "-g0" );
+    }
+  }
+
+  return debug_info;
+}
+
 bool is_non_object_input( const InputFile & input )
 {
   switch( input.language ) {
@@ -81,6 +132,120 @@ bool has_include_or_incbin( const string & filename )
   return false;
 }
 
+/* the headers under each include directory are passed as one bundle (see
+   thunk/bundle.hh), if there are enough of them; every other file is passed
+   as it is */
+vector<ThunkFactory::Data> bundle_headers( const vector<ThunkFactory::Data> & files,
+                                           const vector<string> & include_dirs,
+                                           const string & input_name )
+{
+  constexpr size_t MIN_BUNDLE_SIZE = 4;
+
+  vector<string> roots;
+
+  for ( const string & dir : include_dirs ) {
+    const string root = roost::path( dir ).lexically_normal().string();
+
+    if ( root != "." and find( roots.begin(), roots.end(), root + "/" ) == roots.end() ) {
+      roots.push_back( root + "/" );
+    }
+  }
+
+  const string input_filename = roost::path( input_name ).lexically_normal().string();
+
+  vector<ThunkFactory::Data> output;
+  vector<vector<ThunkFactory::Data>> headers( roots.size() );
+
+  for ( const ThunkFactory::Data & file : files ) {
+    const string filename = roost::path( file.filename() ).lexically_normal().string();
+    Optional<size_t> best_root;
+
+    /* the innermost directory wins; thunks are never bundled */
+    for ( size_t i = 0; i < roots.size() and file.filename() != input_filename and
+                        file.type() == gg::ObjectType::Value; i++ ) {
+      if ( filename.compare( 0, roots[ i ].length(), roots[ i ] ) == 0 and
+           ( not best_root.initialized() or
+             roots[ i ].length() > roots[ *best_root ].length() ) ) {
+        best_root.reset( i );
+      }
+    }
+
+    if ( best_root.initialized() ) {
+      headers[ *best_root ].push_back( file );
+    }
+    else {
+      output.push_back( file );
+    }
+  }
+
+  for ( const vector<ThunkFactory::Data> & root_headers : headers ) {
+    if ( root_headers.size() < MIN_BUNDLE_SIZE ) {
+      output.insert( output.end(), root_headers.begin(), root_headers.end() );
+      continue;
+    }
+
+    FileBundle bundle;
+
+    for ( const ThunkFactory::Data & header : root_headers ) {
+      bundle.add( header.filename(), header.hash() );
+      gg::blobs::insert( header.hash(), header.real_filename() );
+    }
+
+    const string bundle_hash = bundle.store();
+    output.emplace_back( FileBundle::FILENAME,
+                         gg::paths::blob_path( bundle_hash ).string(),
+                         gg::ObjectType::Value, bundle_hash );
+  }
+
+  return output;
+}
+
+bool is_header( const Language language )
+{
+  return language == Language::C_HEADER or language == Language::CXX_HEADER;
+}
+
+/* with GG_GCC_FUSED, a source file that is compiled to an object is turned
+   into a single thunk that runs all of the stages */
+bool fuse_stages( const Language language, const GCCStage last_stage )
+{
+  return getenv( "GG_GCC_FUSED" ) != nullptr and last_stage >= ASSEMBLE and
+         ( language == Language::C or language == Language::CXX or
+           language == Language::ASSEMBLER_WITH_CPP );
+}
+
+vector<string> GCCModelGenerator::precompiled_headers() const
+{
+  vector<string> pch_files;
+
+  for ( const string & include_file : arguments_.include_files() ) {
+    /* gcc looks for the file in the working directory, and then in the
+       include path; in each directory, the .gch wins over the header */
+    vector<string> candidates { include_file };
+
+    if ( not roost::is_absolute( include_file ) ) {
+      for ( const string & dir : arguments_.include_dirs() ) {
+        candidates.push_back( ( roost::path( dir ) / include_file ).string() );
+      }
+    }
+
+    for ( const string & candidate : candidates ) {
+      const string pch_file = candidate + ".gch";
+
+      if ( roost::exists( pch_file ) and not roost::is_directory( pch_file ) ) {
+        pch_files.push_back( pch_file );
+        break;
+      }
+
+      if ( roost::exists( candidate ) ) {
+        break;
+      }
+    }
+  }
+
+  return pch_files;
+}
+
 string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
                                           const GCCStage stage,
                                           const InputFile & input,
@@ -101,7 +266,7 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
   vector<ThunkFactory::Data> base_infiles = { input.indata };
   vector<ThunkFactory::Data> base_executables = { gcc_data };
 
-  base_infiles.emplace_back( "/__gg__/gcc-specs", specs_tempfile_.name() );
+  base_infiles.push_back( specs_data_ );
 
   for ( const string & extra_infile : arguments_.extra_infiles( stage ) ) {
     base_infiles.emplace_back( extra_infile );
@@ -133,6 +298,14 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
   switch ( stage ) {
   case PREPROCESS:
   {
+    /* a header that is compiled is turned into a precompiled header, by a
+       single thunk that runs the whole compiler on it */
+    const bool precompile = is_header( input.language ) and
+                            arguments_.last_stage() != PREPROCESS;
+
+    /* or the thunk goes all the way to the object file */
+    const bool fuse = fuse_stages( input.language, arguments_.last_stage() );
+
     const vector<string> & include_path =
       ( input.language == Language::C or
         input.language == Language::C_HEADER or
@@ -141,7 +314,12 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
         : cpp_include_path;
 
      /* ARGS */
-    args.push_back( "-E" );
+    if ( fuse ) {
+      args.push_back( "-c" );
+    }
+    else if ( not precompile ) {
+      args.push_back( "-E" );
+    }
 
     args.push_back( "-frandom-seed=" + BEGIN_REPLACE
                     + input.name
@@ -198,8 +376,42 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
       makedep_filename = makedep_tempfile.name();
     }
 
-    const vector<string> dependencies = generate_dependencies_file( all_args,
-                                                                    makedep_filename, makedep_target );
+    /* with GG_GCC_TRACE_DEPS, the dependencies are taken from the files that
+       the actual preprocessor opens, and its output is kept as the thunk's
+       result, instead of running gcc -M and then preprocessing again */
+    const bool trace_preprocessor = getenv( "GG_GCC_TRACE_DEPS" ) != nullptr and
+                                    not precompile and
+                                    not has_unsupported_makedep_flags( all_args );
+
+    TempFile preprocessed_tempfile { "/tmp/gg-preprocessed" };
+    vector<string> dependencies;
+
+    if ( trace_preprocessor ) {
+      /* -E wins over -c, so only the preprocessor runs */
+      vector<string> trace_args = prune_makedep_flags( all_args );
+
+      if ( fuse ) {
+        trace_args.push_back( "-E" );
+      }
+
+      dependencies = trace_dependencies( trace_args, preprocessed_tempfile.name() );
+
+      if ( generate_makedep_file ) {
+        const bool phony_targets = find( all_args.begin(), all_args.end(), "-MP" ) != end( all_args );
+        write_dependencies_file( dependencies, makedep_filename, makedep_target, phony_targets );
+      }
+    }
+    else {
+      dependencies = generate_dependencies_file( all_args, makedep_filename, makedep_target );
+    }
+
+    /* if a precompiled header is used, the preprocessor only leaves a
+       pragma for the compiler to load it, instead of the header's contents */
+    const vector<string> pch_files = precompile ? vector<string> {}
+                                                : precompiled_headers();
+
+    const bool keep_output = trace_preprocessor and not fuse and pch_files.empty() and
+                             not output_has_working_directory( all_args );
 
     /* We promised that we would add these here, and we lived up to our
        promise... */
@@ -208,6 +420,16 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
     all_args.push_back( output );
     all_args = prune_makedep_flags( all_args );
 
+    if ( not pch_files.empty() ) {
+      all_args.push_back( "-fpch-preprocess" );
+
+      for ( const string & pch_file : pch_files ) {
+        if ( find( dependencies.begin(), dependencies.end(), pch_file ) == dependencies.end() ) {
+          dependencies.push_back( pch_file );
+        }
+      }
+    }
+
     /* INFILES */
     if ( input.language == Language::C or
          input.language == Language::C_HEADER or
@@ -218,10 +440,18 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
       base_executables.emplace_back( program_data.at( CC1PLUS ) );
     }
 
-    for ( const string & dep : dependencies ) {
-      base_infiles.emplace_back( dep );
+    if ( fuse ) {
+      base_executables.emplace_back( program_data.at( AS ) );
+
+      for ( const GCCStage later_stage : { COMPILE, ASSEMBLE } ) {
+        for ( const string & extra_infile : arguments_.extra_infiles( later_stage ) ) {
+          base_infiles.emplace_back( extra_infile );
+        }
+      }
     }
 
+    vector<ThunkFactory::Data> dependency_data = ThunkFactory::Data::from_files( dependencies );
+
     for ( const string & dir : include_path ) {
       dummy_dirs.push_back( dir );
     }
@@ -230,9 +460,15 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
       dummy_dirs.push_back( dir );
     }
 
+    if ( getenv( "GG_GCC_BUNDLE_HEADERS" ) != nullptr ) {
+      dependency_data = bundle_headers( dependency_data, dummy_dirs, input.name );
+    }
+
+    base_infiles.insert( base_infiles.end(), dependency_data.begin(), dependency_data.end() );
+
     dummy_dirs.push_back( "." );
 
-    return ThunkFactory::generate(
+    const string thunk_hash = ThunkFactory::generate(
       gcc_function( operation_mode_, all_args, envars_ ),
       base_infiles,
       base_executables,
@@ -243,6 +479,15 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
         | ThunkFactory::Options::generate_manifest
         | ThunkFactory::Options::include_filenames
     );
+
+    if ( keep_output ) {
+      const string output_hash = gg::hash::file( preprocessed_tempfile.name() );
+      gg::blobs::insert( output_hash, preprocessed_tempfile.name() );
+      gg::cache::insert( thunk_hash, output_hash );
+      gg::cache::insert( gg::hash::for_output( thunk_hash, "output" ), output_hash );
+    }
+
+    return thunk_hash;
   }
 
   case COMPILE:
@@ -254,6 +499,18 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
 
     args = prune_makedep_flags( args );
 
+    /* for the pragmas that the preprocessor left, which name them by where
+       they were found in the include path */
+    if ( not arguments_.include_files().empty() ) {
+      const vector<string> pch_files = precompiled_headers();
+      base_infiles.insert( base_infiles.end(), pch_files.begin(), pch_files.end() );
+
+      if ( not pch_files.empty() ) {
+        dummy_dirs = arguments_.include_dirs();
+        dummy_dirs.push_back( "." );
+      }
+    }
+
     if ( input.language == Language::CPP_OUTPUT ) {
       base_executables.push_back( program_data.at( CC1 ) );
     }
@@ -327,11 +584,10 @@ void print_gcc_command( const string & command_str )
    cerr << endl;
 }
 
-const bool force_strip = ( getenv( "GG_GCC_FORCE_STRIP" ) != nullptr );
-
 GCCModelGenerator::GCCModelGenerator( const OperationMode operation_mode,
                                       int argc, char ** argv )
-  : operation_mode_( operation_mode ), arguments_( argc, argv, force_strip )
+  : operation_mode_( operation_mode ),
+    arguments_( argc, argv, getenv( "GG_GCC_FORCE_STRIP" ) != nullptr )
 {
   exec_original_gcc = [&argv]() { _exit( execvp( argv[ 0 ], argv ) ); };
 
@@ -377,7 +633,7 @@ GCCModelGenerator::GCCModelGenerator( const OperationMode operation_mode,
     throw runtime_error( "no input files" );
   }
 
-  dump_gcc_specs( specs_tempfile_ );
+  specs_data_ = gcc_specs_data();
 }
 
 void GCCModelGenerator::generate()
@@ -409,14 +665,30 @@ void GCCModelGenerator::generate()
     GCCStage first_stage = language_to_stage( input.language );
     GCCStage input_last_stage = ( last_stage == LINK ) ? ASSEMBLE : last_stage;
 
+    /* a precompiled header is made in the first stage */
+    const bool precompile = is_header( input.language ) and last_stage != PREPROCESS;
+
+    /* the fused thunk stands for the assemble stage, and takes the source */
+    const bool fuse = fuse_stages( input.language, last_stage );
+
+    if ( precompile ) {
+      if ( last_stage == LINK ) {
+        throw runtime_error( "precompiled headers are only supported with -c or -S" );
+      }
+
+      input_last_stage = PREPROCESS;
+    }
+
     map<size_t, string> stage_output;
     stage_output[ first_stage - 1 ] = input.name;
     input.indata = move( ThunkFactory::Data( input.name ) );
 
     cerr << "\u251c\u257c input: " << input.name << endl;
 
-    for ( size_t stage_num = first_stage; stage_num <= input_last_stage; stage_num++ ) {
+    for ( size_t stage_num = fuse ? ASSEMBLE : first_stage;
+          stage_num <= input_last_stage; stage_num++ ) {
       GCCStage stage = static_cast<GCCStage>( stage_num );
+      const bool final_stage = ( stage == last_stage ) or precompile;
       string output_name;
 
       if ( input.source_language == Language::ASSEMBLER_WITH_CPP and
@@ -425,8 +697,11 @@ void GCCModelGenerator::generate()
         continue;
       }
 
-      if ( stage == last_stage ) {
-        if ( final_output.empty() ) {
+      if ( final_stage ) {
+        if ( final_output.empty() and precompile ) {
+          final_output = arguments_.input_files().at( input_index ).name + ".gch";
+        }
+        else if ( final_output.empty() ) {
           /* fill in default names based on the original input filename,
              e.g. hello.abc.cc -> hello.s in compile stage, hello.abc.o in assembly */
           if ( stage == PREPROCESS ) {
@@ -446,7 +721,8 @@ void GCCModelGenerator::generate()
                                 + "_" + to_string( stage_num );
       }
 
-      string last_stage_hash = generate_thunk( first_stage, stage, input, output_name, stage == last_stage );
+      string last_stage_hash = generate_thunk( first_stage, fuse ? PREPROCESS : stage,
+                                               input, output_name, final_stage );
 
       switch ( stage ) {
       case PREPROCESS:
@@ -498,7 +774,7 @@ void GCCModelGenerator::generate()
                                          gg::hash::type( last_stage_hash ),
                                          last_stage_hash );
 
-      if ( stage == last_stage ) {
+      if ( final_stage ) {
         cerr << "\u2570\u257c output: " << final_output << endl;
       }
     }
@@ -520,12 +796,12 @@ void GCCModelGenerator::generate()
   }
 }
 
-void usage( const char * arg0 )
+static void usage( const char * arg0 )
 {
   cerr << arg0 << " (gcc|g++) [GCC ARGUMENTS]" << endl;
 }
 
-int main( int argc, char * argv[] )
+int gg::models::gcc_main( int argc, char * argv[] )
 {
   try {
     gg::models::init();
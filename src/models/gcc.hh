@@ -10,7 +10,6 @@
 #include "thunk/factory.hh"
 #include "thunk/thunk.hh"
 #include "util/optional.hh"
-#include "util/temp_file.hh"
 
 #include "toolchain.hh"
 
@@ -117,6 +116,7 @@ private:
   std::vector<std::string> include_dirs_ {};
   std::vector<std::string> library_dirs_ {};
   std::vector<std::string> system_include_dirs_ {};
+  std::vector<std::string> include_files_ {};
 
   std::unordered_map<GCCStage, std::vector<std::string>> extra_infiles_ {};
 
@@ -142,6 +142,7 @@ public:
   const std::vector<InputFile> & input_files() const { return input_files_; }
   GCCStage last_stage() const { return last_stage_.get_or( LINK ); }
   const std::vector<std::string> & include_dirs() const { return include_dirs_; }
+  const std::vector<std::string> & include_files() const { return include_files_; }
   const std::vector<std::string> & library_dirs() const { return library_dirs_; }
   const std::vector<std::string> & extra_infiles( const GCCStage stage );
   bool no_stdlib() const { return no_stdlib_; }
@@ -164,7 +165,7 @@ private:
 
   OperationMode operation_mode_;
   GCCArguments arguments_;
-  TempFile specs_tempfile_ { "/tmp/gg-gccspecs" };
+  ThunkFactory::Data specs_data_ {};
 
   std::vector<std::string> envars_ { { "PATH=" + GG_BIN_PREFIX }, };
 
@@ -178,6 +179,20 @@ private:
                                                        const std::string & output_name,
                                                        const std::string & target_name );
 
+  /* runs the preprocessor under the tracer, writing its output to
+     `output_name`, and returns the files that it read */
+  std::vector<std::string> trace_dependencies( const std::vector<std::string> & option_args,
+                                               const std::string & output_name );
+
+  void write_dependencies_file( const std::vector<std::string> & dependencies,
+                                const std::string & output_name,
+                                const std::string & target_name,
+                                const bool phony_targets );
+
+  /* the precompiled headers (.gch) for the files passed with -include, if
+     there are any, wherever gcc would find them */
+  std::vector<std::string> precompiled_headers() const;
+
   std::string generate_thunk( const GCCStage first_stage,
                               const GCCStage stage,
                               const InputFile & input,
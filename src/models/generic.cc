@@ -8,18 +8,19 @@
 #include "thunk/thunk.hh"
 #include "util/path.hh"
 
+#include "models.hh"
 #include "toolchain.hh"
 
 using namespace std;
 using namespace gg;
 using namespace gg::thunk;
 
-void usage( const char * argv0  )
+static void usage( const char * argv0  )
 {
   cerr << argv0 << " <cli-description> [program options...]" << endl;
 }
 
-void generate_thunk( const CLIDescription & cli_description,
+static void generate_thunk( const CLIDescription & cli_description,
                      const int argc, char * argv[] )
 {
   vector<struct option> long_options;
@@ -95,7 +96,7 @@ void generate_thunk( const CLIDescription & cli_description,
   );
 }
 
-int main( int argc, char * argv[] )
+int gg::models::generic_main( int argc, char * argv[] )
 {
   if ( argc <= 0 ) {
     abort();
@@ -0,0 +1,66 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "modeld.hh"
+#include "net/socket.hh"
+#include "util/exception.hh"
+
+using namespace std;
+
+/* Runs a model through the gg-modeld at GG_MODELD_SOCKET, or runs the model
+   program itself if there's no daemon to talk to. */
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << " MODEL-PROGRAM [args...]" << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc < 2 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const char * socket_path = getenv( "GG_MODELD_SOCKET" );
+
+    if ( socket_path != nullptr and socket_path[ 0 ] != '\0' ) {
+      UnixSocket daemon;
+      bool connected = false;
+
+      try {
+        daemon.connect( socket_path );
+        connected = true;
+      }
+      catch ( const unix_error & ) {
+        /* the daemon is gone, or not up yet */
+      }
+
+      if ( connected ) {
+        const vector<string> args { argv + 1, argv + argc };
+        daemon.send_with_fds( ModelRequest::for_this_process( args ).serialize(),
+                              { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO } );
+
+        return decode_status( daemon.read_exactly( 4 ) );
+      }
+    }
+
+    CheckSystemCall( "execvp", execvp( argv[ 1 ], argv + 1 ) );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
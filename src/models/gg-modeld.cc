@@ -0,0 +1,271 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <functional>
+#include <unordered_map>
+#include <cstdlib>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "modeld.hh"
+#include "models.hh"
+#include "net/socket.hh"
+#include "thunk/ggutils.hh"
+#include "util/child_process.hh"
+#include "util/exception.hh"
+#include "util/path.hh"
+#include "util/poller.hh"
+#include "util/signalfd.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* gg-modeld serves the model-* programs to gg-model-client, for as long as
+   gg-infer runs. Each request is run in a process forked from the daemon,
+   so it starts with the toolchain data already loaded, and with the entries
+   of the hash, dependency and specs caches that earlier requests loaded or
+   wrote. Requests run in parallel. */
+
+static const unordered_map<string, function<int( int, char ** )>> models = {
+  { "model-gcc", gg::models::gcc_main },
+  { "model-ar", gg::models::ar_main },
+  { "model-ranlib", gg::models::ranlib_main },
+  { "model-strip", gg::models::strip_main },
+  { "model-ld", gg::models::ld_main },
+  { "model-generic", gg::models::generic_main },
+};
+
+/* a client, from the time it connects until its model exits */
+struct Client
+{
+  UnixSocket socket;
+
+  /* the request, as it comes in */
+  std::string data {};
+  std::vector<FileDescriptor> stdio {};
+
+  Optional<ChildProcess> process {};
+
+  Client( UnixSocket && s_socket ) : socket( move( s_socket ) ) {}
+};
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << " SOCKET" << endl;
+}
+
+/* runs in the forked process */
+int run_model( const ModelRequest & request, const vector<FileDescriptor> & stdio,
+               const int report_fd )
+{
+  /* the model, or whatever it runs, shouldn't inherit what the daemon does
+     about a reader that goes away */
+  signal( SIGPIPE, SIG_DFL );
+
+  for ( int i = 0; i < 3; i++ ) {
+    CheckSystemCall( "dup2", dup2( stdio.at( i ).fd_num(), i ) );
+  }
+
+  CheckSystemCall( "chdir (" + request.working_directory + ")",
+                   chdir( request.working_directory.c_str() ) );
+  umask( request.umask );
+
+  CheckSystemCall( "clearenv", clearenv() );
+
+  for ( const string & envar : request.envars ) {
+    const size_t equals = envar.find( '=' );
+
+    if ( equals != string::npos ) {
+      CheckSystemCall( "setenv", setenv( envar.substr( 0, equals ).c_str(),
+                                         envar.substr( equals + 1 ).c_str(), true ) );
+    }
+  }
+
+  gg::cache_entries::report_to( report_fd );
+
+  vector<string> args = request.args;
+  vector<char *> argv;
+
+  for ( string & arg : args ) {
+    argv.push_back( &arg[ 0 ] );
+  }
+
+  argv.push_back( nullptr );
+
+  auto model = models.find( roost::rbasename( args[ 0 ] ).string() );
+
+  if ( model == models.end() ) {
+    CheckSystemCall( "execvp", execvp( argv[ 0 ], argv.data() ) );
+  }
+
+  const int status = model->second( args.size(), argv.data() );
+  cout.flush();
+
+  return status;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 2 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const string socket_path { argv[ 1 ] };
+
+    UnixSocket listener;
+    listener.bind( socket_path );
+    listener.listen( 128 );
+
+    /* the children report the cache entries they see, one per datagram */
+    int report_fds[ 2 ];
+    CheckSystemCall( "socketpair", socketpair( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC,
+                                               0, report_fds ) );
+    FileDescriptor reports { report_fds[ 0 ] };
+    FileDescriptor report_sender { report_fds[ 1 ] };
+
+    gg::cache_entries::keep_in_memory();
+
+    /* a client that goes away shouldn't take us with it */
+    signal( SIGPIPE, SIG_IGN );
+
+    SignalMask signals { SIGCHLD, SIGHUP, SIGTERM, SIGINT };
+    signals.set_as_mask();
+    SignalFD signal_fd { signals };
+
+    list<Client> clients;
+    vector<list<Client>::iterator> new_clients;
+    Poller poller;
+
+    /* the requests are read as they come in, so a slow client doesn't hold
+       up the others */
+    auto read_request =
+      [&] ( const list<Client>::iterator client )
+      {
+        try {
+          client->data += client->socket.recv_with_fds( client->stdio );
+          const Optional<ModelRequest> request = ModelRequest::parse( client->data );
+
+          if ( not request.initialized() ) {
+            if ( client->socket.eof() ) {
+              throw runtime_error( "client went away" );
+            }
+
+            return ResultType::Continue;
+          }
+
+          if ( client->stdio.size() != 3 ) {
+            throw runtime_error( "expected the client's stdin, stdout and stderr" );
+          }
+
+          const vector<FileDescriptor> & stdio = client->stdio;
+          client->process.reset( request->args[ 0 ],
+            [&] () { return run_model( *request, stdio, report_sender.fd_num() ); } );
+
+          /* only the child needs them */
+          client->stdio.clear();
+        }
+        catch ( const exception & e ) {
+          print_exception( "gg-modeld", e );
+          clients.erase( client );
+        }
+
+        return ResultType::CancelAll;
+      };
+
+    poller.add_action( Poller::Action( listener, Direction::In,
+      [&] ()
+      {
+        try {
+          clients.emplace_back( listener.accept() );
+          new_clients.push_back( prev( clients.end() ) );
+        }
+        catch ( const exception & e ) {
+          print_exception( "gg-modeld", e );
+        }
+
+        return ResultType::Continue;
+      } ) );
+
+    poller.add_action( Poller::Action( reports, Direction::In,
+      [&] ()
+      {
+        string report = reports.read();
+        gg::cache_entries::apply_report( report );
+        return ResultType::Continue;
+      } ) );
+
+    poller.add_action( Poller::Action( signal_fd.fd(), Direction::In,
+      [&] ()
+      {
+        const signalfd_siginfo sig = signal_fd.read_signal();
+
+        if ( sig.ssi_signo != SIGCHLD ) {
+          return ResultType::Exit;
+        }
+
+        for ( auto it = clients.begin(); it != clients.end(); ) {
+          if ( not it->process.initialized() ) {
+            it++;
+            continue;
+          }
+
+          ChildProcess & process = *it->process;
+
+          if ( not process.waitable() ) {
+            it++;
+            continue;
+          }
+
+          process.wait( true );
+
+          if ( not process.terminated() ) {
+            it++;
+            continue;
+          }
+
+          const int status = process.died_on_signal() ? 128 + process.exit_status()
+                                                      : process.exit_status();
+
+          try {
+            it->socket.write( encode_status( status ) );
+          }
+          catch ( const exception & e ) {
+            print_exception( "gg-modeld", e );
+          }
+
+          it = clients.erase( it );
+        }
+
+        return ResultType::Continue;
+      } ) );
+
+    while ( poller.poll( -1 ).result != Poller::Result::Type::Exit ) {
+      /* the poller can't take new actions while it's running them */
+      for ( const auto client : new_clients ) {
+        poller.add_action( Poller::Action( client->socket, Direction::In,
+          [client, &read_request] () { return read_request( client ); } ) );
+      }
+
+      new_clients.clear();
+    }
+
+    roost::remove( socket_path );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
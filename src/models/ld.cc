@@ -11,6 +11,7 @@
 #include "thunk/thunk.hh"
 #include "util/path.hh"
 
+#include "models.hh"
 #include "toolchain.hh"
 
 using namespace std;
@@ -27,7 +28,7 @@ enum class LDOption
   no_undefined = 1000, nostdlib, pie, start_group, end_group, whole_archive, no_whole_archive, build_id
 };
 
-vector<string> get_link_dependencies( size_t argc, char * argv[], list<size_t> input_indexes )
+static vector<string> get_link_dependencies( size_t argc, char * argv[], list<size_t> input_indexes )
 {
   vector<string> args;
 
@@ -52,7 +53,7 @@ vector<string> get_link_dependencies( size_t argc, char * argv[], list<size_t> i
   return GCCModelGenerator::parse_linker_output( args );
 }
 
-void generate_thunk( size_t argc, char * argv[] )
+static void generate_thunk( size_t argc, char * argv[] )
 {
   if ( argc < 2 ) {
     throw runtime_error( "not enough arguments" );
@@ -176,7 +177,7 @@ void generate_thunk( size_t argc, char * argv[] )
   );
 }
 
-int main( int argc, char * argv[] )
+int gg::models::ld_main( int argc, char * argv[] )
 {
   gg::models::init();
   generate_thunk( argc, argv );
@@ -14,8 +14,6 @@
 using namespace std;
 using namespace gg::thunk;
 
-const bool include_gompspec = ( getenv( "GG_GCC_OPENMP_SUPPORT" ) != nullptr );
-
 vector<string> GCCModelGenerator::get_link_dependencies( const vector<InputFile> & link_inputs,
                                                          const vector<string> & gcc_args )
 {
@@ -76,9 +74,8 @@ string GCCModelGenerator::generate_link_thunk( const vector<InputFile> & link_in
     }
   }
 
-  for ( const string & dep : dependencies ) {
-    infiles.emplace_back( dep );
-  }
+  const vector<ThunkFactory::Data> dependency_data = ThunkFactory::Data::from_files( dependencies );
+  infiles.insert( infiles.end(), dependency_data.begin(), dependency_data.end() );
 
   /* ARGS */
   vector<string> args { arguments_.option_args() };
@@ -137,7 +134,7 @@ string GCCModelGenerator::generate_link_thunk( const vector<InputFile> & link_in
     infiles.emplace_back( infile );
   }
 
-  if ( include_gompspec ) {
+  if ( getenv( "GG_GCC_OPENMP_SUPPORT" ) != nullptr ) {
     /* let's look for libgomp.spec in library search path */
     bool found = false;
     for ( const string & dir : gcc_library_path ) {
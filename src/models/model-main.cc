@@ -0,0 +1,9 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "models.hh"
+
+/* MODEL_MAIN is set for each model program in Makefile.am */
+int main( int argc, char * argv[] )
+{
+  return gg::models::MODEL_MAIN( argc, argv );
+}
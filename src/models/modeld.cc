@@ -0,0 +1,153 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "modeld.hh"
+
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util/path.hh"
+
+using namespace std;
+
+extern char ** environ;
+
+static void put_uint32( string & output, const uint32_t value )
+{
+  for ( size_t i = 0; i < 4; i++ ) {
+    output += static_cast<char>( ( value >> ( 8 * i ) ) & 0xff );
+  }
+}
+
+static void put_string( string & output, const string & value )
+{
+  put_uint32( output, value.length() );
+  output += value;
+}
+
+static void put_strings( string & output, const vector<string> & values )
+{
+  put_uint32( output, values.size() );
+
+  for ( const string & value : values ) {
+    put_string( output, value );
+  }
+}
+
+class RequestReader
+{
+private:
+  const string & data_;
+  size_t offset_ { 0 };
+
+public:
+  RequestReader( const string & data, const size_t offset )
+    : data_( data ), offset_( offset ) {}
+
+  uint32_t get_uint32()
+  {
+    if ( offset_ + 4 > data_.length() ) {
+      throw runtime_error( "bad model request" );
+    }
+
+    const uint8_t * bytes = reinterpret_cast<const uint8_t *>( data_.data() + offset_ );
+    offset_ += 4;
+
+    return bytes[ 0 ] | ( bytes[ 1 ] << 8 ) | ( bytes[ 2 ] << 16 ) |
+           ( static_cast<uint32_t>( bytes[ 3 ] ) << 24 );
+  }
+
+  string get_string()
+  {
+    const size_t length = get_uint32();
+
+    if ( offset_ + length > data_.length() ) {
+      throw runtime_error( "bad model request" );
+    }
+
+    offset_ += length;
+    return data_.substr( offset_ - length, length );
+  }
+
+  vector<string> get_strings()
+  {
+    vector<string> output;
+    const size_t count = get_uint32();
+
+    for ( size_t i = 0; i < count; i++ ) {
+      output.push_back( get_string() );
+    }
+
+    return output;
+  }
+
+  size_t offset() const { return offset_; }
+};
+
+string ModelRequest::serialize() const
+{
+  string body;
+  put_string( body, working_directory );
+  put_uint32( body, umask );
+  put_strings( body, args );
+  put_strings( body, envars );
+
+  string output;
+  put_uint32( output, body.length() );
+  return output + body;
+}
+
+Optional<ModelRequest> ModelRequest::parse( const string & data )
+{
+  if ( data.length() < 4 ) {
+    return {};
+  }
+
+  RequestReader reader { data, 0 };
+  const size_t size = reader.get_uint32();
+
+  if ( data.length() < 4 + size ) {
+    return {};
+  }
+
+  ModelRequest request;
+  request.working_directory = reader.get_string();
+  request.umask = reader.get_uint32();
+  request.args = reader.get_strings();
+  request.envars = reader.get_strings();
+
+  if ( reader.offset() != 4 + size or request.args.empty() ) {
+    throw runtime_error( "bad model request" );
+  }
+
+  return { true, move( request ) };
+}
+
+ModelRequest ModelRequest::for_this_process( const vector<string> & args )
+{
+  ModelRequest request;
+  request.working_directory = roost::current_working_directory().string();
+  request.args = args;
+
+  /* there's no way to read the umask without setting it */
+  request.umask = ::umask( 0 );
+  ::umask( request.umask );
+
+  for ( char ** envar = environ; *envar != nullptr; envar++ ) {
+    request.envars.emplace_back( *envar );
+  }
+
+  return request;
+}
+
+string encode_status( const int status )
+{
+  string output;
+  put_uint32( output, status );
+  return output;
+}
+
+int decode_status( const string & data )
+{
+  return RequestReader( data, 0 ).get_uint32();
+}
@@ -0,0 +1,40 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef MODELD_HH
+#define MODELD_HH
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "util/optional.hh"
+
+/* A request to gg-modeld: run the model program `args[ 0 ]` with these
+   arguments, environment, working directory and umask. The client's stdin,
+   stdout and stderr are passed along with the request, and the model runs
+   with them. The reply is the model's exit status (see `encode_status()`).
+
+   On the wire: uint32 size of the rest, the working directory, the umask,
+   uint32 number of args, the args, uint32 number of envars, the envars.
+   Strings are (uint32 length, bytes), and integers are little-endian. */
+
+struct ModelRequest
+{
+  std::string working_directory {};
+  mode_t umask { 022 };
+  std::vector<std::string> args {};
+  std::vector<std::string> envars {};
+
+  std::string serialize() const;
+
+  /* returns nothing if `data` doesn't hold a complete request yet */
+  static Optional<ModelRequest> parse( const std::string & data );
+
+  /* the current process's working directory, umask and environment */
+  static ModelRequest for_this_process( const std::vector<std::string> & args );
+};
+
+std::string encode_status( const int status );
+int decode_status( const std::string & data );
+
+#endif /* MODELD_HH */
@@ -0,0 +1,21 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef MODELS_HH
+#define MODELS_HH
+
+/* The entry points of the models. Each model-* program is a main() around
+   one of these (see model-main.cc), and gg-modeld calls them in the
+   processes that it forks to serve requests. */
+
+namespace gg {
+  namespace models {
+    int gcc_main( int argc, char * argv[] );
+    int ar_main( int argc, char * argv[] );
+    int ranlib_main( int argc, char * argv[] );
+    int strip_main( int argc, char * argv[] );
+    int ld_main( int argc, char * argv[] );
+    int generic_main( int argc, char * argv[] );
+  }
+}
+
+#endif /* MODELS_HH */
@@ -7,20 +7,231 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <sstream>
+#include <set>
+#include <unordered_set>
 #include <boost/tokenizer.hpp>
 #include <sys/fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include "thunk/ggutils.hh"
 #include "thunk/thunk_reader.hh"
 #include "thunk/thunk.hh"
+#include "trace/tracer.hh"
+#include "util/digest.hh"
 #include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
 #include "util/system_runner.hh"
 #include "util/temp_file.hh"
+#include "util/tokenize.hh"
 
 using namespace std;
 using namespace boost;
 
+/* The dependency cache keeps the output of the `-M` pass, keyed by
+   everything that goes into it: the command line, the working directory and
+   the environment variables that add to the include path. An entry is only
+   used if the files it lists are unchanged (same size, mtime and ctime, like
+   the hash cache), and so are the directories that were searched for them,
+   so a header that's added somewhere earlier in the search path isn't
+   missed. */
+
+static const char * INCLUDE_PATH_ENVARS[] = { "CPATH", "C_INCLUDE_PATH",
+                                              "CPLUS_INCLUDE_PATH" };
+
+static string dependency_cache_key( const vector<string> & args,
+                                    const string & target_name )
+{
+  string key_data = roost::current_working_directory().string();
+  key_data += '\0';
+
+  for ( const char * envar : INCLUDE_PATH_ENVARS ) {
+    const char * value = getenv( envar );
+    key_data += envar + string( "=" ) + ( value ? value : "" ) + '\0';
+  }
+
+  for ( const string & arg : args ) {
+    key_data += arg + '\0';
+  }
+
+  return digest::sha256( key_data + target_name );
+}
+
+static set<string> include_directories( const vector<string> & args )
+{
+  const static vector<string> include_options = { "-I", "-isystem", "-iquote", "-idirafter" };
+  set<string> directories;
+
+  for ( size_t i = 0; i < args.size(); i++ ) {
+    for ( const string & option : include_options ) {
+      if ( args[ i ].compare( 0, option.length(), option ) != 0 ) {
+        continue;
+      }
+
+      if ( args[ i ].length() > option.length() ) {
+        directories.insert( args[ i ].substr( option.length() ) );
+      }
+      else if ( i + 1 < args.size() ) {
+        directories.insert( args[ i + 1 ] );
+      }
+
+      break;
+    }
+  }
+
+  return directories;
+}
+
+static string stat_line( const string & path, const bool is_directory )
+{
+  struct stat info;
+
+  if ( stat( path.c_str(), &info ) != 0 ) {
+    return {};
+  }
+
+  ostringstream line;
+
+  if ( not is_directory ) {
+    line << info.st_size << " " << info.st_ctim.tv_sec << " " << info.st_ctim.tv_nsec << " ";
+  }
+
+  line << info.st_mtim.tv_sec << " " << info.st_mtim.tv_nsec << " " << path;
+  return line.str();
+}
+
+/* `#include "sys/x.h"` looks for sys/x.h in every search directory (and in
+   the directory of the file that includes it), so the header could show up
+   under sys/ in any of them. creating it, or sys/ itself, changes the mtime
+   of the deepest of search_dir, search_dir/sys that exists. */
+static void add_lookup_directories( const string & search_dir,
+                                    const string & relative_dir,
+                                    set<string> & directories )
+{
+  string directory = search_dir;
+  directories.insert( directory );
+
+  for ( const string & component : split( relative_dir, "/" ) ) {
+    if ( component.empty() or component == "." ) {
+      continue;
+    }
+
+    directory += "/" + component;
+
+    if ( not roost::is_directory( directory ) ) {
+      break;
+    }
+
+    directories.insert( directory );
+  }
+}
+
+/* entry format: "<files> <directories> <size>", then a stat line for each
+   file and directory, then the dependencies file itself */
+static Optional<string> cached_dependencies( const string & cache_key )
+{
+  const Optional<string> entry_data =
+    gg::cache_entries::read( gg::paths::dependency_cache_entry( cache_key ) );
+
+  if ( not entry_data.initialized() ) {
+    return {};
+  }
+
+  istringstream entry { *entry_data };
+  size_t file_count = 0, directory_count = 0, size = 0;
+  string line;
+
+  if ( not ( entry >> file_count >> directory_count >> size ) or not getline( entry, line ) ) {
+    return {};
+  }
+
+  for ( size_t i = 0; i < file_count + directory_count; i++ ) {
+    if ( not getline( entry, line ) ) {
+      return {};
+    }
+
+    const bool is_directory = ( i >= file_count );
+    const size_t fields = is_directory ? 2 : 5;
+    size_t path_start = 0;
+
+    for ( size_t field = 0; field < fields and path_start != string::npos; field++ ) {
+      path_start = line.find( ' ', path_start );
+      path_start = ( path_start == string::npos ) ? path_start : path_start + 1;
+    }
+
+    if ( path_start == string::npos or
+         stat_line( line.substr( path_start ), is_directory ) != line ) {
+      return {};
+    }
+  }
+
+  string contents( size, '\0' );
+
+  if ( not entry.read( &contents[ 0 ], size ) ) {
+    return {};
+  }
+
+  return { true, move( contents ) };
+}
+
+static void insert_cached_dependencies( const string & cache_key,
+                                        const vector<string> & args,
+                                        const vector<string> & dependencies,
+                                        const string & contents )
+{
+  set<string> search_dirs = include_directories( args );
+  vector<string> lines;
+
+  for ( const string & dependency : dependencies ) {
+    lines.push_back( stat_line( dependency, false ) );
+    search_dirs.insert( roost::dirname( dependency ).string() );
+  }
+
+  /* the subdirectories the dependencies were found in, relative to the
+     directories they were found through */
+  set<string> relative_dirs { "." };
+
+  for ( const string & dependency : dependencies ) {
+    for ( const string & search_dir : search_dirs ) {
+      if ( dependency.compare( 0, search_dir.length() + 1, search_dir + "/" ) == 0 ) {
+        relative_dirs.insert(
+          roost::dirname( dependency.substr( search_dir.length() + 1 ) ).string() );
+      }
+    }
+  }
+
+  set<string> directories;
+
+  for ( const string & search_dir : search_dirs ) {
+    for ( const string & relative_dir : relative_dirs ) {
+      add_lookup_directories( search_dir, relative_dir, directories );
+    }
+  }
+
+  for ( const string & directory : directories ) {
+    lines.push_back( stat_line( directory, true ) );
+  }
+
+  ostringstream entry;
+  entry << dependencies.size() << " " << directories.size() << " "
+        << contents.size() << "\n";
+
+  for ( const string & line : lines ) {
+    /* a file that's gone can't be checked later */
+    if ( line.empty() ) {
+      return;
+    }
+
+    entry << line << "\n";
+  }
+
+  entry << contents;
+  gg::cache_entries::write( entry.str(), gg::paths::dependency_cache_entry( cache_key ) );
+}
+
 vector<string> GCCModelGenerator::parse_dependencies_file( const string & dep_filename,
                                                            const string & target_name )
 {
@@ -118,13 +329,158 @@ vector<string> GCCModelGenerator::generate_dependencies_file( const vector<strin
   }
   else {
     args.push_back( "-M" );
+  }
+
+  /* the name of our own output file doesn't matter, so it's not in the key */
+  const string cache_key = dependency_cache_key( args, target_name );
+
+  if ( not has_dependencies_option ) {
     args.push_back( "-MF" );
     args.push_back( output_name );
     args.push_back( "-MT" );
     args.push_back( target_name );
   }
 
+  const Optional<string> cached_contents = cached_dependencies( cache_key );
+
+  if ( cached_contents.initialized() ) {
+    roost::atomic_create( *cached_contents, output_name );
+    return parse_dependencies_file( output_name, target_name );
+  }
+
   run( args[ 0 ], args, {}, true, true );
 
-  return parse_dependencies_file( output_name, target_name );
+  vector<string> dependencies = parse_dependencies_file( output_name, target_name );
+
+  FileDescriptor output_file { CheckSystemCall( "open (" + output_name + ")",
+                                                open( output_name.c_str(), O_RDONLY ) ) };
+  string contents;
+  while ( not output_file.eof() ) { contents += output_file.read(); }
+
+  insert_cached_dependencies( cache_key, args, dependencies, contents );
+
+  return dependencies;
+}
+
+/* libcpp opens every file it reads with O_RDONLY | O_NOCTTY, and it's the
+   only part of the compiler that does; the driver and cc1 open everything
+   else (specs, shared libraries, the output) differently. */
+static bool is_source_open( const SystemCallInvocation & invocation )
+{
+  if ( not invocation.arguments().initialized() or
+       not invocation.retval().initialized() or *invocation.retval() < 0 ) {
+    return false;
+  }
+
+  const vector<Argument> & arguments = *invocation.arguments();
+  const size_t path_index = ( invocation.syscall_no() == SYS_openat ) ? 1 : 0;
+  const int flags = arguments.at( path_index + 1 ).value<int>();
+
+  if ( path_index == 1 and arguments.at( 0 ).value<int>() != AT_FDCWD and
+       arguments.at( 1 ).value<string>().front() != '/' ) {
+    return false;
+  }
+
+  return ( flags & O_ACCMODE ) == O_RDONLY and ( flags & O_NOCTTY );
+}
+
+vector<string> GCCModelGenerator::trace_dependencies( const vector<string> & option_args,
+                                                      const string & output_name )
+{
+  vector<string> args;
+  args.reserve( 3 + option_args.size() );
+
+  if ( operation_mode_ == OperationMode::GCC ) {
+    args.push_back( "gcc-7" );
+  }
+  else {
+    args.push_back( "g++-7" );
+  }
+
+  args.insert( args.end(), option_args.begin(), option_args.end() );
+  args.push_back( "-o" );
+  args.push_back( output_name );
+
+  vector<string> dependencies;
+  unordered_set<string> seen;
+
+  Tracer tracer {
+    args[ 0 ],
+    [&args]() { return ezexec( args[ 0 ], args, {}, true, true ); },
+    []( TracedThreadInfo & tcb, TracerFlock & )
+    {
+      SystemCallInvocation & invocation = *tcb.syscall_invocation;
+
+      if ( invocation.syscall_no() == SYS_open or
+           invocation.syscall_no() == SYS_openat ) {
+        invocation.fetch_arguments();
+      }
+    },
+    [&]( const TracedThreadInfo & tcb )
+    {
+      const SystemCallInvocation & invocation = *tcb.syscall_invocation;
+
+      if ( not is_source_open( invocation ) ) {
+        return;
+      }
+
+      const size_t path_index = ( invocation.syscall_no() == SYS_openat ) ? 1 : 0;
+      const string path = invocation.arguments()->at( path_index ).value<string>();
+
+      if ( path == output_name or seen.count( path ) ) {
+        return;
+      }
+
+      seen.insert( path );
+
+      /* it might still be a directory, or /dev/null */
+      struct stat path_stat;
+      if ( stat( path.c_str(), &path_stat ) == 0 and S_ISREG( path_stat.st_mode ) ) {
+        dependencies.push_back( path );
+      }
+    },
+    [](){},
+    { SYS_open, SYS_openat }
+  };
+
+  tracer.loop_until_done();
+
+  return dependencies;
+}
+
+static string escape_make_path( const string & path )
+{
+  string output;
+
+  for ( const char c : path ) {
+    if ( c == ' ' or c == '#' ) { output += '\\'; }
+    else if ( c == '$' ) { output += '$'; }
+    output += c;
+  }
+
+  return output;
+}
+
+void GCCModelGenerator::write_dependencies_file( const vector<string> & dependencies,
+                                                 const string & output_name,
+                                                 const string & target_name,
+                                                 const bool phony_targets )
+{
+  /* the same layout that gcc uses: the first dependency is the source file,
+     and with -MP, every other one gets an empty rule */
+  string contents = escape_make_path( target_name ) + ":";
+
+  for ( size_t i = 0; i < dependencies.size(); i++ ) {
+    contents += ( i == 0 ? " " : " \\\n " ) + escape_make_path( dependencies[ i ] );
+  }
+
+  contents += "\n";
+
+  if ( phony_targets ) {
+    for ( size_t i = 1; i < dependencies.size(); i++ ) {
+      contents += "\n" + escape_make_path( dependencies[ i ] ) + ":\n";
+    }
+  }
+
+  roost::atomic_create( contents, output_name );
 }
@@ -7,12 +7,13 @@
 #include "thunk/thunk.hh"
 #include "util/path.hh"
 
+#include "models.hh"
 #include "toolchain.hh"
 
 using namespace std;
 using namespace gg::thunk;
 
-void generate_thunk( int argc, char * argv[] )
+static void generate_thunk( int argc, char * argv[] )
 {
   if ( argc < 2 ) {
     throw runtime_error( "not enough arguments" );
@@ -51,7 +52,7 @@ void generate_thunk( int argc, char * argv[] )
   );
 }
 
-int main( int argc, char * argv[] )
+int gg::models::strip_main( int argc, char * argv[] )
 {
   gg::models::init();
   generate_thunk( argc, argv );
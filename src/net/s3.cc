@@ -14,6 +14,7 @@
 #include "awsv4_sig.hh"
 #include "util/exception.hh"
 #include "util/temp_file.hh"
+#include "util/compression.hh"
 
 using namespace std;
 using namespace storage;
@@ -33,13 +34,18 @@ std::string S3::endpoint( const string & region, const string & bucket )
 S3PutRequest::S3PutRequest( const AWSCredentials & credentials,
                             const string & region, const string & bucket,
                             const string & object, const string & contents,
-                            const string & content_hash )
+                            const string & content_hash,
+                            const string & content_encoding )
   : AWSRequest( credentials, region, "PUT /" + object + " HTTP/1.1", contents )
 {
   headers_[ "x-amz-acl" ] = "public-read";
   headers_[ "host" ] = S3::endpoint( region, bucket );
   headers_[ "content-length" ] = to_string( contents.length() );
 
+  if ( content_encoding.length() ) {
+    headers_[ "content-encoding" ] = content_encoding;
+  }
+
   if ( credentials.session_token().initialized() ) {
     headers_[ "x-amz-security-token" ] = *credentials.session_token();
   }
@@ -74,6 +80,12 @@ TCPSocket tcp_connection( const Address & address )
   return sock;
 }
 
+bool is_zstd_encoded( const HTTPResponse & response )
+{
+  return response.has_header( "Content-Encoding" ) and
+         response.get_header_value( "Content-Encoding" ) == compression::ZSTD_ENCODING;
+}
+
 S3Client::S3Client( const AWSCredentials & credentials,
                     const S3ClientConfig & config )
   : credentials_( credentials ), config_( config )
@@ -106,6 +118,9 @@ void S3Client::download_file( const string & bucket, const string & object,
   if ( responses.front().first_line() != "HTTP/1.1 200 OK" ) {
     throw runtime_error( "HTTP failure in S3Client::download_file( " + bucket + ", " + object + " ): " + responses.front().first_line() );
   }
+  else if ( is_zstd_encoded( responses.front() ) ) {
+    compression::zstd_decompress( responses.front().body(), file );
+  }
   else {
     file.write( responses.front().body(), true );
   }
@@ -142,14 +157,26 @@ void S3Client::upload_files( const string & bucket,
               const string & filename = upload_requests.at( file_id ).filename.string();
               const string & object_key = upload_requests.at( file_id ).object_key;
               string hash = upload_requests.at( file_id ).content_hash.get_or( UNSIGNED_PAYLOAD );
+              string encoding;
 
               string contents;
               FileDescriptor file { CheckSystemCall( "open " + filename, open( filename.c_str(), O_RDONLY ) ) };
               while ( not file.eof() ) { contents.append( file.read() ); }
               file.close();
 
+              string compressed;
+              if ( config_.compression_level > 0 and
+                   compression::zstd_compress( contents, compressed, config_.compression_level ) ) {
+                /* the content hash we were given is for the uncompressed
+                   object, so the compressed payload goes unsigned */
+                contents = move( compressed );
+                hash = UNSIGNED_PAYLOAD;
+                encoding = compression::ZSTD_ENCODING;
+              }
+
               S3PutRequest request { credentials_, config_.region,
-                                     bucket, object_key, contents, hash };
+                                     bucket, object_key, contents, hash,
+                                     encoding };
 
               HTTPRequest outgoing_request = request.to_http_request();
               responses.new_request_arrived( outgoing_request );
@@ -244,7 +271,14 @@ void S3Client::download_files( const std::string & bucket,
                   const string & filename = download_requests.at( response_index ).filename.string();
 
                   UniqueFile temp_file { filename };
-                  temp_file.write( responses.front().body() );
+
+                  if ( is_zstd_encoded( responses.front() ) ) {
+                    compression::zstd_decompress( responses.front().body(), temp_file.fd() );
+                  }
+                  else {
+                    temp_file.write( responses.front().body() );
+                  }
+
                   temp_file.fd().close();
                   roost::rename( temp_file.name(), filename );
 
@@ -28,7 +28,8 @@ public:
   S3PutRequest( const AWSCredentials & credentials,
                 const std::string & region, const std::string & bucket,
                 const std::string & object, const std::string & contents,
-                const std::string & content_hash = {} );
+                const std::string & content_hash = {},
+                const std::string & content_encoding = {} );
 };
 
 class S3GetRequest : public AWSRequest
@@ -45,6 +46,9 @@ struct S3ClientConfig
   std::string endpoint {};
   size_t max_threads { 32 };
   size_t max_batch_size { 32 };
+
+  /* zstd level used for uploads; 0 disables compression */
+  int compression_level { 0 };
 };
 
 class S3Client
@@ -1,7 +1,10 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <cstring>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <linux/netfilter_ipv4.h>
 
 #include "socket.hh"
@@ -9,6 +12,8 @@
 
 using namespace std;
 
+template <typename T> void zero( T & x ) { memset( &x, 0, sizeof( x ) ); }
+
 /* default constructor for socket of (subclassed) domain and type */
 Socket::Socket( const int domain, const int type )
     : FileDescriptor( CheckSystemCall( "socket", socket( domain, type, 0 ) ) )
@@ -146,6 +151,12 @@ void Socket::set_reuseaddr( void )
     setsockopt( SOL_SOCKET, SO_REUSEADDR, int( true ) );
 }
 
+/* send small segments right away instead of coalescing them */
+void TCPSocket::set_nodelay( void )
+{
+    setsockopt( IPPROTO_TCP, TCP_NODELAY, int( true ) );
+}
+
 /* turn on timestamps on receipt */
 void UDPSocket::set_timestamps( void )
 {
@@ -200,3 +211,127 @@ void TCPSocket::verify_no_errors() const
         throw unix_error( "nonblocking socket", socket_error );
     }
 }
+
+static sockaddr_un unix_address( const string & path )
+{
+    sockaddr_un address;
+    zero( address );
+    address.sun_family = AF_UNIX;
+
+    if ( path.length() >= sizeof( address.sun_path ) ) {
+        throw runtime_error( "socket path too long: " + path );
+    }
+
+    strcpy( address.sun_path, path.c_str() );
+    return address;
+}
+
+void UnixSocket::bind( const string & path )
+{
+    const sockaddr_un address = unix_address( path );
+    CheckSystemCall( "bind (" + path + ")",
+                     ::bind( fd_num(), reinterpret_cast<const sockaddr *>( &address ),
+                             sizeof( address ) ) );
+}
+
+void UnixSocket::connect( const string & path )
+{
+    const sockaddr_un address = unix_address( path );
+    CheckSystemCall( "connect (" + path + ")",
+                     ::connect( fd_num(), reinterpret_cast<const sockaddr *>( &address ),
+                                sizeof( address ) ) );
+    register_write();
+}
+
+void UnixSocket::listen( const int backlog )
+{
+    CheckSystemCall( "listen", ::listen( fd_num(), backlog ) );
+}
+
+UnixSocket UnixSocket::accept( void )
+{
+    register_read();
+    return UnixSocket( FileDescriptor( CheckSystemCall( "accept",
+        ::accept4( fd_num(), nullptr, nullptr, SOCK_CLOEXEC ) ) ) );
+}
+
+void UnixSocket::send_with_fds( const string & data, const vector<int> & fds )
+{
+    if ( data.empty() ) {
+        throw runtime_error( "descriptors must be sent with some data" );
+    }
+
+    iovec data_iov { const_cast<char *>( data.data() ), data.length() };
+
+    string control( CMSG_SPACE( sizeof( int ) * fds.size() ), '\0' );
+
+    msghdr message;
+    zero( message );
+    message.msg_iov = &data_iov;
+    message.msg_iovlen = 1;
+
+    if ( not fds.empty() ) {
+        message.msg_control = &control[ 0 ];
+        message.msg_controllen = control.length();
+
+        cmsghdr * header = CMSG_FIRSTHDR( &message );
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN( sizeof( int ) * fds.size() );
+        memcpy( CMSG_DATA( header ), fds.data(), sizeof( int ) * fds.size() );
+    }
+
+    const size_t bytes_sent = CheckSystemCall( "sendmsg", ::sendmsg( fd_num(), &message, 0 ) );
+    register_write();
+
+    if ( bytes_sent < data.length() ) {
+        write( data.substr( bytes_sent ) );
+    }
+}
+
+string UnixSocket::recv_with_fds( vector<FileDescriptor> & fds )
+{
+    static constexpr size_t MAX_FDS = 16;
+
+    string buffer( BUFFER_SIZE, '\0' );
+    iovec data_iov { &buffer[ 0 ], buffer.length() };
+
+    string control( CMSG_SPACE( sizeof( int ) * MAX_FDS ), '\0' );
+
+    msghdr message;
+    zero( message );
+    message.msg_iov = &data_iov;
+    message.msg_iovlen = 1;
+    message.msg_control = &control[ 0 ];
+    message.msg_controllen = control.length();
+
+    const size_t bytes_read = CheckSystemCall( "recvmsg",
+                                               ::recvmsg( fd_num(), &message, MSG_CMSG_CLOEXEC ) );
+    register_read();
+
+    for ( cmsghdr * header = CMSG_FIRSTHDR( &message ); header != nullptr;
+          header = CMSG_NXTHDR( &message, header ) ) {
+        if ( header->cmsg_level != SOL_SOCKET or header->cmsg_type != SCM_RIGHTS ) {
+            continue;
+        }
+
+        const size_t count = ( header->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+
+        for ( size_t i = 0; i < count; i++ ) {
+            int fd;
+            memcpy( &fd, CMSG_DATA( header ) + i * sizeof( int ), sizeof( int ) );
+            fds.emplace_back( fd );
+        }
+    }
+
+    if ( message.msg_flags & MSG_CTRUNC ) {
+        throw runtime_error( "recvmsg: too many descriptors" );
+    }
+
+    if ( bytes_read == 0 ) {
+        set_eof();
+    }
+
+    buffer.resize( bytes_read );
+    return buffer;
+}
@@ -4,6 +4,8 @@
 #define SOCKET_HH
 
 #include <functional>
+#include <string>
+#include <vector>
 
 #include "address.hh"
 #include "util/file_descriptor.hh"
@@ -85,6 +87,34 @@ public:
 
     /* are there pending errors on a nonblocking socket? */
     void verify_no_errors() const;
+
+    /* disable Nagle's algorithm, for pipelined request/response traffic */
+    void set_nodelay( void );
+};
+
+/* UNIX-domain stream socket, which can also pass file descriptors */
+class UnixSocket : public Socket
+{
+private:
+    /* constructor used by accept() */
+    UnixSocket( FileDescriptor && fd ) : Socket( std::move( fd ), AF_UNIX, SOCK_STREAM ) {}
+
+public:
+    /* a stream socket, unless asked for another type (e.g. SOCK_DGRAM) */
+    UnixSocket( const int type = SOCK_STREAM ) : Socket( AF_UNIX, type | SOCK_CLOEXEC ) {}
+
+    /* bind to, or connect to, a socket file */
+    void bind( const std::string & path );
+    void connect( const std::string & path );
+
+    void listen( const int backlog = 16 );
+    UnixSocket accept( void );
+
+    /* send all of the data, with the descriptors attached to its first byte */
+    void send_with_fds( const std::string & data, const std::vector<int> & fds );
+
+    /* receive some data, and the descriptors that came with it (if any) */
+    std::string recv_with_fds( std::vector<FileDescriptor> & fds );
 };
 
 #endif /* SOCKET_HH */
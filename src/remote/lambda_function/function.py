@@ -4,6 +4,7 @@ import os
 import sys
 import time
 import shutil
+import hashlib
 import subprocess as sub
 from base64 import b64decode, b64encode
 
@@ -23,6 +24,45 @@ from common import is_executable, make_executable, run_command
 def is_hash_for_thunk(hash):
     return len(hash) > 0 and hash[0] == 'T'
 
+# Every pack index entry starts with the object's hash
+PACK_INDEX_ENTRY_SIZE = 64
+HASH_LENGTH = 52
+
+def stored_hashes():
+    for blob in os.listdir(GGPaths.blobs):
+        yield blob
+
+    if not os.path.isdir(GGPaths.packs):
+        return
+
+    for name in os.listdir(GGPaths.packs):
+        if not name.endswith(".idx"):
+            continue
+
+        with open(os.path.join(GGPaths.packs, name), 'rb') as fin:
+            index = fin.read()
+
+        for offset in range(0, len(index) - PACK_INDEX_ENTRY_SIZE + 1,
+                            PACK_INDEX_ENTRY_SIZE):
+            yield index[offset:offset + HASH_LENGTH].decode('ascii')
+
+# A Bloom filter over the blobs we have, so that the reductor can send us the
+# jobs whose inputs we already hold. Keep in sync with util/bloom_filter.hh.
+def blob_summary(size=8192, hash_count=4):
+    bits = bytearray(size)
+    bit_count = size * 8
+
+    for blob in stored_hashes():
+        digest = hashlib.sha256(blob.encode('ascii')).digest()
+        h1 = int.from_bytes(digest[0:8], 'little')
+        h2 = int.from_bytes(digest[8:16], 'little')
+
+        for i in range(hash_count):
+            position = ((h1 + i * h2) & 0xffffffffffffffff) % bit_count
+            bits[position // 8] |= 1 << (position % 8)
+
+    return b64encode(bytes(bits)).decode('ascii')
+
 def handler(event, context):
     os.environ['GG_STORAGE_URI'] = event['storageBackend']
     thunks = event['thunks']
@@ -45,11 +85,13 @@ def handler(event, context):
                 make_executable(blob_path)
 
     # Remove old thunk-execute directories
-    os.system("rm -rf /tmp/thunk-execute.*")
+    os.system("rm -rf {}/thunk-execute.*".format(GGPaths.scratch))
 
-    # Execute the thunk, and upload the result
+    # Execute the thunk, and upload the result. Blobs from earlier invocations
+    # are kept, up to GG_RETAIN_SIZE, so that a warm container can reuse them.
     return_code, stdout = run_command(["gg-execute-static",
-         "--get-dependencies", "--put-output", "--cleanup",] +
+         "--get-dependencies", "--put-output",
+         "--retain={}".format(os.environ.get('GG_RETAIN_SIZE', '256M'))] +
          [x['hash'] for x in thunks])
 
     executed_thunks = []
@@ -84,8 +126,14 @@ def handler(event, context):
             'outputs': outputs
         }]
 
-    return {
+    response = {
         'returnCode': 0,
         'stdout': '',
         'executedThunks': executed_thunks
     }
+
+    # Only a runner keeps its blobs in one place that the reductor can target
+    if os.environ.get('GG_RUNNER'):
+        response['blobSummary'] = blob_summary()
+
+    return response
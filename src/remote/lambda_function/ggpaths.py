@@ -12,7 +12,9 @@ if not os.path.isabs(GG_DIR):
 
 class GGPaths:
     blobs = os.path.join(GG_DIR, "blobs")
+    packs = os.path.join(GG_DIR, "packs")
     reductions = os.path.join(GG_DIR, "reductions")
+    scratch = os.path.join(GG_DIR, "tmp")
 
     @classmethod
     def blob_path(cls, blob_hash):
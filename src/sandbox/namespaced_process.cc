@@ -0,0 +1,169 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "namespaced_process.hh"
+
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
+
+using namespace std;
+
+static void write_file( const string & filename, const string & contents )
+{
+  FileDescriptor file { CheckSystemCall( "open (" + filename + ")",
+                                         open( filename.c_str(), O_WRONLY | O_CLOEXEC ) ) };
+  file.write( contents );
+}
+
+static void bind_mount( const string & source, const string & target,
+                        unsigned long flags )
+{
+  CheckSystemCall( "mount (" + source + ")",
+                   mount( source.c_str(), target.c_str(), nullptr, MS_BIND, nullptr ) );
+
+  /* in a user namespace, a remount can't clear the flags that the source
+     file system was mounted with */
+  struct statvfs source_info;
+  CheckSystemCall( "statvfs (" + source + ")", statvfs( source.c_str(), &source_info ) );
+
+  if ( source_info.f_flag & ST_RDONLY ) { flags |= MS_RDONLY; }
+  if ( source_info.f_flag & ST_NOSUID ) { flags |= MS_NOSUID; }
+  if ( source_info.f_flag & ST_NODEV ) { flags |= MS_NODEV; }
+  if ( source_info.f_flag & ST_NOEXEC ) { flags |= MS_NOEXEC; }
+  if ( source_info.f_flag & ST_NOATIME ) { flags |= MS_NOATIME; }
+  if ( source_info.f_flag & ST_NODIRATIME ) { flags |= MS_NODIRATIME; }
+  if ( source_info.f_flag & ST_RELATIME ) { flags |= MS_RELATIME; }
+
+  CheckSystemCall( "remount (" + target + ")",
+                   mount( nullptr, target.c_str(), nullptr,
+                          MS_REMOUNT | MS_BIND | flags, nullptr ) );
+}
+
+static unsigned long mount_flags( const Permissions & permissions )
+{
+  return MS_NOSUID | MS_NODEV
+         | ( permissions.write ? 0 : MS_RDONLY )
+         | ( permissions.execute ? 0 : MS_NOEXEC );
+}
+
+/* runs in the child, before the child procedure */
+static void enter_sandbox( const unordered_map<string, Permissions> & allowed_files,
+                           const string & root, const string & working_directory )
+{
+  const uid_t uid = getuid();
+  const gid_t gid = getgid();
+
+  CheckSystemCall( "unshare", unshare( CLONE_NEWUSER | CLONE_NEWNS ) );
+
+  /* the process keeps its own uid and gid in the namespace */
+  write_file( "/proc/self/setgroups", "deny" );
+  write_file( "/proc/self/uid_map", to_string( uid ) + " " + to_string( uid ) + " 1" );
+  write_file( "/proc/self/gid_map", to_string( gid ) + " " + to_string( gid ) + " 1" );
+
+  /* nothing we mount should show up outside */
+  CheckSystemCall( "mount (/)", mount( nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr ) );
+  CheckSystemCall( "mount (" + root + ")",
+                   mount( "tmpfs", root.c_str(), "tmpfs", MS_NOSUID | MS_NODEV, "mode=0755" ) );
+
+  for ( const auto & allowed_file : allowed_files ) {
+    const string & path = allowed_file.first;
+
+    /* the outputs; they are written to the working directory */
+    if ( not roost::is_absolute( path ) ) {
+      continue;
+    }
+
+    const string target = root + path;
+
+    /* a directory only gets the allowed files that are in it */
+    if ( roost::is_directory( path ) ) {
+      roost::create_directories( target );
+      continue;
+    }
+
+    roost::create_directories( roost::dirname( target ) );
+    FileDescriptor { CheckSystemCall( "open (" + target + ")",
+                                      open( target.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC,
+                                            0600 ) ) };
+
+    bind_mount( path, target, mount_flags( allowed_file.second ) );
+  }
+
+  roost::create_directories( root + working_directory );
+  bind_mount( working_directory, root + working_directory, MS_NOSUID | MS_NODEV );
+
+  CheckSystemCall( "remount (" + root + ")",
+                   mount( nullptr, root.c_str(), nullptr,
+                          MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NODEV, nullptr ) );
+
+  /* swap the roots, and let go of the old one */
+  CheckSystemCall( "chdir (" + root + ")", chdir( root.c_str() ) );
+  CheckSystemCall( "pivot_root", syscall( SYS_pivot_root, ".", "." ) );
+  CheckSystemCall( "umount", umount2( ".", MNT_DETACH ) );
+
+  CheckSystemCall( "chdir (" + working_directory + ")", chdir( working_directory.c_str() ) );
+
+  /* the capabilities in the namespace are gone after execve, since the
+     process isn't root; make sure it can't get new ones */
+  CheckSystemCall( "prctl(PR_SET_NO_NEW_PRIVS)", prctl( PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0 ) );
+}
+
+NamespacedProcess::NamespacedProcess( const string & name,
+                                      const unordered_map<string, Permissions> & allowed_files,
+                                      const string & working_directory,
+                                      function<int()> && child_procedure )
+  : root_( working_directory + "-root" ),
+    process_( name,
+              [allowed_files, working_directory, child_procedure, this]() {
+                enter_sandbox( allowed_files, root_.name(), working_directory );
+                return child_procedure(); } )
+{}
+
+void NamespacedProcess::execute()
+{
+  while ( not process_.terminated() ) {
+    process_.wait();
+  }
+
+  if ( process_.exit_status() ) {
+    process_.throw_exception();
+  }
+}
+
+bool NamespacedProcess::supported()
+{
+  static const bool result = [] () {
+    /* unsharing isn't enough: some kernels and containers let the process
+       create the namespaces, but not mount anything in them. so the probe
+       goes through the same steps as a real run, with nothing allowed. */
+    TempDirectory working_directory { "/tmp/gg-namespace-probe" };
+    TempDirectory root { working_directory.name() + "-root" };
+
+    ChildProcess probe { "namespace-probe",
+      [&working_directory, &root] () {
+        try {
+          enter_sandbox( {}, root.name(), working_directory.name() );
+          return EXIT_SUCCESS;
+        }
+        catch ( const exception & ) {
+          return EXIT_FAILURE;
+        }
+      } };
+
+    while ( not probe.terminated() ) {
+      probe.wait();
+    }
+
+    return probe.exit_status() == 0;
+  } ();
+
+  return result;
+}
@@ -0,0 +1,40 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef NAMESPACED_PROCESS_HH
+#define NAMESPACED_PROCESS_HH
+
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+#include "sandbox.hh"
+#include "util/child_process.hh"
+#include "util/temp_dir.hh"
+
+/* runs the process in its own user and mount namespaces, with a root file
+   system that only has the allowed files in it (bind mounted, read-only,
+   and executable only if they're allowed to be), and the working directory,
+   which is writable. the kernel does the checks, so unlike
+   SandboxedProcess, the process runs at full speed. */
+
+class NamespacedProcess
+{
+private:
+  /* the mount point for the new root; it stays empty outside the sandbox */
+  TempDirectory root_;
+  ChildProcess process_;
+
+public:
+  NamespacedProcess( const std::string & name,
+                     const std::unordered_map<std::string, Permissions> & allowed_files,
+                     const std::string & working_directory,
+                     std::function<int()> && child_procedure );
+
+  /* throws an exception if the process fails. */
+  void execute();
+
+  /* can this user create the namespaces, and set up the sandbox in them? */
+  static bool supported();
+};
+
+#endif /* NAMESPACED_PROCESS_HH */
@@ -4,10 +4,71 @@
 
 #include <iostream>
 #include <functional>
+#include <vector>
 #include <fcntl.h>
 
 using namespace std;
 
+static bool is_forbidden( const long syscall_no )
+{
+  switch ( syscall_no ) {
+  case SYS_chroot:
+  case SYS_stat:
+  case SYS_lstat:
+  case SYS_chdir:
+  case SYS_fchdir:
+  case SYS_openat:
+  case SYS_mkdirat:
+  case SYS_mknodat:
+  case SYS_fchownat:
+  case SYS_futimesat:
+  case SYS_newfstatat:
+  case SYS_unlinkat:
+  case SYS_renameat:
+  case SYS_linkat:
+  case SYS_symlinkat:
+  case SYS_readlinkat:
+  case SYS_fchmodat:
+  case SYS_faccessat:
+  case SYS_utimensat:
+  case SYS_name_to_handle_at:
+  case SYS_open_by_handle_at:
+#ifdef SYS_execveat
+  case SYS_execveat:
+#endif
+  case SYS_fanotify_mark:
+  case SYS_renameat2:
+  case SYS_getpid:
+  case SYS_gettimeofday:
+  case SYS_time:
+  case SYS_clock_gettime:
+  case SYS_getcpu:
+  case SYS_mkdir:
+  case SYS_socket:
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+/* the syscalls that syscall_entry() has to look at; the rest are let
+   through by the seccomp filter without stopping the process */
+static vector<long> checked_syscalls()
+{
+  vector<long> syscalls;
+
+  for ( long syscall_no = 0; syscall_signature( syscall_no ).number() != -1; syscall_no++ ) {
+    const SystemCallSignature & sig = syscall_signature( syscall_no );
+
+    if ( not sig.complete() or ( sig.flags() & TRACE_FILE ) or is_forbidden( syscall_no ) ) {
+      syscalls.push_back( syscall_no );
+    }
+  }
+
+  return syscalls;
+}
+
 SandboxedProcess::SandboxedProcess( const std::string & name,
                                     const unordered_map<std::string, Permissions> & allowed_files,
                                     function<int()> && child_procedure,
@@ -15,7 +76,7 @@ SandboxedProcess::SandboxedProcess( const std::string & name,
   : tracer_( name, move( child_procedure ),
              std::bind( &SandboxedProcess::syscall_entry, this, std::placeholders::_1 ),
              std::bind( &SandboxedProcess::syscall_exit,  this, std::placeholders::_1 ),
-             move( preparation_procedure ) ),
+             move( preparation_procedure ), checked_syscalls() ),
     allowed_files_( allowed_files )
 {}
 
@@ -30,7 +91,7 @@ bool SandboxedProcess::file_syscall_entry( const SystemCallInvocation & syscall
 {
   assert( syscall.arguments().initialized() );
 
-  for ( const Argument arg : *syscall.arguments() ) {
+  for ( const Argument & arg : *syscall.arguments() ) {
     if ( arg.info().flags & ARGUMENT_F_PATHNAME ) { /* it's a path argument */
       const string pathname = arg.value<string>();
       if ( allowed_files_.count( pathname ) == 0 ) {
@@ -114,40 +175,7 @@ void SandboxedProcess::syscall_entry( TracedThreadInfo & tcb )
 {
   SystemCallInvocation & syscall = tcb.syscall_invocation.get();
 
-  switch ( syscall.syscall_no() ) {
-  case SYS_chroot:
-  case SYS_stat:
-  case SYS_lstat:
-  case SYS_chdir:
-  case SYS_fchdir:
-  case SYS_openat:
-  case SYS_mkdirat:
-  case SYS_mknodat:
-  case SYS_fchownat:
-  case SYS_futimesat:
-  case SYS_newfstatat:
-  case SYS_unlinkat:
-  case SYS_renameat:
-  case SYS_linkat:
-  case SYS_symlinkat:
-  case SYS_readlinkat:
-  case SYS_fchmodat:
-  case SYS_faccessat:
-  case SYS_utimensat:
-  case SYS_name_to_handle_at:
-  case SYS_open_by_handle_at:
-#ifdef SYS_execveat
-  case SYS_execveat:
-#endif
-  case SYS_fanotify_mark:
-  case SYS_renameat2:
-  case SYS_getpid:
-  case SYS_gettimeofday:
-  case SYS_time:
-  case SYS_clock_gettime:
-  case SYS_getcpu:
-  case SYS_mkdir:
-  case SYS_socket:
+  if ( is_forbidden( syscall.syscall_no() ) ) {
     throw SandboxViolation( "Forbidden syscall", tcb.syscall_invocation->to_string() );
   }
 
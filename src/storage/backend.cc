@@ -8,15 +8,42 @@
 
 #include "backend_local.hh"
 #include "backend_s3.hh"
+#include "backend_http.hh"
+#include "backend_chunked.hh"
+#include "backend_cache.hh"
+#include "util/compression.hh"
 #include "util/optional.hh"
 #include "util/tokenize.hh"
+#include "util/util.hh"
 
 using namespace std;
 
+/* `compress` enables zstd for uploads; `compress=N` picks the level */
+static int compression_level( const StorageEndpoint & endpoint )
+{
+  auto option = endpoint.options.find( "compress" );
+
+  if ( option == endpoint.options.end() ) {
+    return 0;
+  }
+
+  if ( option->second.length() == 0 ) {
+    return compression::DEFAULT_ZSTD_LEVEL;
+  }
+
+  const int level = stoi( option->second );
+
+  if ( level < 0 ) {
+    throw runtime_error( "invalid compression level: " + option->second );
+  }
+
+  return level;
+}
+
 unique_ptr<StorageBackend> StorageBackend::create_backend( const string & uri )
 {
   const static regex uri_regex {
-    R"RAWSTR(((s3)://)?(([^:\n\r]+):([^@\n\r]+)@)?(([^:/\n\r]+):?(\d*))/?([^?\n\r]+)?\??([^#\n\r]*)?#?([^\n\r]*))RAWSTR" };
+    R"RAWSTR(((s3|http)://)?(([^:\n\r]+):([^@\n\r]+)@)?(([^:/\n\r]+):?(\d*))/?([^?\n\r]+)?\??([^#\n\r]*)?#?([^\n\r]*))RAWSTR" };
 
   smatch uri_match_result;
 
@@ -51,6 +78,8 @@ unique_ptr<StorageBackend> StorageBackend::create_backend( const string & uri )
     throw runtime_error( "malformed storage uri" );
   }
 
+  unique_ptr<StorageBackend> backend;
+
   if ( endpoint.protocol == "s3" ) {
     AWSCredentials credentials;
 
@@ -58,13 +87,38 @@ unique_ptr<StorageBackend> StorageBackend::create_backend( const string & uri )
       credentials = AWSCredentials { endpoint.username, endpoint.password };
     }
 
-    return make_unique<S3StorageBackend>( credentials, endpoint.host,
-                                          endpoint.options.count( "region" ) ? endpoint.options[ "region" ]
-                                                                             : "us-east-1" );
+    backend = make_unique<S3StorageBackend>( credentials, endpoint.host,
+                                             endpoint.options.count( "region" ) ? endpoint.options[ "region" ]
+                                                                                : "us-east-1",
+                                             compression_level( endpoint ) );
+  }
+  else if ( endpoint.protocol == "http" ) {
+    backend = make_unique<HTTPStorageBackend>( endpoint.host,
+                                               endpoint.port.get_or( 0 ) ? *endpoint.port : 80,
+                                               endpoint.path, compression_level( endpoint ) );
   }
   else {
     throw runtime_error( "unknown storage backend" );
   }
 
-  return {};
+  /* `chunking` stores large objects as content-defined chunks; `chunking=N`
+     sets the smallest object size that gets chunked */
+  if ( endpoint.options.count( "chunking" ) ) {
+    const string & threshold = endpoint.options.at( "chunking" );
+    backend = make_unique<ChunkedStorageBackend>( move( backend ),
+      threshold.length() ? parse_size( threshold )
+                         : ChunkedStorageBackend::DEFAULT_THRESHOLD );
+  }
+
+  /* `cache=<dir>` puts a local disk cache in front of the remote storage,
+     holding at most `cache_size` bytes */
+  if ( endpoint.options.count( "cache" ) ) {
+    const string & cache_dir = endpoint.options.at( "cache" );
+    backend = make_unique<CachedStorageBackend>( move( backend ),
+      cache_dir.length() ? cache_dir : "/tmp/gg-cache",
+      endpoint.options.count( "cache_size" ) ? parse_size( endpoint.options.at( "cache_size" ) )
+                                             : CachedStorageBackend::DEFAULT_SIZE );
+  }
+
+  return backend;
 }
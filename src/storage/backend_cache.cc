@@ -0,0 +1,324 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "backend_cache.hh"
+
+#include <algorithm>
+#include <list>
+#include <sstream>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+
+using namespace std;
+using namespace storage;
+
+namespace {
+
+  FileDescriptor open_lock_file( const roost::path & path )
+  {
+    return { CheckSystemCall( "open (" + path.string() + ")",
+                              open( path.string().c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                                    S_IRUSR | S_IWUSR ) ) };
+  }
+
+  /* copies `src` to `dst`, sharing the blocks if the file system can. the
+     copies are never hardlinked: the blobs get chmod-ed and touched, and
+     that shouldn't reach the cache. returns false if `src` doesn't exist
+     (anymore). */
+  bool copy_object( const roost::path & src, const roost::path & dst )
+  {
+    try {
+      roost::copy_then_rename( src, dst );
+    }
+    catch ( const unix_error & e ) {
+      if ( e.error_code() == ENOENT ) { return false; }
+      throw;
+    }
+
+    return true;
+  }
+
+  void add( CachedStorageBackend::Stats & totals, const CachedStorageBackend::Stats & delta )
+  {
+    totals.hits += delta.hits;
+    totals.misses += delta.misses;
+    totals.coalesced += delta.coalesced;
+    totals.hit_bytes += delta.hit_bytes;
+    totals.miss_bytes += delta.miss_bytes;
+    totals.evictions += delta.evictions;
+  }
+
+  void create_directory( const roost::path & path )
+  {
+    if ( not roost::exists( path ) ) {
+      roost::create_directories( path );
+    }
+  }
+
+}
+
+CachedStorageBackend::CachedStorageBackend( unique_ptr<StorageBackend> && backend,
+                                            const roost::path & cache_dir,
+                                            const size_t max_size )
+  : backend_( move( backend ) ), cache_dir_( cache_dir ), max_size_( max_size )
+{
+  create_directory( cache_dir_ / "objects" );
+  create_directory( cache_dir_ / "incoming" );
+  create_directory( cache_dir_ / "locks" );
+}
+
+roost::path CachedStorageBackend::object_path( const string & key ) const
+{
+  return cache_dir_ / "objects" / key;
+}
+
+roost::path CachedStorageBackend::lock_path( const string & key ) const
+{
+  return cache_dir_ / "locks" / key;
+}
+
+/* copies a cached object to where it was requested, and marks it as
+   recently used */
+bool CachedStorageBackend::deliver( const GetRequest & request )
+{
+  const roost::path cached = object_path( request.object_key );
+
+  if ( utimensat( AT_FDCWD, cached.string().c_str(), nullptr, 0 ) != 0 ) {
+    if ( errno == ENOENT ) { return false; }
+    throw unix_error( "utimensat (" + cached.string() + ")" );
+  }
+
+  return copy_object( cached, request.filename );
+}
+
+void CachedStorageBackend::insert( const roost::path & filename, const string & key )
+{
+  if ( not roost::exists( object_path( key ) ) ) {
+    copy_object( filename, object_path( key ) );
+  }
+}
+
+void CachedStorageBackend::put( const vector<PutRequest> & requests,
+                                const PutCallback & success_callback )
+{
+  backend_->put( requests, success_callback );
+
+  for ( const PutRequest & request : requests ) {
+    insert( request.filename, request.object_key );
+  }
+
+  evict();
+}
+
+void CachedStorageBackend::get( const vector<GetRequest> & requests,
+                                const GetCallback & success_callback )
+{
+  Stats delta;
+
+  vector<GetRequest> to_fetch;
+  list<FileDescriptor> fetch_locks;
+  unordered_set<string> fetching;
+
+  vector<const GetRequest *> pending;
+  list<pair<const GetRequest *, FileDescriptor>> contended;
+
+  for ( const GetRequest & request : requests ) {
+    if ( deliver( request ) ) {
+      delta.hits++;
+      delta.hit_bytes += roost::file_size( request.filename );
+      success_callback( request );
+      continue;
+    }
+
+    if ( fetching.count( request.object_key ) ) {
+      pending.push_back( &request );
+      delta.coalesced++;
+      continue;
+    }
+
+    FileDescriptor lock = open_lock_file( lock_path( request.object_key ) );
+
+    if ( not lock.try_exclusive_lock() ) {
+      /* another process is fetching this object right now */
+      contended.emplace_back( &request, move( lock ) );
+      delta.coalesced++;
+      continue;
+    }
+
+    /* it might have arrived while we were waiting for the lock */
+    if ( deliver( request ) ) {
+      delta.hits++;
+      delta.hit_bytes += roost::file_size( request.filename );
+      success_callback( request );
+      continue;
+    }
+
+    fetching.insert( request.object_key );
+    to_fetch.push_back( { request.object_key,
+                          cache_dir_ / "incoming" / request.object_key } );
+    fetch_locks.push_back( move( lock ) );
+    pending.push_back( &request );
+    delta.misses++;
+  }
+
+  if ( to_fetch.size() ) {
+    backend_->get( to_fetch );
+
+    for ( const GetRequest & fetched : to_fetch ) {
+      delta.miss_bytes += roost::file_size( fetched.filename );
+      roost::rename( fetched.filename, object_path( fetched.object_key ) );
+    }
+  }
+
+  /* let the other processes waiting on these objects go */
+  fetch_locks.clear();
+
+  vector<GetRequest> uncached;
+
+  for ( const GetRequest * request : pending ) {
+    if ( deliver( *request ) ) {
+      success_callback( *request );
+    }
+    else {
+      /* evicted by somebody else before we could use it */
+      uncached.push_back( *request );
+    }
+  }
+
+  for ( auto & waiter : contended ) {
+    waiter.second.block_for_exclusive_lock();
+    waiter.second.release_lock();
+
+    if ( deliver( *waiter.first ) ) {
+      success_callback( *waiter.first );
+    }
+    else {
+      /* the other fetch failed */
+      uncached.push_back( *waiter.first );
+    }
+  }
+
+  if ( uncached.size() ) {
+    backend_->get( uncached, success_callback );
+  }
+
+  record( delta );
+
+  if ( to_fetch.size() ) {
+    evict();
+  }
+}
+
+void CachedStorageBackend::record( const Stats & delta )
+{
+  unique_lock<mutex> lock { stats_mutex_ };
+  add( stats_, delta );
+  add( unsaved_stats_, delta );
+}
+
+CachedStorageBackend::~CachedStorageBackend()
+{
+  const Stats & delta = unsaved_stats_;
+
+  if ( delta.hits + delta.misses + delta.coalesced + delta.evictions == 0 ) {
+    return;
+  }
+
+  /* one line per process; a single append needs no locking */
+  ostringstream sout;
+  sout << "hits " << delta.hits
+       << " misses " << delta.misses
+       << " coalesced " << delta.coalesced
+       << " hit_bytes " << delta.hit_bytes
+       << " miss_bytes " << delta.miss_bytes
+       << " evictions " << delta.evictions << "\n";
+
+  try {
+    const roost::path stats_path = cache_dir_ / "stats";
+    FileDescriptor stats_file { CheckSystemCall( "open (" + stats_path.string() + ")",
+                                                 open( stats_path.string().c_str(),
+                                                       O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                                                       S_IRUSR | S_IWUSR ) ) };
+    stats_file.write( sout.str() );
+  }
+  catch ( const exception & e ) {
+    print_exception( "cache stats", e );
+  }
+}
+
+/* drops the least recently used objects until the cache is back under 90%
+   of its size limit */
+void CachedStorageBackend::evict()
+{
+  struct Entry
+  {
+    string name;
+    timespec last_use;
+    off_t size;
+  };
+
+  FileDescriptor lock = open_lock_file( cache_dir_ / "lock" );
+  lock.block_for_exclusive_lock();
+
+  const roost::path objects_dir = cache_dir_ / "objects";
+  vector<Entry> entries;
+  size_t total_size = 0;
+
+  for ( const string & name : roost::get_directory_listing( objects_dir ) ) {
+    struct stat info;
+
+    if ( lstat( ( objects_dir / name ).string().c_str(), &info ) != 0 ) {
+      continue; /* somebody else removed it */
+    }
+
+    entries.push_back( { name, info.st_mtim, info.st_size } );
+    total_size += info.st_size;
+  }
+
+  if ( total_size <= max_size_ ) {
+    return;
+  }
+
+  sort( entries.begin(), entries.end(),
+        [] ( const Entry & a, const Entry & b )
+        {
+          return ( a.last_use.tv_sec != b.last_use.tv_sec )
+                 ? ( a.last_use.tv_sec < b.last_use.tv_sec )
+                 : ( a.last_use.tv_nsec < b.last_use.tv_nsec );
+        } );
+
+  Stats delta;
+  const size_t target_size = max_size_ / 10 * 9;
+
+  for ( const Entry & entry : entries ) {
+    if ( total_size <= target_size ) {
+      break;
+    }
+
+    FileDescriptor object_lock = open_lock_file( lock_path( entry.name ) );
+
+    if ( not object_lock.try_exclusive_lock() ) {
+      continue; /* being fetched again right now */
+    }
+
+    /* the lock file stays: a process that's waiting on it has to wake up
+       holding the lock that the next fetch of this object will take */
+    roost::remove( objects_dir / entry.name );
+
+    total_size -= entry.size;
+    delta.evictions++;
+  }
+
+  lock.release_lock();
+  record( delta );
+}
+
+CachedStorageBackend::Stats CachedStorageBackend::stats()
+{
+  unique_lock<mutex> lock { stats_mutex_ };
+  return stats_;
+}
@@ -0,0 +1,68 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef STORAGE_BACKEND_CACHE_HH
+#define STORAGE_BACKEND_CACHE_HH
+
+#include <memory>
+#include <mutex>
+
+#include "backend.hh"
+#include "util/units.hh"
+
+/* A read-through, write-through local disk cache in front of another
+   backend. Objects are kept in a content-addressed directory that can be
+   shared by many processes: fetches of the same object are coalesced with a
+   per-object lock, and the least recently used objects are evicted once the
+   cache grows past its size limit. */
+class CachedStorageBackend : public StorageBackend
+{
+public:
+  struct Stats
+  {
+    size_t hits { 0 };
+    size_t misses { 0 };
+    size_t coalesced { 0 };
+    size_t hit_bytes { 0 };
+    size_t miss_bytes { 0 };
+    size_t evictions { 0 };
+  };
+
+private:
+  std::unique_ptr<StorageBackend> backend_;
+  roost::path cache_dir_;
+  size_t max_size_;
+
+  std::mutex stats_mutex_ {};
+  Stats stats_ {};
+  Stats unsaved_stats_ {};
+
+  roost::path object_path( const std::string & key ) const;
+  roost::path lock_path( const std::string & key ) const;
+
+  bool deliver( const storage::GetRequest & request );
+  void insert( const roost::path & filename, const std::string & key );
+  void evict();
+  void record( const Stats & delta );
+
+public:
+  static constexpr size_t DEFAULT_SIZE = 1024_MiB;
+
+  CachedStorageBackend( std::unique_ptr<StorageBackend> && backend,
+                        const roost::path & cache_dir,
+                        const size_t max_size = DEFAULT_SIZE );
+
+  /* appends this process's counters to the `stats` file */
+  ~CachedStorageBackend();
+
+  void put( const std::vector<storage::PutRequest> & requests,
+            const PutCallback & success_callback = []( const storage::PutRequest & ){} ) override;
+
+  void get( const std::vector<storage::GetRequest> & requests,
+            const GetCallback & success_callback = []( const storage::GetRequest & ){} ) override;
+
+  /* the counters for this process; every process that used the cache adds
+     a line with its own to the `stats` file of the cache directory */
+  Stats stats();
+};
+
+#endif /* STORAGE_BACKEND_CACHE_HH */
@@ -0,0 +1,363 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "backend_chunked.hh"
+
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "thunk/ggutils.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/mmap.hh"
+#include "util/optional.hh"
+#include "util/temp_file.hh"
+#include "util/tokenize.hh"
+
+using namespace std;
+using namespace storage;
+
+namespace {
+
+  const string MANIFEST_MAGIC = "##GGCHUNKS##";
+
+  string read_file( const roost::path & path )
+  {
+    FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                           open( path.string().c_str(), O_RDONLY ) ) };
+    string contents;
+    while ( not file.eof() ) { contents += file.read(); }
+    return contents;
+  }
+
+  void write_range( FileDescriptor & file, const char * data, size_t length )
+  {
+    while ( length > 0 ) {
+      const ssize_t written = CheckSystemCall( "write", ::write( file.fd_num(), data, length ) );
+      data += written;
+      length -= written;
+    }
+  }
+
+  /* appends the file to `output`, a buffer at a time */
+  void append_file( FileDescriptor & output, const roost::path & path )
+  {
+    FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                           open( path.string().c_str(), O_RDONLY ) ) };
+    while ( not file.eof() ) { output.write( file.read() ); }
+  }
+
+  string serialize_manifest( const vector<string> & chunks )
+  {
+    string output = MANIFEST_MAGIC + "\n";
+
+    for ( const string & chunk : chunks ) {
+      output += chunk + "\n";
+    }
+
+    return output;
+  }
+
+  /* the staging files live in the gg directory, next to the blobs */
+  TempFile stage( const char * data, const size_t length )
+  {
+    TempFile file { ( gg::paths::chunk_index() / "staged" ).string() };
+    write_range( file.fd(), data, length );
+    return file;
+  }
+
+  TempFile stage( const string & contents )
+  {
+    return stage( contents.data(), contents.length() );
+  }
+
+  /* the blob that the index points to for this chunk, if it's still here */
+  Optional<roost::path> local_source( const string & chunk_hash )
+  {
+    const roost::path entry_path = gg::paths::chunk_index_entry( chunk_hash );
+
+    if ( not roost::exists( entry_path ) ) {
+      return {};
+    }
+
+    const vector<string> entry = split( read_file( entry_path ), " " );
+
+    if ( entry.size() != 2 ) {
+      return {};
+    }
+
+    const roost::path blob_path = gg::paths::blob_path( entry[ 0 ] );
+    return { roost::exists( blob_path ), blob_path };
+  }
+
+  /* remember where the chunks of a local blob are, for future fetches. an
+     existing entry is kept as long as the blob it points to is around. */
+  void index_chunks( const string & blob_hash, const vector<string> & chunks )
+  {
+    size_t offset = 0;
+
+    for ( const string & chunk : chunks ) {
+      if ( not local_source( chunk ).initialized() ) {
+        roost::atomic_create( blob_hash + " " + to_string( offset ),
+                              gg::paths::chunk_index_entry( chunk ) );
+      }
+
+      offset += gg::hash::size( chunk );
+    }
+  }
+
+  /* the index is only a hint: the blob might be gone or truncated, so the
+     data is verified before it's appended to `output` */
+  bool append_local_chunk( FileDescriptor & output, const string & chunk_hash )
+  {
+    try {
+      const vector<string> entry = split( read_file( gg::paths::chunk_index_entry( chunk_hash ) ), " " );
+      const roost::path blob_path = gg::paths::blob_path( entry.at( 0 ) );
+      const size_t offset = stoull( entry.at( 1 ) );
+      const size_t length = gg::hash::size( chunk_hash );
+
+      if ( not roost::exists( blob_path ) ) {
+        return false;
+      }
+
+      FileDescriptor blob { CheckSystemCall( "open (" + blob_path.string() + ")",
+                                             open( blob_path.string().c_str(), O_RDONLY ) ) };
+      const size_t blob_size = roost::file_size( blob_path );
+
+      if ( blob_size < offset + length ) {
+        return false;
+      }
+
+      const MappedFile mapping { blob, blob_size };
+      const char * data = mapping.data() + offset;
+
+      if ( gg::hash::compute( data, length, gg::ObjectType::Value ) == chunk_hash ) {
+        write_range( output, data, length );
+        return true;
+      }
+    }
+    catch ( const exception & ) {
+      /* fall through to downloading the chunk */
+    }
+
+    return false;
+  }
+
+}
+
+ChunkedStorageBackend::ChunkedStorageBackend( unique_ptr<StorageBackend> && backend,
+                                              const size_t threshold )
+  : backend_( move( backend ) ), threshold_( threshold )
+{}
+
+vector<string> ChunkedStorageBackend::parse_manifest( const string & object_key,
+                                                      const string & manifest )
+{
+  if ( manifest.compare( 0, MANIFEST_MAGIC.length(), MANIFEST_MAGIC ) != 0 ) {
+    throw runtime_error( "invalid chunk manifest for " + object_key );
+  }
+
+  vector<string> chunks;
+  size_t total_size = 0;
+
+  for ( const string & line : split( manifest.substr( MANIFEST_MAGIC.length() ), "\n" ) ) {
+    if ( line.length() == 0 ) { continue; }
+
+    if ( line.length() != gg::hash::length ) {
+      throw runtime_error( "invalid chunk in the manifest for " + object_key );
+    }
+
+    chunks.push_back( line );
+    total_size += gg::hash::size( line );
+  }
+
+  if ( total_size != gg::hash::size( object_key ) ) {
+    throw runtime_error( "chunk manifest size mismatch for " + object_key );
+  }
+
+  return chunks;
+}
+
+bool ChunkedStorageBackend::should_chunk( const string & object_key ) const
+{
+  return object_key.length() == gg::hash::length and
+         gg::hash::size( object_key ) >= threshold_;
+}
+
+void ChunkedStorageBackend::put( const vector<PutRequest> & requests,
+                                 const PutCallback & success_callback )
+{
+  vector<PutRequest> forwarded;
+  vector<PutRequest> manifests;
+  list<TempFile> staged;
+
+  unordered_set<string> direct_keys;
+  unordered_set<string> chunk_keys;
+  vector<const PutRequest *> chunked_requests;
+
+  for ( const PutRequest & request : requests ) {
+    if ( not should_chunk( request.object_key ) ) {
+      forwarded.push_back( request );
+      direct_keys.insert( request.object_key );
+      continue;
+    }
+
+    /* the object is mapped, not read, and each chunk is staged straight
+       from the mapping */
+    FileDescriptor file { CheckSystemCall( "open (" + request.filename.string() + ")",
+                                           open( request.filename.string().c_str(), O_RDONLY ) ) };
+    const MappedFile contents { file, static_cast<size_t>( roost::file_size( request.filename ) ) };
+
+    vector<string> chunks;
+    size_t offset = 0;
+
+    for ( const size_t length : chunker_.chunk( contents.data(), contents.size() ) ) {
+      const char * data = contents.data() + offset;
+      const string chunk_hash = gg::hash::compute( data, length, gg::ObjectType::Value );
+      chunks.push_back( chunk_hash );
+      offset += length;
+
+      if ( gg::remote::is_available( chunk_hash ) or
+           not chunk_keys.insert( chunk_hash ).second ) {
+        continue;
+      }
+
+      staged.push_back( stage( data, length ) );
+      forwarded.push_back( { staged.back().name(), chunk_hash,
+                             gg::hash::to_hex( chunk_hash ) } );
+    }
+
+    index_chunks( request.object_key, chunks );
+
+    staged.push_back( stage( serialize_manifest( chunks ) ) );
+    manifests.push_back( { staged.back().name(), request.object_key, {} } );
+    chunked_requests.push_back( &request );
+  }
+
+  backend_->put( forwarded,
+    [&] ( const PutRequest & request )
+    {
+      if ( chunk_keys.count( request.object_key ) ) {
+        gg::remote::set_available( request.object_key );
+      }
+
+      if ( direct_keys.count( request.object_key ) ) {
+        success_callback( request );
+      }
+    } );
+
+  /* the manifests go last, so a manifest never names a chunk that isn't
+     there (the blob server checks) */
+  if ( not manifests.empty() ) {
+    backend_->put( manifests );
+  }
+
+  for ( const PutRequest * request : chunked_requests ) {
+    success_callback( *request );
+  }
+}
+
+void ChunkedStorageBackend::get( const vector<GetRequest> & requests,
+                                 const GetCallback & success_callback )
+{
+  /* first round: fetch the manifests along with all the small objects */
+  vector<GetRequest> forwarded;
+  list<pair<const GetRequest *, TempFile>> manifests;
+  unordered_set<string> direct_keys;
+
+  for ( const GetRequest & request : requests ) {
+    if ( not should_chunk( request.object_key ) ) {
+      forwarded.push_back( request );
+      direct_keys.insert( request.object_key );
+      continue;
+    }
+
+    manifests.emplace_back( &request, stage( {} ) );
+    forwarded.push_back( { request.object_key, manifests.back().second.name() } );
+  }
+
+  backend_->get( forwarded,
+    [&] ( const GetRequest & request )
+    {
+      if ( direct_keys.count( request.object_key ) ) {
+        success_callback( request );
+      }
+    } );
+
+  /* second round: fetch the chunks that we don't have a local copy of */
+  vector<pair<const GetRequest *, vector<string>>> objects;
+  vector<GetRequest> chunk_requests;
+  unordered_map<string, TempFile> fetched;
+
+  for ( const auto & manifest_file : manifests ) {
+    const GetRequest & request = *manifest_file.first;
+    const roost::path manifest_path { manifest_file.second.name() };
+
+    if ( static_cast<size_t>( roost::file_size( manifest_path ) ) ==
+         gg::hash::size( request.object_key ) ) {
+      /* this object was stored whole */
+      roost::copy_then_rename( manifest_path, request.filename );
+      success_callback( request );
+      continue;
+    }
+
+    const string manifest = read_file( manifest_path );
+
+    objects.emplace_back( &request, parse_manifest( request.object_key, manifest ) );
+
+    for ( const string & chunk : objects.back().second ) {
+      if ( local_source( chunk ).initialized() or fetched.count( chunk ) ) {
+        continue;
+      }
+
+      fetched.emplace( chunk, stage( {} ) );
+      chunk_requests.push_back( { chunk, fetched.at( chunk ).name() } );
+    }
+  }
+
+  if ( chunk_requests.size() ) {
+    backend_->get( chunk_requests );
+  }
+
+  for ( const GetRequest & request : chunk_requests ) {
+    gg::remote::set_available( request.object_key );
+  }
+
+  /* finally, put each object back together */
+  for ( const auto & object : objects ) {
+    const GetRequest & request = *object.first;
+    const vector<string> & chunks = object.second;
+
+    UniqueFile output { request.filename.string() };
+
+    for ( const string & chunk : chunks ) {
+      auto staged_chunk = fetched.find( chunk );
+
+      if ( staged_chunk != fetched.end() ) {
+        append_file( output.fd(), staged_chunk->second.name() );
+        continue;
+      }
+
+      if ( not append_local_chunk( output.fd(), chunk ) ) {
+        /* the local copy went away after all */
+        auto inserted = fetched.emplace( chunk, stage( {} ) );
+        backend_->get( { { chunk, inserted.first->second.name() } } );
+        append_file( output.fd(), inserted.first->second.name() );
+      }
+    }
+
+    output.fd().close();
+
+    if ( static_cast<size_t>( roost::file_size( output.name() ) ) !=
+         gg::hash::size( request.object_key ) ) {
+      throw runtime_error( "reassembled object has the wrong size: " + request.object_key );
+    }
+
+    roost::rename( output.name(), request.filename );
+    index_chunks( request.object_key, chunks );
+    success_callback( request );
+  }
+}
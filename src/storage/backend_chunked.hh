@@ -0,0 +1,45 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef STORAGE_BACKEND_CHUNKED_HH
+#define STORAGE_BACKEND_CHUNKED_HH
+
+#include <memory>
+
+#include "backend.hh"
+#include "util/cdc.hh"
+#include "util/units.hh"
+
+/* Stores large objects as a list of content-addressed chunks. The object key
+   maps to a small manifest that names the chunks, and every chunk is stored
+   under its own gghash, so a new version of a large binary only costs the
+   chunks that actually changed. Chunks that are already remote (according to
+   the remote index) aren't uploaded again, and chunks that are already in a
+   local blob (according to the chunk index) aren't downloaded again. */
+class ChunkedStorageBackend : public StorageBackend
+{
+private:
+  std::unique_ptr<StorageBackend> backend_;
+  size_t threshold_;
+  ContentDefinedChunker chunker_ {};
+
+  bool should_chunk( const std::string & object_key ) const;
+
+public:
+  static constexpr size_t DEFAULT_THRESHOLD = 8_MiB;
+
+  ChunkedStorageBackend( std::unique_ptr<StorageBackend> && backend,
+                         const size_t threshold = DEFAULT_THRESHOLD );
+
+  void put( const std::vector<storage::PutRequest> & requests,
+            const PutCallback & success_callback = []( const storage::PutRequest & ){} ) override;
+
+  void get( const std::vector<storage::GetRequest> & requests,
+            const GetCallback & success_callback = []( const storage::GetRequest & ){} ) override;
+
+  /* the chunks that make up the object; throws if `manifest` isn't a valid
+     manifest for it */
+  static std::vector<std::string> parse_manifest( const std::string & object_key,
+                                                  const std::string & manifest );
+};
+
+#endif /* STORAGE_BACKEND_CHUNKED_HH */
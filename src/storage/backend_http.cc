@@ -0,0 +1,185 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "backend_http.hh"
+
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+
+#include "net/socket.hh"
+#include "net/http_response_parser.hh"
+#include "util/compression.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/temp_file.hh"
+
+using namespace std;
+using namespace storage;
+
+HTTPStorageBackend::HTTPStorageBackend( const string & host, const uint16_t port,
+                                        const string & prefix,
+                                        const int compression_level )
+  : address_( host, to_string( port ) ), host_( host + ":" + to_string( port ) ),
+    prefix_( prefix ), compression_level_( compression_level )
+{
+  if ( prefix_.length() and prefix_.back() != '/' ) {
+    prefix_ += '/';
+  }
+}
+
+string HTTPStorageBackend::object_url( const string & key ) const
+{
+  return "/" + prefix_ + key;
+}
+
+template<class RequestType>
+void HTTPStorageBackend::pipeline( const vector<RequestType> & requests,
+                                   const function<HTTPRequest( const RequestType & )> & make_request,
+                                   const function<void( const RequestType &,
+                                                        const HTTPResponse & )> & handle_response )
+{
+  const size_t thread_count = min( max_connections_, requests.size() );
+
+  mutex error_mutex;
+  exception_ptr error;
+
+  vector<thread> threads;
+  for ( size_t thread_index = 0; thread_index < thread_count; thread_index++ ) {
+    threads.emplace_back(
+      [&] ( const size_t first_index )
+      {
+        try {
+          TCPSocket connection;
+          connection.connect( address_ );
+          connection.set_nodelay();
+
+          HTTPResponseParser responses;
+
+          /* this connection takes every thread_count-th request, and keeps
+             up to max_pipeline_depth_ of them in flight */
+          size_t next_to_send = first_index;
+          size_t next_to_receive = first_index;
+
+          while ( next_to_receive < requests.size() ) {
+            while ( next_to_send < requests.size() and
+                    ( next_to_send - next_to_receive ) / thread_count < max_pipeline_depth_ ) {
+              HTTPRequest outgoing_request = make_request( requests[ next_to_send ] );
+              responses.new_request_arrived( outgoing_request );
+              connection.write( outgoing_request.str() );
+              next_to_send += thread_count;
+            }
+
+            const string data = connection.read();
+
+            if ( connection.eof() ) {
+              throw runtime_error( "blob server closed the connection" );
+            }
+
+            responses.parse( data );
+
+            while ( not responses.empty() ) {
+              handle_response( requests[ next_to_receive ], responses.front() );
+              responses.pop();
+              next_to_receive += thread_count;
+            }
+          }
+        }
+        catch ( ... ) {
+          unique_lock<mutex> lock { error_mutex };
+          if ( not error ) { error = current_exception(); }
+        }
+      }, thread_index
+    );
+  }
+
+  for ( auto & thread : threads ) {
+    thread.join();
+  }
+
+  if ( error ) {
+    rethrow_exception( error );
+  }
+}
+
+void HTTPStorageBackend::put( const vector<PutRequest> & requests,
+                              const PutCallback & success_callback )
+{
+  pipeline<PutRequest>( requests,
+    [this] ( const PutRequest & request )
+    {
+      const string & filename = request.filename.string();
+      FileDescriptor file { CheckSystemCall( "open " + filename,
+                                             open( filename.c_str(), O_RDONLY ) ) };
+      string contents;
+      while ( not file.eof() ) { contents.append( file.read() ); }
+
+      string compressed;
+      const bool is_compressed = compression_level_ > 0 and
+        compression::zstd_compress( contents, compressed, compression_level_ );
+
+      if ( is_compressed ) {
+        contents = move( compressed );
+      }
+
+      HTTPRequest outgoing_request;
+      outgoing_request.set_first_line( "PUT " + object_url( request.object_key ) + " HTTP/1.1" );
+      outgoing_request.add_header( HTTPHeader{ "Host", host_ } );
+      outgoing_request.add_header( HTTPHeader{ "Content-Length", to_string( contents.size() ) } );
+
+      if ( is_compressed ) {
+        outgoing_request.add_header( HTTPHeader{ "Content-Encoding", compression::ZSTD_ENCODING } );
+      }
+
+      outgoing_request.done_with_headers();
+      outgoing_request.read_in_body( contents );
+      return outgoing_request;
+    },
+    [&success_callback] ( const PutRequest & request, const HTTPResponse & response )
+    {
+      if ( response.status_code() != "200" ) {
+        throw runtime_error( "HTTP failure in uploading '" + request.object_key + "': "
+                             + response.first_line() );
+      }
+
+      success_callback( request );
+    } );
+}
+
+void HTTPStorageBackend::get( const vector<GetRequest> & requests,
+                              const GetCallback & success_callback )
+{
+  pipeline<GetRequest>( requests,
+    [this] ( const GetRequest & request )
+    {
+      HTTPRequest outgoing_request;
+      outgoing_request.set_first_line( "GET " + object_url( request.object_key ) + " HTTP/1.1" );
+      outgoing_request.add_header( HTTPHeader{ "Host", host_ } );
+      outgoing_request.done_with_headers();
+      outgoing_request.read_in_body( "" );
+      return outgoing_request;
+    },
+    [&success_callback] ( const GetRequest & request, const HTTPResponse & response )
+    {
+      if ( response.status_code() != "200" ) {
+        throw runtime_error( "HTTP failure in downloading '" + request.object_key + "': "
+                             + response.first_line() );
+      }
+
+      const string & filename = request.filename.string();
+      UniqueFile temp_file { filename };
+
+      if ( response.has_header( "Content-Encoding" ) and
+           response.get_header_value( "Content-Encoding" ) == compression::ZSTD_ENCODING ) {
+        compression::zstd_decompress( response.body(), temp_file.fd() );
+      }
+      else if ( response.body().length() ) {
+        temp_file.write( response.body() );
+      }
+
+      temp_file.fd().close();
+      roost::rename( temp_file.name(), filename );
+
+      success_callback( request );
+    } );
+}
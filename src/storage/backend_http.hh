@@ -0,0 +1,49 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef STORAGE_BACKEND_HTTP_HH
+#define STORAGE_BACKEND_HTTP_HH
+
+#include <string>
+#include <functional>
+
+#include "backend.hh"
+#include "net/address.hh"
+#include "net/http_request.hh"
+#include "net/http_response.hh"
+
+/* talks to a plain HTTP blob server (e.g. gg-blob-server): GET /<key> and
+   PUT /<key>, pipelined over a few keep-alive connections */
+class HTTPStorageBackend : public StorageBackend
+{
+private:
+  Address address_;
+  std::string host_;
+  std::string prefix_;
+  int compression_level_;
+
+  size_t max_connections_ { 16 };
+  size_t max_pipeline_depth_ { 64 };
+
+  std::string object_url( const std::string & key ) const;
+
+  /* sends the requests over up to max_connections_ connections, and calls
+     `handle_response` for each response, in order */
+  template<class RequestType>
+  void pipeline( const std::vector<RequestType> & requests,
+                 const std::function<HTTPRequest( const RequestType & )> & make_request,
+                 const std::function<void( const RequestType &,
+                                           const HTTPResponse & )> & handle_response );
+
+public:
+  HTTPStorageBackend( const std::string & host, const uint16_t port,
+                      const std::string & prefix,
+                      const int compression_level = 0 );
+
+  void put( const std::vector<storage::PutRequest> & requests,
+            const PutCallback & success_callback = []( const storage::PutRequest & ){} ) override;
+
+  void get( const std::vector<storage::GetRequest> & requests,
+            const GetCallback & success_callback = []( const storage::GetRequest & ){} ) override;
+};
+
+#endif /* STORAGE_BACKEND_HTTP_HH */
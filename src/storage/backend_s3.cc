@@ -7,8 +7,15 @@ using namespace storage;
 
 S3StorageBackend::S3StorageBackend( const AWSCredentials & credentials,
                                     const string & s3_bucket,
-                                    const string & s3_region )
-  : client_( credentials, { s3_region } ), bucket_( s3_bucket )
+                                    const string & s3_region,
+                                    const int compression_level )
+  : client_( credentials, [&]() {
+      S3ClientConfig config;
+      config.region = s3_region;
+      config.compression_level = compression_level;
+      return config;
+    }() ),
+    bucket_( s3_bucket )
 {}
 
 void S3StorageBackend::put( const std::vector<PutRequest> & requests,
@@ -0,0 +1,202 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "transfer_agent.hh"
+
+#include <unordered_map>
+#include <stdexcept>
+
+#include "util/pipe.hh"
+
+using namespace std;
+using namespace storage;
+
+namespace {
+
+  typedef function<void( const string & )> ObjectCallback;
+
+  void transfer( StorageBackend & backend, const vector<PutRequest> & requests,
+                 const ObjectCallback & done )
+  {
+    backend.put( requests, [&done] ( const PutRequest & request ) { done( request.object_key ); } );
+  }
+
+  void transfer( StorageBackend & backend, const vector<GetRequest> & requests,
+                 const ObjectCallback & done )
+  {
+    backend.get( requests, [&done] ( const GetRequest & request ) { done( request.object_key ); } );
+  }
+
+}
+
+TransferAgent::TransferAgent( StorageBackend & backend,
+                              const size_t thread_count,
+                              const size_t max_batch_size )
+  : backend_( backend ), max_batch_size_( max_batch_size ),
+    notification_pipe_( make_pipe() )
+{
+  for ( size_t i = 0; i < thread_count; i++ ) {
+    threads_.emplace_back( &TransferAgent::worker, this );
+  }
+}
+
+TransferAgent::~TransferAgent()
+{
+  {
+    unique_lock<mutex> lock { mutex_ };
+    terminated_ = true;
+  }
+
+  work_available_.notify_all();
+
+  for ( auto & thread : threads_ ) {
+    thread.join();
+  }
+}
+
+void TransferAgent::upload( const PutRequest & request,
+                            const DoneCallbackFunc & callback )
+{
+  {
+    unique_lock<mutex> lock { mutex_ };
+    uploads_.push_back( { request, callback } );
+  }
+
+  pending_++;
+  work_available_.notify_one();
+}
+
+void TransferAgent::download( const GetRequest & request,
+                              const DoneCallbackFunc & callback )
+{
+  {
+    unique_lock<mutex> lock { mutex_ };
+    downloads_.push_back( { request, callback } );
+  }
+
+  pending_++;
+  work_available_.notify_one();
+}
+
+/* must be called with the lock held. there's at most one byte in the pipe,
+   so this never blocks. */
+void TransferAgent::notify()
+{
+  if ( not notified_ ) {
+    notified_ = true;
+    notification_pipe_.second.write( "x" );
+  }
+}
+
+void TransferAgent::worker()
+{
+  unique_lock<mutex> lock { mutex_ };
+
+  while ( true ) {
+    work_available_.wait( lock,
+      [this] { return terminated_ or uploads_.size() or downloads_.size(); } );
+
+    if ( terminated_ ) {
+      return;
+    }
+
+    /* the executions are waiting on the uploads, so they go first */
+    if ( uploads_.size() ) {
+      run_batch( uploads_, lock );
+    }
+    else {
+      run_batch( downloads_, lock );
+    }
+  }
+}
+
+template<class RequestType>
+void TransferAgent::run_batch( deque<Transfer<RequestType>> & queue,
+                               unique_lock<mutex> & lock )
+{
+  vector<RequestType> requests;
+  unordered_map<string, deque<DoneCallbackFunc>> callbacks;
+
+  while ( queue.size() and requests.size() < max_batch_size_ ) {
+    requests.push_back( queue.front().request );
+    callbacks[ queue.front().request.object_key ].push_back( move( queue.front().callback ) );
+    queue.pop_front();
+  }
+
+  lock.unlock();
+
+  try {
+    /* the backend might call this from its own threads */
+    transfer( backend_, requests,
+      [this, &callbacks] ( const string & object_key )
+      {
+        unique_lock<mutex> completion_lock { mutex_ };
+        auto object_callbacks = callbacks.find( object_key );
+
+        if ( object_callbacks == callbacks.end() or object_callbacks->second.empty() ) {
+          return;
+        }
+
+        completed_.emplace_back( object_key, move( object_callbacks->second.front() ) );
+        object_callbacks->second.pop_front();
+        notify();
+      } );
+
+    lock.lock();
+  }
+  catch ( ... ) {
+    lock.lock();
+
+    if ( not error_ ) {
+      error_ = current_exception();
+    }
+  }
+
+  /* whatever the backend didn't report back has failed, one way or the
+     other; it's no longer pending either */
+  for ( const auto & object_callbacks : callbacks ) {
+    if ( object_callbacks.second.empty() ) {
+      continue;
+    }
+
+    failed_ += object_callbacks.second.size();
+
+    if ( not error_ ) {
+      error_ = make_exception_ptr(
+        runtime_error( "transfer did not complete: " + object_callbacks.first ) );
+    }
+
+    notify();
+  }
+}
+
+void TransferAgent::process_completions()
+{
+  vector<pair<string, DoneCallbackFunc>> completed;
+  size_t failed;
+  exception_ptr error;
+
+  {
+    unique_lock<mutex> lock { mutex_ };
+
+    if ( notified_ ) {
+      notification_pipe_.first.read( 1 );
+      notified_ = false;
+    }
+
+    swap( completed, completed_ );
+    failed = failed_;
+    failed_ = 0;
+    error = move( error_ );
+    error_ = nullptr;
+  }
+
+  pending_ -= completed.size() + failed;
+
+  for ( const auto & done : completed ) {
+    done.second( done.first );
+  }
+
+  if ( error ) {
+    rethrow_exception( error );
+  }
+}
@@ -0,0 +1,93 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef STORAGE_TRANSFER_AGENT_HH
+#define STORAGE_TRANSFER_AGENT_HH
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+
+#include "backend.hh"
+#include "util/file_descriptor.hh"
+
+/* Runs the transfers of a StorageBackend on a few background threads, so
+   that the caller can keep doing other work. Each object's callback is run
+   on the caller's thread, from `process_completions()`, which should be
+   called whenever `fd()` becomes readable (e.g. from a Poller). */
+class TransferAgent
+{
+public:
+  typedef std::function<void( const std::string & /* object_key */ )> DoneCallbackFunc;
+
+private:
+  template<class RequestType>
+  struct Transfer
+  {
+    RequestType request;
+    DoneCallbackFunc callback;
+  };
+
+  StorageBackend & backend_;
+  size_t max_batch_size_;
+
+  std::mutex mutex_ {};
+  std::condition_variable work_available_ {};
+  bool terminated_ { false };
+
+  std::deque<Transfer<storage::PutRequest>> uploads_ {};
+  std::deque<Transfer<storage::GetRequest>> downloads_ {};
+
+  std::vector<std::pair<std::string, DoneCallbackFunc>> completed_ {};
+  size_t failed_ { 0 };
+  std::exception_ptr error_ {};
+  bool notified_ { false };
+
+  /* the worker threads wake up the owner by writing into this pipe */
+  std::pair<FileDescriptor, FileDescriptor> notification_pipe_;
+
+  size_t pending_ { 0 };
+
+  std::vector<std::thread> threads_ {};
+
+  void worker();
+  void notify();
+
+  template<class RequestType>
+  void run_batch( std::deque<Transfer<RequestType>> & queue,
+                  std::unique_lock<std::mutex> & lock );
+
+public:
+  TransferAgent( StorageBackend & backend,
+                 const size_t thread_count = 4,
+                 const size_t max_batch_size = 32 );
+
+  ~TransferAgent();
+
+  void upload( const storage::PutRequest & request,
+               const DoneCallbackFunc & callback = []( const std::string & ){} );
+
+  void download( const storage::GetRequest & request,
+                 const DoneCallbackFunc & callback = []( const std::string & ){} );
+
+  /* runs the callbacks of the finished transfers; rethrows the error if a
+     transfer has failed (a failed transfer is no longer pending, and its
+     callback is never called) */
+  void process_completions();
+
+  /* number of transfers whose callbacks haven't been called yet */
+  size_t pending() const { return pending_; }
+
+  FileDescriptor & fd() { return notification_pipe_.first; }
+
+  /* forbid copying or assigning */
+  TransferAgent( const TransferAgent & other ) = delete;
+  TransferAgent & operator=( const TransferAgent & other ) = delete;
+};
+
+#endif /* STORAGE_TRANSFER_AGENT_HH */
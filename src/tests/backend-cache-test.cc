@@ -0,0 +1,149 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <memory>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "storage/backend_cache.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
+#include "util/util.hh"
+
+using namespace std;
+using namespace storage;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+string read_file( const roost::path & path )
+{
+  FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                         open( path.string().c_str(), O_RDONLY ) ) };
+  string contents;
+  while ( not file.eof() ) { contents += file.read(); }
+  return contents;
+}
+
+struct stat file_info( const roost::path & path )
+{
+  struct stat info;
+  CheckSystemCall( "stat", stat( path.string().c_str(), &info ) );
+  return info;
+}
+
+/* a remote that keeps its objects in memory, and counts the downloads */
+class MemoryBackend : public StorageBackend
+{
+private:
+  map<string, string> & objects_;
+  size_t & downloads_;
+
+public:
+  MemoryBackend( map<string, string> & objects, size_t & downloads )
+    : objects_( objects ), downloads_( downloads ) {}
+
+  void put( const vector<PutRequest> & requests,
+            const PutCallback & success_callback ) override
+  {
+    for ( const PutRequest & request : requests ) {
+      objects_[ request.object_key ] = read_file( request.filename );
+      success_callback( request );
+    }
+  }
+
+  void get( const vector<GetRequest> & requests,
+            const GetCallback & success_callback ) override
+  {
+    for ( const GetRequest & request : requests ) {
+      roost::atomic_create( objects_.at( request.object_key ), request.filename );
+      downloads_++;
+      success_callback( request );
+    }
+  }
+};
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    UniqueDirectory test_dir { safe_getenv_or( "TEST_TMPDIR", "/tmp" ) + "/cache-test" };
+    const roost::path root { test_dir.name() };
+    const roost::path cache_dir = root / "cache";
+    const roost::path output = root / "output";
+
+    map<string, string> objects { { "A", string( 60, 'a' ) }, { "B", string( 60, 'b' ) } };
+    size_t downloads = 0;
+    bool ok = true;
+
+    auto check = [&ok] ( const bool condition, const string & what )
+      {
+        if ( not condition ) {
+          cerr << "failed: " << what << endl;
+          ok = false;
+        }
+      };
+
+    {
+      CachedStorageBackend cache { make_unique<MemoryBackend>( objects, downloads ),
+                                   cache_dir, 100 };
+
+      /* a miss, and then a hit */
+      cache.get( { { "A", output } } );
+      check( downloads == 1 and read_file( output ) == objects[ "A" ], "miss" );
+
+      roost::remove( output );
+      cache.get( { { "A", output } } );
+      check( downloads == 1 and read_file( output ) == objects[ "A" ], "hit" );
+
+      /* the delivered copy is not the cached one */
+      const roost::path cached = cache_dir / "objects" / "A";
+      check( file_info( output ).st_ino != file_info( cached ).st_ino, "separate copies" );
+      roost::make_executable( output );
+      check( not ( file_info( cached ).st_mode & S_IXUSR ), "mode of the cached copy" );
+
+      /* two requests for the same object in one call are one download */
+      cache.get( { { "B", root / "b1" }, { "B", root / "b2" } } );
+      check( downloads == 2 and read_file( root / "b2" ) == objects[ "B" ], "coalescing" );
+
+      /* A and B don't both fit, so A (the least recently used) is gone,
+         but its lock file, which other processes may be waiting on, isn't */
+      check( not roost::exists( cached ) and roost::exists( cache_dir / "objects" / "B" ),
+             "eviction" );
+      check( roost::exists( cache_dir / "locks" / "A" ), "lock files are kept" );
+
+      const CachedStorageBackend::Stats stats = cache.stats();
+      check( stats.hits == 1 and stats.misses == 2 and stats.coalesced == 1 and
+             stats.evictions == 1, "stats" );
+    }
+
+    /* the process's counters are appended to the shared file */
+    check( read_file( cache_dir / "stats" ) ==
+           "hits 1 misses 2 coalesced 1 hit_bytes 60 miss_bytes 120 evictions 1\n",
+           "stats file" );
+
+    roost::remove_directory( root );
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  catch ( const exception &  e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
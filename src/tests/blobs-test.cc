@@ -0,0 +1,244 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "thunk/blobs.hh"
+#include "thunk/ggutils.hh"
+#include "util/child_process.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
+#include "util/util.hh"
+
+using namespace std;
+using namespace gg;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+string read_file( const roost::path & path )
+{
+  FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                         open( path.string().c_str(), O_RDONLY ) ) };
+  string contents;
+  while ( not file.eof() ) { contents += file.read(); }
+  return contents;
+}
+
+bool is_executable( const roost::path & path )
+{
+  struct stat info;
+  CheckSystemCall( "stat", stat( path.string().c_str(), &info ) );
+  return info.st_mode & S_IXUSR;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const string small = "a small object";
+    const string large( blobs::PACKED_OBJECT_SIZE + 1, 'x' );
+    const string small_hash = gg::hash::compute( small, ObjectType::Value );
+    const string large_hash = gg::hash::compute( large, ObjectType::Value );
+
+    // Small objects go into a pack, large ones get a file of their own
+    blobs::write( small_hash, small );
+    blobs::write( large_hash, large );
+
+    if ( not blobs::exists( small_hash ) or blobs::read( small_hash ) != small or
+         roost::exists( paths::blob_path( small_hash ) ) ) {
+      cerr << "small object isn't packed" << endl;
+      return EXIT_FAILURE;
+    }
+
+    if ( not roost::exists( paths::blob_path( large_hash ) ) or
+         blobs::read( large_hash ) != large ) {
+      cerr << "large object isn't a file" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // A packed object keeps its mode, and comes back as a file on demand
+    const string script = "#!/bin/sh\n";
+    const string script_hash = gg::hash::compute( script, ObjectType::Value );
+    const roost::path source = safe_getenv_or( "TEST_TMPDIR", "/tmp" ) + "/script";
+
+    roost::atomic_create( script, source, true, 0755 );
+    blobs::insert( script_hash, source, true );
+
+    if ( roost::exists( source ) or roost::exists( paths::blob_path( script_hash ) ) ) {
+      cerr << "inserting didn't consume the source" << endl;
+      return EXIT_FAILURE;
+    }
+
+    const roost::path materialized = blobs::materialize( script_hash );
+
+    if ( materialized != paths::blob_path( script_hash ) or
+         read_file( materialized ) != script or not is_executable( materialized ) ) {
+      cerr << "bad materialized object" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // Objects packed by another process are found through the index
+    const string other = "packed somewhere else";
+    const string other_hash = gg::hash::compute( other, ObjectType::Value );
+
+    if ( blobs::exists( other_hash ) ) {
+      return EXIT_FAILURE;
+    }
+
+    ChildProcess writer { "writer",
+      [&] () { blobs::write( other_hash, other ); return EXIT_SUCCESS; } };
+
+    while ( not writer.terminated() ) {
+      writer.wait();
+    }
+
+    if ( writer.exit_status() != 0 or not blobs::exists( other_hash ) or
+         blobs::read( other_hash ) != other ) {
+      cerr << "object from the other process wasn't found" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // Only the objects that are kept survive, as files
+    blobs::retain_only( { small_hash } );
+
+    if ( not roost::exists( paths::blob_path( small_hash ) ) or
+         blobs::read( small_hash ) != small or
+         blobs::exists( large_hash ) or blobs::exists( other_hash ) or
+         blobs::exists( script_hash ) ) {
+      cerr << "retain_only kept the wrong objects" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // The packs start over
+    blobs::write( other_hash, other );
+
+    if ( blobs::read( other_hash ) != other or
+         roost::exists( paths::blob_path( other_hash ) ) ) {
+      cerr << "couldn't pack after retain_only" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // Eviction drops the least recently used objects that aren't pinned
+    blobs::retain_only( {} );
+
+    const uint64_t object_size = blobs::PACKED_OBJECT_SIZE + 1;
+    vector<string> hashes;
+
+    for ( const char c : { 'a', 'b', 'c', 'd' } ) {
+      const string contents( object_size, c );
+      hashes.push_back( gg::hash::compute( contents, ObjectType::Value ) );
+      blobs::write( hashes.back(), contents );
+    }
+
+    for ( const string & hash : hashes ) {
+      blobs::read( hash );
+    }
+
+    {
+      blobs::Pin pin { { hashes[ 0 ] } };
+      pin.add( { hashes[ 1 ] } );
+
+      blobs::evict( 3 * object_size );
+
+      if ( not blobs::exists( hashes[ 0 ] ) or not blobs::exists( hashes[ 1 ] ) or
+           blobs::exists( hashes[ 2 ] ) or not blobs::exists( hashes[ 3 ] ) ) {
+        cerr << "evicted the wrong objects" << endl;
+        return EXIT_FAILURE;
+      }
+
+      blobs::evict( 0 );
+
+      if ( not blobs::exists( hashes[ 0 ] ) or not blobs::exists( hashes[ 1 ] ) or
+           blobs::exists( hashes[ 3 ] ) ) {
+        cerr << "evicted pinned objects" << endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // A pin left behind by a process that's gone doesn't count
+    ChildProcess pinner { "pinner",
+      [&hashes] () { new blobs::Pin( { hashes[ 0 ] } ); return EXIT_SUCCESS; } };
+
+    while ( not pinner.terminated() ) {
+      pinner.wait();
+    }
+
+    blobs::evict( 0 );
+
+    if ( blobs::exists( hashes[ 0 ] ) or blobs::exists( hashes[ 1 ] ) or
+         roost::list_directory( paths::pins() ).size() != 2 /* . and .. */ ) {
+      cerr << "stale pins weren't ignored" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // Files that are still being written aren't objects
+    const roost::path partial = paths::blobs() / ( hashes[ 0 ] + ".a1B2c3" );
+    roost::atomic_create( "partial", partial );
+    blobs::evict( 0 );
+
+    if ( not roost::exists( partial ) ) {
+      cerr << "evicted a temporary file" << endl;
+      return EXIT_FAILURE;
+    }
+
+    roost::remove( partial );
+
+    // An object that's there once it's pinned stays there, even if another
+    // process is evicting at the same time
+    const string contents( object_size, 'e' );
+    const string hash = gg::hash::compute( contents, ObjectType::Value );
+
+    ChildProcess evictor { "evictor",
+      [] () {
+        for ( size_t i = 0; i < 500; i++ ) {
+          blobs::evict( 0 );
+        }
+
+        return EXIT_SUCCESS;
+      } };
+
+    for ( size_t i = 0; i < 500; i++ ) {
+      blobs::write( hash, contents );
+      blobs::Pin pin { { hash } };
+
+      try {
+        if ( blobs::exists( hash ) and blobs::read( hash ) != contents ) {
+          throw runtime_error( "bad contents" );
+        }
+      }
+      catch ( const exception & e ) {
+        cerr << "lost a pinned object: " << e.what() << endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    while ( not evictor.terminated() ) {
+      evictor.wait();
+    }
+
+    if ( evictor.exit_status() != 0 ) {
+      return EXIT_FAILURE;
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <stdexcept>
+
+#include "thunk/blobs.hh"
+#include "thunk/ggutils.hh"
+#include "util/bloom_filter.hh"
+#include "util/exception.hh"
+#include "util/path.hh"
+#include "util/system_runner.hh"
+#include "util/tokenize.hh"
+#include "util/util.hh"
+
+using namespace std;
+using namespace gg;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+string to_hex( const string & bytes )
+{
+  string output;
+  char digits[ 3 ];
+
+  for ( const char c : bytes ) {
+    snprintf( digits, sizeof( digits ), "%02x", static_cast<uint8_t>( c ) );
+    output += digits;
+  }
+
+  return output;
+}
+
+Optional<roost::path> find_python()
+{
+  for ( const string & dir : split( safe_getenv_or( "PATH", "/usr/bin" ), ":" ) ) {
+    if ( dir.length() and roost::exists( roost::path( dir ) / "python3" ) ) {
+      return roost::path( dir ) / "python3";
+    }
+  }
+
+  return {};
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    // No false negatives, and few false positives at the size the workers use
+    BloomFilter filter { 8192 };
+
+    for ( size_t i = 0; i < 1000; i++ ) {
+      filter.insert( gg::hash::compute( to_string( i ), ObjectType::Value ) );
+    }
+
+    size_t false_positives = 0;
+
+    for ( size_t i = 0; i < 10000; i++ ) {
+      if ( i < 1000 and
+           ( not filter.contains( gg::hash::compute( to_string( i ), ObjectType::Value ) ) or
+             not BloomFilter::from_bytes( filter.bytes() ).contains(
+               gg::hash::compute( to_string( i ), ObjectType::Value ) ) ) ) {
+        cerr << "false negative" << endl;
+        return EXIT_FAILURE;
+      }
+
+      false_positives += filter.contains( gg::hash::compute( to_string( i ), ObjectType::Thunk ) );
+    }
+
+    if ( false_positives > 100 ) {
+      cerr << false_positives << " false positives" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // The bit layout, as built by the rules in bloom_filter.hh (and Python)
+    BloomFilter small { 16 };
+    small.insert( "hello" );
+    small.insert( "gg" );
+
+    if ( to_hex( small.bytes() ) != "00000040001000104208040000000001" ) {
+      cerr << "unexpected bits: " << to_hex( small.bytes() ) << endl;
+      return EXIT_FAILURE;
+    }
+
+    try {
+      BloomFilter { 0 };
+      return EXIT_FAILURE;
+    }
+    catch ( const runtime_error & ) {}
+
+    // The handler's summary of a blob store (loose and packed) is the same
+    const Optional<roost::path> python = find_python();
+    const string abs_srcdir = safe_getenv_or( "abs_srcdir", "" );
+
+    if ( not python.initialized() or abs_srcdir.empty() ) {
+      cerr << "skipping the comparison with the Python handler" << endl;
+      return EXIT_SUCCESS;
+    }
+
+    BloomFilter expected { 8192 };
+
+    for ( const string & contents : { string( "small" ), string( "smaller" ),
+                                      string( blobs::PACKED_OBJECT_SIZE + 1, 'x' ),
+                                      string( blobs::PACKED_OBJECT_SIZE + 2, 'y' ) } ) {
+      const string hash = gg::hash::compute( contents, ObjectType::Value );
+      blobs::write( hash, contents );
+      expected.insert( hash );
+    }
+
+    const string handler_dir = abs_srcdir + "/../remote/lambda_function";
+    const vector<string> environment { "GG_DIR=" + paths::blobs().string() + "/.." };
+
+    /* running as root, ezexec insists on a clean environment */
+    CheckSystemCall( "clearenv", clearenv() );
+
+    const string summary = run( python->string(),
+      { "python3", "-c",
+        "import sys; from base64 import b64decode;"
+        "sys.path.insert(0, '" + handler_dir + "'); import function;"
+        "sys.stdout.write(b64decode(function.blob_summary()).hex())" },
+      environment, false, false, true );
+
+    if ( summary != to_hex( expected.bytes() ) ) {
+      cerr << "the Python handler built a different summary" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
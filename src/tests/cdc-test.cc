@@ -0,0 +1,151 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <array>
+#include <random>
+#include <stdexcept>
+
+#include "util/cdc.hh"
+#include "util/exception.hh"
+
+using namespace std;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+string random_data( const size_t length, const unsigned int seed )
+{
+  mt19937 generator { seed };
+  uniform_int_distribution<int> byte { 0, 255 };
+
+  string data( length, '\0' );
+  for ( char & c : data ) { c = static_cast<char>( byte( generator ) ); }
+  return data;
+}
+
+set<size_t> cut_points( const vector<size_t> & lengths )
+{
+  set<size_t> points;
+  size_t offset = 0;
+
+  for ( const size_t length : lengths ) {
+    offset += length;
+    points.insert( offset );
+  }
+
+  return points;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const size_t min_size = 1_KiB, avg_size = 4_KiB, max_size = 16_KiB;
+    const ContentDefinedChunker chunker { min_size, avg_size, max_size };
+
+    const string data = random_data( 1_MiB, 1 );
+    const vector<size_t> lengths = chunker.chunk( data );
+
+    /* the chunks cover the data, and respect the size limits */
+    size_t total = 0;
+    for ( size_t i = 0; i < lengths.size(); i++ ) {
+      total += lengths[ i ];
+
+      if ( lengths[ i ] > max_size or
+           ( i + 1 < lengths.size() and lengths[ i ] <= min_size ) ) {
+        cerr << "chunk " << i << " has length " << lengths[ i ] << endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    if ( total != data.size() ) {
+      cerr << "chunks don't add up to the data" << endl;
+      return EXIT_FAILURE;
+    }
+
+    /* the average is in the right neighborhood */
+    const size_t average = data.size() / lengths.size();
+    if ( average < avg_size / 2 or average > avg_size * 2 ) {
+      cerr << "average chunk length is " << average << endl;
+      return EXIT_FAILURE;
+    }
+
+    /* the cut points only depend on the data */
+    if ( chunker.chunk( data ) != lengths or
+         chunker.chunk( data.data(), data.size() ) != lengths ) {
+      cerr << "chunking is not deterministic" << endl;
+      return EXIT_FAILURE;
+    }
+
+    /* short data is a single chunk */
+    if ( chunker.next_cut( data.data(), min_size ) != min_size or
+         chunker.chunk( string {} ).size() != 0 ) {
+      cerr << "bad chunking of short data" << endl;
+      return EXIT_FAILURE;
+    }
+
+    /* an insertion only moves the boundaries around it */
+    const size_t insert_at = 300_KiB;
+    const string inserted = random_data( 100, 2 );
+
+    string edited = data;
+    edited.insert( insert_at, inserted );
+
+    const set<size_t> original_points = cut_points( lengths );
+    const set<size_t> edited_points = cut_points( chunker.chunk( edited ) );
+
+    size_t after = 0, kept = 0;
+    for ( const size_t point : original_points ) {
+      if ( point < insert_at + max_size ) {
+        if ( point < insert_at and not edited_points.count( point ) ) {
+          cerr << "boundary before the insertion moved: " << point << endl;
+          return EXIT_FAILURE;
+        }
+
+        continue;
+      }
+
+      after++;
+      kept += edited_points.count( point + inserted.size() );
+    }
+
+    if ( kept != after ) {
+      cerr << kept << " of " << after << " boundaries survived the insertion" << endl;
+      return EXIT_FAILURE;
+    }
+
+    /* bad parameters, including ones the masks can't be computed for */
+    const vector<array<size_t, 3>> bad_parameters {
+      { { 8_KiB, 4_KiB, 16_KiB } }, { { 0, 0, 0 } }, { { 1, 1, 1 } },
+      { { 1, 1ULL << 63, ~0ULL } },
+    };
+
+    for ( const auto & parameters : bad_parameters ) {
+      try {
+        ContentDefinedChunker { parameters[ 0 ], parameters[ 1 ], parameters[ 2 ] };
+        cerr << "accepted bad parameters" << endl;
+        return EXIT_FAILURE;
+      }
+      catch ( const runtime_error & ) {}
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
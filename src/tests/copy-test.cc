@@ -0,0 +1,149 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <random>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
+#include "util/units.hh"
+#include "util/util.hh"
+
+using namespace std;
+using roost::CopyMethod;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+string read_file( const roost::path & path )
+{
+  FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                         open( path.string().c_str(), O_RDONLY ) ) };
+  string contents;
+  while ( not file.eof() ) { contents += file.read(); }
+  return contents;
+}
+
+mode_t file_mode( const roost::path & path )
+{
+  struct stat info;
+  CheckSystemCall( "stat", stat( path.string().c_str(), &info ) );
+  return info.st_mode & 07777;
+}
+
+string random_data( const size_t length )
+{
+  mt19937 generator { 1 };
+  uniform_int_distribution<int> byte { 0, 255 };
+
+  string data( length, '\0' );
+  for ( char & c : data ) { c = static_cast<char>( byte( generator ) ); }
+  return data;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    UniqueDirectory test_dir { safe_getenv_or( "TEST_TMPDIR", "/tmp" ) + "/copy-test" };
+    const roost::path root { test_dir.name() };
+
+    /* bigger than a single copy_file_range or sendfile call is likely to
+       copy, with a tail that isn't a whole block */
+    const vector<string> sources { {}, "x", random_data( 5_MiB + 123 ) };
+
+    // Each method copies the contents and the mode, starting from any of them
+    for ( const CopyMethod method : { CopyMethod::Reflink, CopyMethod::CopyFileRange,
+                                      CopyMethod::Sendfile } ) {
+      for ( const string & contents : sources ) {
+        const roost::path src = root / "src";
+        const roost::path dst = root / "dst";
+
+        roost::atomic_create( contents, src, true, 0750 );
+        roost::copy_then_rename( src, dst, method );
+
+        if ( read_file( dst ) != contents or file_mode( dst ) != 0750 or
+             read_file( src ) != contents ) {
+          cerr << "bad copy of " << contents.size() << " bytes with method "
+               << static_cast<int>( method ) << endl;
+          return EXIT_FAILURE;
+        }
+
+        /* the copy is separate from the original */
+        roost::atomic_create( "changed", src );
+
+        if ( read_file( dst ) != contents ) {
+          cerr << "the copy changed with the original" << endl;
+          return EXIT_FAILURE;
+        }
+
+        roost::remove( src );
+        roost::remove( dst );
+      }
+    }
+
+    // A failed copy leaves nothing behind
+    roost::create_directories( root / "directory" );
+
+    try {
+      roost::copy_then_rename( root / "directory", root / "dst" );
+      return EXIT_FAILURE;
+    }
+    catch ( const runtime_error & ) {}
+
+    try {
+      roost::copy_then_rename( root / "missing", root / "dst" );
+      return EXIT_FAILURE;
+    }
+    catch ( const unix_error & ) {}
+
+    if ( roost::list_directory( root ).size() != 3 /* ., .. and the directory */ ) {
+      cerr << "a failed copy left files behind" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // Moving a file renames it, or copies it to the other file system
+    const string contents = random_data( 1_MiB );
+
+    for ( const roost::path & target_dir : { root, roost::path { "/dev/shm" } } ) {
+      if ( not roost::is_directory( target_dir ) ) {
+        continue;
+      }
+
+      const roost::path target = target_dir / ( "moved-" + to_string( getpid() ) );
+
+      roost::atomic_create( contents, root / "src" );
+      roost::move_file( root / "src", target );
+
+      if ( roost::exists( root / "src" ) or read_file( target ) != contents ) {
+        cerr << "bad move to " << target.string() << endl;
+        return EXIT_FAILURE;
+      }
+
+      roost::remove( target );
+    }
+
+    roost::remove_directory( root );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,327 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdlib>
+#include <google/protobuf/util/json_util.h>
+
+#include "execution/engine_gg.hh"
+#include "execution/loop.hh"
+#include "net/http_request_parser.hh"
+#include "net/socket.hh"
+#include "protobufs/gg.pb.h"
+#include "thunk/ggutils.hh"
+#include "thunk/thunk.hh"
+#include "util/bloom_filter.hh"
+#include "util/child_process.hh"
+#include "util/exception.hh"
+
+using namespace std;
+using namespace gg;
+using namespace gg::thunk;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+/* runs the loop until `done` is true */
+void run_until( ExecutionLoop & loop, const function<bool()> & done )
+{
+  while ( not done() ) {
+    if ( loop.loop_once( 5000 ).result == Poller::Result::Type::Timeout ) {
+      throw runtime_error( "timed out" );
+    }
+  }
+}
+
+Thunk make_thunk( const string & name, vector<Thunk::DataItem> values = {} )
+{
+  const string function_hash = gg::hash::compute( name, ObjectType::Value );
+  return { { function_hash, { name }, {} }, move( values ), {},
+           { { function_hash, "" } }, { "output" } };
+}
+
+/* the response of a runner that executed the thunk into `outputs`, and
+   has the objects in `blob_summary` */
+string execution_response( const string & thunk_hash, const vector<string> & outputs,
+                           const string & blob_summary = {} )
+{
+  gg::protobuf::ExecutionResponse response;
+  response.set_blob_summary( blob_summary );
+
+  gg::protobuf::ResponseItem & executed_thunk = *response.add_executed_thunks();
+  executed_thunk.set_thunk_hash( thunk_hash );
+
+  for ( const string & output_hash : outputs ) {
+    gg::protobuf::OutputItem & output = *executed_thunk.add_outputs();
+    output.set_tag( "output" );
+    output.set_hash( output_hash );
+  }
+
+  string body;
+  if ( not google::protobuf::util::MessageToJsonString( response, &body ).ok() ) {
+    throw runtime_error( "cannot create the response" );
+  }
+
+  return body;
+}
+
+/* a runner that answers every request with `body`, one connection at a
+   time */
+int serve( TCPSocket & listener, const string & body )
+{
+  const string response = "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: "
+                          + to_string( body.length() ) + "\r\n\r\n" + body;
+
+  while ( true ) {
+    TCPSocket connection = listener.accept();
+    HTTPRequestParser requests;
+
+    while ( requests.empty() and not connection.eof() ) {
+      requests.parse( connection.read() );
+    }
+
+    if ( not requests.empty() ) {
+      connection.write( response );
+    }
+  }
+}
+
+/* a runner that executes any of `thunk_hashes` into `output_hash`, one
+   connection at a time */
+int serve_thunks( TCPSocket & listener, const vector<string> & thunk_hashes,
+                  const string & output_hash, const string & blob_summary )
+{
+  while ( true ) {
+    TCPSocket connection = listener.accept();
+    HTTPRequestParser requests;
+
+    while ( requests.empty() and not connection.eof() ) {
+      requests.parse( connection.read() );
+    }
+
+    for ( const string & thunk_hash : thunk_hashes ) {
+      if ( not requests.empty() and
+           requests.front().body().find( thunk_hash ) != string::npos ) {
+        const string body = execution_response( thunk_hash, { output_hash }, blob_summary );
+        connection.write( "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: "
+                          + to_string( body.length() ) + "\r\n\r\n" + body );
+      }
+    }
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    setenv( "GG_STORAGE_URI", "s3://gg-test-bucket", true );
+
+    const Thunk thunk = make_thunk( "T" );
+    const string output_hash = gg::hash::compute( "output", ObjectType::Value );
+
+    TCPSocket listener, broken_listener;
+
+    for ( TCPSocket * socket : { &listener, &broken_listener } ) {
+      socket->set_reuseaddr();
+      socket->bind( { "127.0.0.1", 0 } );
+      socket->listen();
+    }
+
+    ChildProcess runner { "runner",
+      [&] () { return serve( listener, execution_response( thunk.hash(), { output_hash } ) ); } };
+
+    ChildProcess broken_runner { "broken-runner",
+      [&] () { return serve( broken_listener, execution_response( thunk.hash(), {} ) ); } };
+
+    /* two runners for the same thunks, one of which has their input */
+    const string input( 32 * 1024 * 1024, 'i' );
+    const string input_hash = gg::hash::compute( input, ObjectType::Value );
+    const vector<Thunk> input_thunks {
+      make_thunk( "W" ), make_thunk( "X", { { input_hash, "" } } ),
+      make_thunk( "Y", { { input_hash, "" } } ) };
+
+    vector<string> input_thunk_hashes;
+    for ( const Thunk & input_thunk : input_thunks ) {
+      input_thunk_hashes.push_back( input_thunk.hash() );
+    }
+
+    BloomFilter summary { 1024 };
+    summary.insert( input_hash );
+
+    const string warm_output = gg::hash::compute( "warm", ObjectType::Value );
+    const string cold_output = gg::hash::compute( "cold", ObjectType::Value );
+    TCPSocket warm_listener, cold_listener;
+
+    for ( TCPSocket * socket : { &warm_listener, &cold_listener } ) {
+      socket->set_reuseaddr();
+      socket->bind( { "127.0.0.1", 0 } );
+      socket->listen();
+    }
+
+    ChildProcess warm_runner { "warm-runner",
+      [&] () { return serve_thunks( warm_listener, input_thunk_hashes, warm_output,
+                                    summary.bytes() ); } };
+
+    ChildProcess cold_runner { "cold-runner",
+      [&] () { return serve_thunks( cold_listener, input_thunk_hashes, cold_output, {} ); } };
+
+    /* nothing listens here, and the connection is refused after a while */
+    uint16_t closed_port = 0;
+
+    {
+      TCPSocket socket;
+      socket.bind( { "127.0.0.1", 0 } );
+      closed_port = socket.local_address().ip_port().second;
+    }
+
+    /* and this one can't even be connected to */
+    const remote::RunnerServer unreachable { "255.255.255.255", 80, 0 };
+    const remote::RunnerServer refusing { "127.0.0.1", closed_port, 0 };
+    const remote::RunnerServer working { "127.0.0.1",
+                                         listener.local_address().ip_port().second, 1 };
+    const remote::RunnerServer no_outputs { "127.0.0.1",
+                                            broken_listener.local_address().ip_port().second, 0 };
+    const remote::RunnerServer warm { "127.0.0.1",
+                                      warm_listener.local_address().ip_port().second, 4 };
+    const remote::RunnerServer cold { "127.0.0.1",
+                                      cold_listener.local_address().ip_port().second, 4 };
+
+    vector<string> succeeded;
+    vector<pair<string, JobStatus>> failed;
+
+    auto success_callback =
+      [&succeeded] ( const string & hash, const string & output, const float )
+      { succeeded.push_back( hash + "=" + output ); };
+
+    auto failure_callback =
+      [&failed] ( const string & hash, const JobStatus status )
+      { failed.emplace_back( hash, status ); };
+
+    ExecutionLoop loop;
+
+    // A connection that fails right away is still reported by the loop
+    {
+      GGExecutionEngine engine { { unreachable, working }, success_callback,
+                                 failure_callback };
+
+      for ( size_t i = 1; i <= 3; i++ ) {
+        engine.force_thunk( make_thunk( "U" ), loop );
+
+        if ( failed.size() != i - 1 or engine.job_count() != 1 ) {
+          cerr << "the failure was reported too early" << endl;
+          return EXIT_FAILURE;
+        }
+
+        run_until( loop, [&] { return failed.size() == i; } );
+
+        if ( failed.back().second != JobStatus::SocketFailure or engine.job_count() != 0 ) {
+          cerr << "bad failure" << endl;
+          return EXIT_FAILURE;
+        }
+      }
+
+      /* that runner is drained now, so the job goes to the other one */
+      engine.force_thunk( thunk, loop );
+
+      if ( engine.has_capacity() ) {
+        cerr << "a drained runner was available" << endl;
+        return EXIT_FAILURE;
+      }
+
+      run_until( loop, [&] { return succeeded.size() == 1; } );
+
+      if ( succeeded.back() != thunk.hash() + "=" + output_hash or failed.size() != 3 or
+           engine.job_count() != 0 or not engine.has_capacity() ) {
+        cerr << "the working runner didn't run the job" << endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // With every runner drained, only one job at a time is sent to try them
+    {
+      failed.clear();
+
+      GGExecutionEngine engine { { unreachable, refusing }, success_callback,
+                                 failure_callback };
+
+      for ( size_t i = 1; i <= 6; i++ ) {
+        engine.force_thunk( make_thunk( "U" ), loop );
+        run_until( loop, [&] { return failed.size() == i; } );
+      }
+
+      if ( not engine.has_capacity() ) {
+        cerr << "the first runner to come back wasn't tried" << endl;
+        return EXIT_FAILURE;
+      }
+
+      engine.force_thunk( make_thunk( "U" ), loop );
+
+      if ( engine.has_capacity() or failed.size() != 6 ) {
+        cerr << "more than one job was sent to the drained runners" << endl;
+        return EXIT_FAILURE;
+      }
+
+      run_until( loop, [&] { return failed.size() == 7; } );
+
+      if ( engine.job_count() != 0 ) {
+        return EXIT_FAILURE;
+      }
+    }
+
+    // A successful response without any outputs is the runner's failure
+    {
+      failed.clear();
+
+      GGExecutionEngine engine { { no_outputs }, success_callback, failure_callback };
+      engine.force_thunk( thunk, loop );
+      run_until( loop, [&] { return failed.size() == 1; } );
+
+      if ( failed.back().second != JobStatus::OperationalFailure or succeeded.size() != 1 ) {
+        cerr << "a response without outputs was accepted" << endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // A runner that has the inputs gets the job, even if it's a little busier
+    {
+      succeeded.clear();
+      failed.clear();
+
+      GGExecutionEngine engine { { warm, cold }, success_callback, failure_callback };
+
+      /* the first job tells us what the warm runner has */
+      engine.force_thunk( input_thunks[ 0 ], loop );
+      run_until( loop, [&] { return succeeded.size() == 1; } );
+
+      /* the second one makes it busier than the other runner */
+      engine.force_thunk( input_thunks[ 1 ], loop );
+      engine.force_thunk( input_thunks[ 2 ], loop );
+      run_until( loop, [&] { return succeeded.size() + failed.size() == 3; } );
+
+      for ( size_t i = 0; i < input_thunks.size(); i++ ) {
+        if ( succeeded.at( i ) != input_thunks[ i ].hash() + "=" + warm_output ) {
+          cerr << "a job went to the runner without the inputs" << endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+
+#include "thunk/ggutils.hh"
+#include "util/digest.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/sha256.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+/* what gg::hash::file used to do: read the whole file into a string, then
+   run the Crypto++ pipeline over it */
+string read_and_hash( const string & filename )
+{
+  FileDescriptor file { CheckSystemCall( "open (" + filename + ")",
+                                         open( filename.c_str(), O_RDONLY ) ) };
+  string contents;
+  while ( not file.eof() ) { contents += file.read(); }
+
+  return digest::sha256( contents );
+}
+
+template<class Function>
+void benchmark( const string & name, const size_t bytes, const size_t rounds,
+                Function && function )
+{
+  const auto start = steady_clock::now();
+
+  for ( size_t i = 0; i < rounds; i++ ) {
+    function();
+  }
+
+  const double seconds = duration<double>( steady_clock::now() - start ).count();
+
+  cout << setw( 24 ) << left << name
+       << fixed << setprecision( 1 ) << setw( 10 ) << right
+       << ( 1000 * seconds / rounds ) << " ms"
+       << setw( 10 ) << ( bytes * rounds / seconds / ( 1 << 20 ) ) << " MiB/s" << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc < 2 or argc > 3 ) {
+      cerr << "Usage: " << argv[ 0 ] << " FILE [ROUNDS]" << endl;
+      return EXIT_FAILURE;
+    }
+
+    const string filename { argv[ 1 ] };
+    const size_t rounds = ( argc == 3 ) ? stoul( argv[ 2 ] ) : 5;
+    const size_t bytes = roost::file_size( filename );
+
+    benchmark( "read + crypto++", bytes, rounds,
+               [&] { read_and_hash( filename ); } );
+
+    benchmark( "gg::hash::file", bytes, rounds,
+               [&] { gg::hash::file( filename ); } );
+
+    if ( digest::SHA256::best_implementation() != digest::SHA256::Implementation::Portable ) {
+      FileDescriptor file { CheckSystemCall( "open (" + filename + ")",
+                                             open( filename.c_str(), O_RDONLY ) ) };
+      string contents;
+      while ( not file.eof() ) { contents += file.read(); }
+
+      benchmark( "sha256 (portable)", bytes, rounds,
+                 [&]
+                 {
+                   digest::SHA256 hasher { digest::SHA256::Implementation::Portable };
+                   hasher.update( contents );
+                   hasher.digest();
+                 } );
+
+      benchmark( "sha256 (sha-ni)", bytes, rounds,
+                 [&]
+                 {
+                   digest::SHA256 hasher { digest::SHA256::Implementation::SHANI };
+                   hasher.update( contents );
+                   hasher.digest();
+                 } );
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdlib>
+#include <thread>
+
+#include "execution/loop.hh"
+#include "execution/response.hh"
+#include "net/http_request.hh"
+#include "net/http_request_parser.hh"
+#include "net/socket.hh"
+#include "util/exception.hh"
+
+using namespace std;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+HTTPRequest make_request( const string & body )
+{
+  HTTPRequest request;
+  request.set_first_line( "POST /cgi-bin/gg/execute.cgi HTTP/1.1" );
+  request.add_header( HTTPHeader{ "Content-Length", to_string( body.size() ) } );
+  request.done_with_headers();
+  request.read_in_body( body );
+  return request;
+}
+
+string make_response( const string & body, const string & extra_headers = {} )
+{
+  return "HTTP/1.1 200 OK\r\n" + extra_headers + "Content-Length: "
+         + to_string( body.length() ) + "\r\n\r\n" + body;
+}
+
+/* reads `count` requests from the one connection it accepts, then answers
+   the first `answers` of them at once, echoing their bodies, followed by
+   `trailer` */
+int serve( TCPSocket & listener, const size_t count, const size_t answers,
+           const string & trailer )
+{
+  TCPSocket connection = listener.accept();
+  HTTPRequestParser requests;
+  vector<string> bodies;
+
+  while ( bodies.size() < count and not connection.eof() ) {
+    requests.parse( connection.read() );
+
+    while ( not requests.empty() ) {
+      bodies.push_back( requests.front().body() );
+      requests.pop();
+    }
+  }
+
+  string responses;
+
+  for ( size_t i = 0; i < answers and i < bodies.size(); i++ ) {
+    responses += make_response( bodies[ i ] );
+  }
+
+  connection.write( responses + trailer );
+
+  /* wait for the client to hang up */
+  while ( not connection.eof() ) {
+    connection.read();
+  }
+
+  return EXIT_SUCCESS;
+}
+
+struct Results
+{
+  vector<string> responses {};
+  vector<string> failures {};
+};
+
+/* sends the requests, pipelined on one connection, and runs the loop until
+   every one of them has been answered or has failed */
+Results send_requests( const Address & server, const vector<string> & bodies,
+                       const bool expect_close )
+{
+  ExecutionLoop loop;
+  Results results;
+
+  TCPSocket socket;
+  socket.set_blocking( false );
+
+  try {
+    socket.connect( server );
+  }
+  catch ( const unix_error & e ) {
+    if ( e.error_code() != EINPROGRESS ) {
+      throw;
+    }
+  }
+
+  const uint64_t connection = loop.open_connection( move( socket ) );
+
+  for ( const string & body : bodies ) {
+    loop.send_request( connection, "tag" + body,
+      [&results] ( const uint64_t, const string & tag, const HTTPResponse & response )
+      { results.responses.push_back( tag + ":" + response.body() ); },
+      [&results] ( const uint64_t, const string & tag )
+      { results.failures.push_back( tag ); },
+      make_request( body ) );
+  }
+
+  while ( results.responses.size() + results.failures.size() < bodies.size() or
+          ( expect_close and loop.connection_is_open( connection ) ) ) {
+    if ( loop.loop_once( 5000 ).result == Poller::Result::Type::Timeout ) {
+      throw runtime_error( "timed out" );
+    }
+  }
+
+  return results;
+}
+
+Results exchange( const vector<string> & bodies, const size_t answers,
+                  const string & trailer )
+{
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( { "127.0.0.1", 0 } );
+  listener.listen();
+
+  /* a thread, not a child process: the loop only expects children of its
+     own */
+  thread server { [&] () { serve( listener, bodies.size(), answers, trailer ); } };
+
+  /* the connection is closed once something's wrong with it */
+  Results results = send_requests( listener.local_address(), bodies, trailer.length() );
+  server.join();
+  return results;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    // Pipelined requests get their own responses, in order
+    const vector<string> bodies { "0", "1", "2", string( 100000, '3' ) };
+    Results results = exchange( bodies, bodies.size(), {} );
+
+    if ( results.failures.size() or results.responses.size() != bodies.size() ) {
+      cerr << "not every request was answered" << endl;
+      return EXIT_FAILURE;
+    }
+
+    for ( size_t i = 0; i < bodies.size(); i++ ) {
+      if ( results.responses[ i ] != "tag" + bodies[ i ] + ":" + bodies[ i ] ) {
+        cerr << "response " << i << " went to the wrong request" << endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // A response nobody asked for closes the connection, without an exception
+    results = exchange( { "0", "1" }, 2, make_response( "2" ) );
+
+    if ( results.responses != vector<string>{ "tag0:0", "tag1:1" } or results.failures.size() ) {
+      cerr << "the extra response got in the way" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // And so does garbage, failing the requests that are still waiting
+    results = exchange( { "0", "1", "2" }, 2, "garbage\r\n\r\n" );
+
+    if ( results.responses != vector<string>{ "tag0:0", "tag1:1" } or
+         results.failures != vector<string>{ "tag2" } ) {
+      cerr << "the responses before the garbage were lost" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // A response for anything but one thunk is a failure, not an exception
+    if ( ExecutionResponse::parse_message(
+           "{\"returnCode\":0,\"executedThunks\":[]}" ).status != JobStatus::OperationalFailure or
+         ExecutionResponse::parse_message(
+           "{\"returnCode\":0,\"executedThunks\":[{\"thunkHash\":\"A\"},{\"thunkHash\":\"B\"}]}"
+         ).status != JobStatus::OperationalFailure or
+         ExecutionResponse::parse_message( "not json" ).status != JobStatus::OperationalFailure ) {
+      cerr << "bad responses weren't operational failures" << endl;
+      return EXIT_FAILURE;
+    }
+
+    const ExecutionResponse response = ExecutionResponse::parse_message(
+      "{\"returnCode\":0,\"executedThunks\":[{\"thunkHash\":\"A\",\"outputs\":[{\"tag\":\"o\",\"hash\":\"B\"}]}]}" );
+
+    if ( response.status != JobStatus::Success or response.thunk_hash != "A" or
+         response.outputs.size() != 1 or response.outputs[ 0 ].hash != "B" ) {
+      cerr << "a good response was rejected" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
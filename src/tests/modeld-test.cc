@@ -0,0 +1,132 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <cstdlib>
+#include <poll.h>
+#include <unistd.h>
+
+#include "models/modeld.hh"
+#include "net/socket.hh"
+#include "util/child_process.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/util.hh"
+
+using namespace std;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+/* connects to the daemon, once it's listening */
+UnixSocket connect_to( const string & socket_path )
+{
+  for ( size_t attempt = 0; ; attempt++ ) {
+    try {
+      UnixSocket daemon;
+      daemon.connect( socket_path );
+      return daemon;
+    }
+    catch ( const unix_error & ) {
+      if ( attempt == 100 ) {
+        throw;
+      }
+
+      usleep( 50000 );
+    }
+  }
+}
+
+/* sends the request (or starts to), with `output` as its stdout */
+UnixSocket send_request( const string & socket_path, const vector<string> & args,
+                         FileDescriptor & output, const size_t length = string::npos )
+{
+  UnixSocket daemon = connect_to( socket_path );
+  daemon.send_with_fds( ModelRequest::for_this_process( args ).serialize().substr( 0, length ),
+                        { STDIN_FILENO, output.fd_num(), STDERR_FILENO } );
+  return daemon;
+}
+
+int wait_for_status( UnixSocket & daemon )
+{
+  pollfd reply { daemon.fd_num(), POLLIN, 0 };
+  CheckSystemCall( "poll", poll( &reply, 1, 10000 ) );
+
+  if ( not ( reply.revents & POLLIN ) ) {
+    throw runtime_error( "no reply from gg-modeld" );
+  }
+
+  return decode_status( daemon.read_exactly( 4 ) );
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const string modeld = safe_getenv( "abs_builddir" ) + "/../models/gg-modeld";
+    const string socket_path = safe_getenv_or( "TEST_TMPDIR", "/tmp" ) + "/modeld.socket";
+
+    ChildProcess daemon { "gg-modeld",
+      [&] () { return execl( modeld.c_str(), modeld.c_str(), socket_path.c_str(), nullptr ); } };
+
+    int pipe_fds[ 2 ];
+    CheckSystemCall( "pipe", pipe( pipe_fds ) );
+    FileDescriptor output_reader { pipe_fds[ 0 ] };
+    FileDescriptor output { pipe_fds[ 1 ] };
+
+    const ModelRequest hello = ModelRequest::for_this_process( { "/bin/sh", "-c", "echo hello" } );
+
+    // A client that hasn't sent all of its request doesn't hold up the others
+    UnixSocket slow_client = send_request( socket_path, hello.args, output, 10 );
+    UnixSocket client = send_request( socket_path, hello.args, output );
+
+    if ( wait_for_status( client ) != 0 or output_reader.read() != "hello\n" ) {
+      cerr << "the request wasn't run" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // and its request runs once the rest of it comes in
+    slow_client.write( hello.serialize().substr( 10 ) );
+
+    if ( wait_for_status( slow_client ) != 0 or output_reader.read() != "hello\n" ) {
+      cerr << "the slow request wasn't run" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // A client that goes away halfway through its request doesn't matter
+    send_request( socket_path, hello.args, output, 10 );
+    UnixSocket next_client = send_request( socket_path, hello.args, output );
+
+    if ( wait_for_status( next_client ) != 0 or output_reader.read() != "hello\n" ) {
+      cerr << "gg-modeld is gone" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // The programs it runs get the default SIGPIPE action, not the daemon's
+    UnixSocket pipe_client =
+      send_request( socket_path, { "/bin/sh", "-c", "kill -PIPE $$; exit 0" }, output );
+
+    if ( wait_for_status( pipe_client ) != 128 + SIGPIPE ) {
+      cerr << "SIGPIPE was still ignored" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
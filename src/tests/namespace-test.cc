@@ -0,0 +1,172 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/statvfs.h>
+
+#include "sandbox/namespaced_process.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
+#include "util/util.hh"
+
+using namespace std;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+/* the errno that opening `path` fails with, or 0 if it doesn't */
+int open_error( const string & path, const int flags )
+{
+  const int fd = open( path.c_str(), flags, 0600 );
+
+  if ( fd < 0 ) {
+    return errno;
+  }
+
+  close( fd );
+  return 0;
+}
+
+/* the errno that executing `path` fails with */
+int exec_error( const string & path )
+{
+  execl( path.c_str(), path.c_str(), nullptr );
+  return errno;
+}
+
+bool is_noexec( const string & path )
+{
+  struct statvfs info;
+  CheckSystemCall( "statvfs", statvfs( path.c_str(), &info ) );
+  return info.f_flag & ST_NOEXEC;
+}
+
+/* runs `procedure` in the sandbox; false if it failed */
+bool run( const string & name, const unordered_map<string, Permissions> & allowed_files,
+          const string & working_directory, function<int()> && procedure )
+{
+  NamespacedProcess process { name, allowed_files, working_directory, move( procedure ) };
+
+  try {
+    process.execute();
+    return true;
+  }
+  catch ( const exception & ) {
+    return false;
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    if ( not NamespacedProcess::supported() ) {
+      cerr << "namespaces aren't supported here, skipping" << endl;
+      return 77;
+    }
+
+    const string tmpdir = safe_getenv_or( "TEST_TMPDIR", "/tmp" );
+    const string input = tmpdir + "/input";
+    const string program = tmpdir + "/program";
+    const string secret = tmpdir + "/secret";
+
+    roost::atomic_create( "input", input );
+    roost::atomic_create( "#!/bin/sh\n", program, true, 0755 );
+    roost::atomic_create( "secret", secret );
+
+    const unordered_map<string, Permissions> allowed_files {
+      { input, { true, false, false } },
+      { program, { true, false, true } },
+    };
+
+    // Only the allowed files are there, with the permissions they're given
+    {
+      TempDirectory working_directory { tmpdir + "/work" };
+
+      const bool success = run( "permissions", allowed_files, working_directory.name(),
+        [&] () {
+          FileDescriptor file { CheckSystemCall( "open", open( input.c_str(), O_RDONLY ) ) };
+
+          if ( file.read() != "input" ) {
+            cerr << "couldn't read an allowed file" << endl;
+            return EXIT_FAILURE;
+          }
+
+          if ( open_error( input, O_WRONLY ) != EROFS or
+               open_error( "/new-file", O_WRONLY | O_CREAT ) != EROFS ) {
+            cerr << "wrote to a read-only file" << endl;
+            return EXIT_FAILURE;
+          }
+
+          if ( open_error( secret, O_RDONLY ) != ENOENT or
+               open_error( "/etc/passwd", O_RDONLY ) != ENOENT ) {
+            cerr << "a file that isn't allowed was there" << endl;
+            return EXIT_FAILURE;
+          }
+
+          if ( not is_noexec( input ) or is_noexec( program ) ) {
+            cerr << "bad executable permissions" << endl;
+            return EXIT_FAILURE;
+          }
+
+          if ( exec_error( input ) != EACCES ) {
+            cerr << "executed a file that isn't executable" << endl;
+            return EXIT_FAILURE;
+          }
+
+          /* the outputs go to the working directory */
+          FileDescriptor output { CheckSystemCall( "open",
+            open( "output", O_WRONLY | O_CREAT | O_EXCL, 0600 ) ) };
+          output.write( "output" );
+
+          return EXIT_SUCCESS;
+        } );
+
+      if ( not success ) {
+        cerr << "the sandboxed checks failed" << endl;
+        return EXIT_FAILURE;
+      }
+
+      if ( not roost::exists( working_directory.name() + "/output" ) ) {
+        cerr << "the output didn't make it out" << endl;
+        return EXIT_FAILURE;
+      }
+
+      roost::remove( working_directory.name() + "/output" );
+    }
+
+    // A process that fails is reported
+    {
+      TempDirectory working_directory { tmpdir + "/work" };
+
+      if ( run( "failure", allowed_files, working_directory.name(),
+                [] () { return EXIT_FAILURE; } ) ) {
+        cerr << "the failure wasn't reported" << endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,173 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <regex>
+#include <cstdlib>
+#include <fcntl.h>
+
+#include "thunk/ggutils.hh"
+#include "thunk/thunk.hh"
+#include "util/child_process.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
+#include "util/util.hh"
+
+using namespace std;
+using namespace gg;
+using namespace gg::thunk;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+string read_file( const roost::path & path )
+{
+  FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                         open( path.string().c_str(), O_RDONLY ) ) };
+  string contents;
+  while ( not file.eof() ) { contents += file.read(); }
+  return contents;
+}
+
+/* what the placeholders used to be expanded with */
+vector<string> expand_with_regex( vector<string> strings )
+{
+  const regex placeholder { R"X(@\{GGHASH:([a-zA-Z0-9_.]+)\})X" };
+
+  for ( string & str : strings ) {
+    str = regex_replace( str, placeholder, "<$1>" );
+  }
+
+  return strings;
+}
+
+bool expands_like_regex( const Function & function )
+{
+  vector<string> args, envars;
+  function.expand_placeholders(
+    [] ( const string & hash ) { return "<" + hash + ">"; }, args, envars );
+
+  return args == expand_with_regex( function.args() ) and
+         envars == expand_with_regex( function.envars() );
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const string A = gg::hash::compute( "A", ObjectType::Value );
+    const string B = gg::hash::compute( "B", ObjectType::Value );
+    const string C = gg::hash::compute( "C", ObjectType::Value );
+    const string T = gg::hash::compute( "T", ObjectType::Thunk );
+
+    Function function {
+      "FUNCTIONHASH",
+      {
+        "f", data_placeholder( A ),
+        "--x=" + data_placeholder( A ) + ":" + data_placeholder( B ) + ":" + data_placeholder( A ),
+        "@{GGHASH:}", "@{GGHASH:" + A, "@{GGHASH:a-b}", "@{GGHASH:@{GGHASH:" + B + "}",
+      },
+      { "PATH=" + data_placeholder( T ), "OTHER=x" }
+    };
+
+    // The index finds what the regex would, and nothing else
+    const vector<Function::Placeholder> & placeholders = function.placeholders();
+
+    if ( placeholders.size() != 6 or
+         function.placeholder_hash( placeholders[ 0 ] ) != A or
+         function.placeholder_hash( placeholders[ 2 ] ) != B or
+         function.placeholder_hash( placeholders[ 4 ] ) != B or
+         not placeholders[ 5 ].in_envars or
+         function.placeholder_hash( placeholders[ 5 ] ) != T ) {
+      cerr << "wrong placeholders" << endl;
+      return EXIT_FAILURE;
+    }
+
+    if ( not expands_like_regex( function ) ) {
+      cerr << "bad expansion" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // Replacing a hash updates the strings and the index, repeatedly
+    function.replace_placeholders( A, C );
+    function.replace_placeholders( C, B );
+    function.replace_placeholders( "NOSUCHHASH", A );
+
+    if ( function.args()[ 2 ] != "--x=" + data_placeholder( B ) + ":" +
+                                 data_placeholder( B ) + ":" + data_placeholder( B ) or
+         not expands_like_regex( function ) ) {
+      cerr << "bad replacement" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // Changing the args drops the index
+    function.args().push_back( data_placeholder( C ) );
+
+    if ( function.placeholders().size() != 7 or not expands_like_regex( function ) ) {
+      cerr << "stale index" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // Updating a thunk's data moves the dependency and its placeholders
+    const string script = "#!/bin/sh\necho \"$@\" \"$INPUT\" > \"$OUTPUT\"\n";
+    const string script_hash = gg::hash::compute( script, ObjectType::Value );
+    roost::atomic_create( script, paths::blob_path( script_hash ), true, 0755 );
+
+    const roost::path output = safe_getenv_or( "TEST_TMPDIR", "/tmp" ) + "/execute-output";
+
+    Thunk thunk {
+      { script_hash, { "f", data_placeholder( T ), "-o", data_placeholder( A ) + "/x" },
+        { "INPUT=" + data_placeholder( T ), "OUTPUT=" + output.string() } },
+      { }, { { T, "" } }, { { script_hash, "" } }, { "output" }
+    };
+
+    thunk.update_data( T, C );
+
+    if ( thunk.thunks().size() != 0 or thunk.values().count( C ) != 1 or
+         thunk.function().args()[ 1 ] != data_placeholder( C ) or
+         thunk.function().envars()[ 0 ] != "INPUT=" + data_placeholder( C ) ) {
+      cerr << "bad update_data" << endl;
+      return EXIT_FAILURE;
+    }
+
+    // Executing puts the blob paths in place of the placeholders
+    ChildProcess execution { "execute",
+      [&thunk] ()
+      {
+        /* the thunk gets exactly its own envars */
+        CheckSystemCall( "clearenv", clearenv() );
+        return thunk.execute();
+      } };
+
+    while ( not execution.terminated() ) {
+      execution.wait();
+    }
+
+    const string expected = paths::blob_path( C ).string() + " -o " +
+                            paths::blob_path( A ).string() + "/x " +
+                            paths::blob_path( C ).string() + "\n";
+
+    if ( execution.exit_status() != 0 or read_file( output ) != expected ) {
+      cerr << "bad execution" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -4,6 +4,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/syscall.h>
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -30,7 +31,7 @@ int main( int argc, char * argv[] )
       return EXIT_FAILURE;
     }
 
-    const size_t total_tests = 5;
+    const size_t total_tests = 8;
     size_t successful_tests = 0;
 
     /* test 1 */
@@ -149,6 +150,62 @@ int main( int argc, char * argv[] )
       successful_tests++;
     }
 
+    /* test 6: a forbidden syscall, which the filter has to trap */
+    SandboxedProcess sp_6(
+      "sp_6",
+      {},
+      []()
+      {
+        syscall( SYS_getpid );
+        return 0;
+      }
+    );
+
+    try {
+      sp_6.execute();
+    }
+    catch ( const SandboxViolation & e ) {
+      if ( string( e.what() ).find( "Forbidden syscall" ) == 0 ) {
+        successful_tests++;
+      }
+    }
+
+    /* test 7: a syscall that isn't in the syscall table */
+    SandboxedProcess sp_7(
+      "sp_7",
+      {},
+      []()
+      {
+        syscall( 1000 );
+        return 0;
+      }
+    );
+
+    try {
+      sp_7.execute();
+    }
+    catch ( const SandboxViolation & e ) {
+      if ( string( e.what() ).find( "Unknown syscall" ) == 0 ) {
+        successful_tests++;
+      }
+    }
+
+    /* test 8: the syscalls that aren't checked run freely */
+    SandboxedProcess sp_8(
+      "sp_8",
+      {},
+      []()
+      {
+        return ( getppid() > 0 and getuid() == geteuid() ) ? 0 : 1;
+      }
+    );
+
+    try {
+      sp_8.execute();
+      successful_tests++;
+    }
+    catch (...) {}
+
     return successful_tests != total_tests;
   }
   catch ( const exception &  e ) {
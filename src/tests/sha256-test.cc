@@ -0,0 +1,127 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "util/digest.hh"
+#include "util/sha256.hh"
+
+using namespace std;
+
+/* digest::sha256 returns base64url, without padding */
+string encode( const string & raw_digest )
+{
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                 "abcdefghijklmnopqrstuvwxyz"
+                                 "0123456789-_";
+  string output;
+  uint32_t bits = 0;
+  int bit_count = 0;
+
+  for ( const unsigned char c : raw_digest ) {
+    bits = ( bits << 8 ) | c;
+    bit_count += 8;
+
+    while ( bit_count >= 6 ) {
+      output += alphabet[ ( bits >> ( bit_count - 6 ) ) & 0x3f ];
+      bit_count -= 6;
+    }
+  }
+
+  if ( bit_count > 0 ) {
+    output += alphabet[ ( bits << ( 6 - bit_count ) ) & 0x3f ];
+  }
+
+  return output;
+}
+
+void test_implementation( const digest::SHA256::Implementation implementation,
+                          const string & name )
+{
+  mt19937 prng { 2017 };
+  uniform_int_distribution<int> byte_dist { 0, 255 };
+
+  for ( size_t length = 0; length < 1100; length += ( length < 200 ) ? 1 : 37 ) {
+    string input;
+    for ( size_t i = 0; i < length; i++ ) {
+      input += static_cast<char>( byte_dist( prng ) );
+    }
+
+    const string expected = digest::sha256( input );
+
+    /* all at once */
+    digest::SHA256 whole { implementation };
+    whole.update( input );
+
+    if ( encode( whole.digest() ) != expected ) {
+      throw runtime_error( name + ": wrong digest for length " + to_string( length ) );
+    }
+
+    /* in random pieces */
+    digest::SHA256 pieces { implementation };
+    uniform_int_distribution<size_t> piece_dist { 0, 150 };
+
+    for ( size_t offset = 0; offset < length; ) {
+      const size_t piece = min( piece_dist( prng ), length - offset );
+      pieces.update( input.data() + offset, piece );
+      offset += piece;
+    }
+
+    if ( encode( pieces.digest() ) != expected ) {
+      throw runtime_error( name + ": wrong incremental digest for length "
+                           + to_string( length ) );
+    }
+  }
+}
+
+void test_multi_buffer()
+{
+  mt19937 prng { 1234 };
+  uniform_int_distribution<size_t> length_dist { 0, 3000 };
+  uniform_int_distribution<int> byte_dist { 0, 255 };
+
+  /* messages of very different lengths, so the lanes get refilled at
+     different times */
+  vector<string> messages;
+  for ( size_t i = 0; i < 157; i++ ) {
+    string message;
+    const size_t length = ( i % 10 == 0 ) ? i : length_dist( prng );
+
+    for ( size_t j = 0; j < length; j++ ) {
+      message += static_cast<char>( byte_dist( prng ) );
+    }
+
+    messages.push_back( move( message ) );
+  }
+
+  const vector<string> digests = digest::SHA256::digest_many( messages, true );
+
+  for ( size_t i = 0; i < messages.size(); i++ ) {
+    if ( encode( digests[ i ] ) != digest::sha256( messages[ i ] ) ) {
+      throw runtime_error( "multi-buffer: wrong digest for message " + to_string( i ) );
+    }
+  }
+}
+
+int main()
+{
+  test_implementation( digest::SHA256::Implementation::Portable, "portable" );
+
+  if ( digest::SHA256::is_supported( digest::SHA256::Implementation::SHANI ) ) {
+    test_implementation( digest::SHA256::Implementation::SHANI, "sha-ni" );
+  }
+  else {
+    cerr << "SHA extensions are not available, skipping." << endl;
+  }
+
+  if ( digest::SHA256::multi_buffer_supported() ) {
+    test_multi_buffer();
+  }
+  else {
+    cerr << "AVX2 is not available, skipping the multi-buffer test." << endl;
+  }
+
+  return 0;
+}
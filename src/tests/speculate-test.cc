@@ -0,0 +1,134 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <thread>
+
+#include "execution/reductor.hh"
+#include "execution/response.hh"
+#include "net/http_request_parser.hh"
+#include "net/socket.hh"
+#include "thunk/ggutils.hh"
+#include "thunk/thunk.hh"
+#include "thunk/thunk_writer.hh"
+#include "util/exception.hh"
+#include "util/util.hh"
+
+using namespace std;
+using namespace gg;
+using namespace gg::thunk;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+/* a runner that answers `count` requests, one connection each: the one for
+   `working_hash` produces `output_hash`, and the rest fail to execute */
+void serve( TCPSocket & listener, const size_t count,
+            const string & working_hash, const string & output_hash )
+{
+  for ( size_t i = 0; i < count; i++ ) {
+    TCPSocket connection = listener.accept();
+    HTTPRequestParser requests;
+
+    while ( requests.empty() and not connection.eof() ) {
+      requests.parse( connection.read() );
+    }
+
+    if ( requests.empty() ) {
+      continue;
+    }
+
+    string body = "{\"returnCode\":"
+                  + to_string( static_cast<int>( JobStatus::ExecutionFailure ) ) + "}";
+
+    if ( requests.front().body().find( working_hash ) != string::npos ) {
+      body = "{\"returnCode\":0,\"executedThunks\":[{\"thunkHash\":\"" + working_hash
+             + "\",\"outputs\":[{\"tag\":\"output\",\"hash\":\"" + output_hash + "\"}]}]}";
+    }
+
+    connection.write( "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: "
+                      + to_string( body.length() ) + "\r\n\r\n" + body );
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    TCPSocket listener;
+    listener.set_reuseaddr();
+    listener.bind( { "127.0.0.1", 0 } );
+    listener.listen();
+
+    setenv( "GG_STORAGE_URI", "s3://gg-test-bucket", true );
+    setenv( "GG_RUNNER_SERVER",
+            ( "127.0.0.1:" + to_string( listener.local_address().ip_port().second ) ).c_str(),
+            true );
+
+    const string output_hash = gg::hash::compute( "output", ObjectType::Value );
+
+    auto make_thunk =
+      [] ( const string & name, vector<Thunk::DataItem> && thunks )
+      {
+        const string function_hash = gg::hash::compute( name, ObjectType::Value );
+        return Thunk { { function_hash, { name }, {} }, {}, move( thunks ),
+                       { { function_hash, "" } }, { "output" } };
+      };
+
+    const string failing = ThunkWriter::write( make_thunk( "fails", {} ) );
+    const string dependent = ThunkWriter::write( make_thunk( "depends", { { failing, "in" } } ) );
+    const string working = ThunkWriter::write( make_thunk( "works", {} ) );
+
+    const string socket_path = safe_getenv_or( "TEST_TMPDIR", "/tmp" ) + "/speculate";
+    UnixSocket notifications { SOCK_DGRAM };
+    notifications.bind( socket_path );
+
+    /* what gg-infer sends, as it writes the thunks */
+    setenv( "GG_SPECULATE_SOCKET", socket_path.c_str(), true );
+    gg::speculation::notify( dependent );
+    gg::speculation::notify( working );
+    gg::speculation::finish( socket_path );
+
+    /* each thunk is only sent out once: the failing one isn't retried */
+    thread runner { [&] () { serve( listener, 2, working, output_hash ); } };
+
+    // A thunk that fails to execute doesn't stop the speculation
+    {
+      Reductor reductor { {}, 2, { ExecutionEnvironment::GG_RUNNER }, nullptr };
+      reductor.speculate( notifications );
+    }
+
+    runner.join();
+
+    if ( gg::cache::check( failing ).initialized() or
+         gg::cache::check( dependent ).initialized() ) {
+      cerr << "the failing thunk was reduced" << endl;
+      return EXIT_FAILURE;
+    }
+
+    const Optional<gg::cache::ReductionResult> result = gg::cache::check( working );
+
+    if ( not result.initialized() or result->hash != output_hash ) {
+      cerr << "the other thunk wasn't reduced" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -5,7 +5,10 @@
 #include <iostream>
 #include <google/protobuf/text_format.h>
 
+#include "thunk/bundle.hh"
+#include "thunk/ggutils.hh"
 #include "thunk/thunk_reader.hh"
+#include "thunk/thunk_view.hh"
 #include "thunk/thunk_writer.hh"
 #include "thunk/thunk.hh"
 #include "util/exception.hh"
@@ -13,6 +16,7 @@
 
 using namespace std;
 using namespace google::protobuf;
+using namespace gg;
 using namespace gg::thunk;
 
 void usage( const char * argv0 )
@@ -56,13 +60,69 @@ int main( int argc, char * argv[] )
     // Now reading it back
     Thunk thunk { move( ThunkReader::read( temp_file.name() ) ) };
 
-    if ( thunk == original_thunk ) {
-      return EXIT_SUCCESS;
+    if ( thunk != original_thunk ) {
+      return EXIT_FAILURE;
     }
-    else {
+
+    // With real hashes, the thunk is written in the binary encoding
+    auto hash_of =
+      [] ( const string & str, const ObjectType type )
+      {
+        return gg::hash::compute( str, type );
+      };
+
+    Thunk binary_thunk {
+      {
+        hash_of( "f", ObjectType::Value ), { "f", "arg1", "arg1", "" },
+        { "envar1=A" },
+      },
+      {
+        { hash_of( "A", ObjectType::Value ), "A" }, { hash_of( "B", ObjectType::Value ), "" },
+        { hash_of( "A", ObjectType::Value ), "C" }, { hash_of( "T", ObjectType::Thunk ), "A" },
+      },
+      {
+        { hash_of( "f", ObjectType::Value ), "f" },
+      },
+      {
+        "output1", "output2"
+      }
+    };
+
+    const string binary_contents = ThunkWriter::serialize( binary_thunk );
+
+    if ( not ThunkView::is_binary( binary_contents.data(), binary_contents.size() ) or
+         ThunkWriter::serialize( ThunkReader::parse( binary_contents ) ) != binary_contents or
+         ThunkReader::parse( binary_contents ) != binary_thunk or
+         ThunkReader::parse( binary_contents ).hash() != binary_thunk.hash() ) {
+      return EXIT_FAILURE;
+    }
+
+    const ThunkView view { binary_contents.data(), binary_contents.size() };
+
+    if ( view.function_hash() != binary_thunk.function().hash() or
+         view.count( ThunkView::List::Values ) != 3 or
+         view.text( ThunkView::List::Args, 2 ).str() != "arg1" or
+         view.hash( ThunkView::List::Thunks, 0 ) != hash_of( "T", ObjectType::Thunk ) ) {
       return EXIT_FAILURE;
     }
 
+    // A bundle doesn't depend on the order its files were added in
+    FileBundle bundle;
+    bundle.add( "include/b.h", hash_of( "B", ObjectType::Value ) );
+    bundle.add( "include/a.h", hash_of( "A", ObjectType::Value ) );
+
+    FileBundle same_bundle;
+    same_bundle.add( "include/a.h", hash_of( "A", ObjectType::Value ) );
+    same_bundle.add( "include/b.h", hash_of( "B", ObjectType::Value ) );
+
+    if ( bundle.serialize() != same_bundle.serialize() or
+         FileBundle::parse( bundle.serialize() ).entries() != bundle.entries() or
+         bundle.entries().begin()->first != "include/a.h" ) {
+      return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+
   }
   catch ( const exception &  e ) {
     print_exception( argv[ 0 ], e );
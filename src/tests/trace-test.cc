@@ -0,0 +1,146 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace/tracer.hh"
+#include "util/exception.hh"
+#include "util/util.hh"
+
+using namespace std;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+struct Open
+{
+  long syscall_no;
+  string path;
+  int flags;
+  long retval;
+};
+
+/* what the traced-dependencies pass relies on: opens show up with their
+   paths and flags (libcpp's are O_RDONLY | O_NOCTTY), whether they're made
+   with open or openat, and nothing else does when only those are traced.
+   and a path that the tracer changes is what the tracee opens, and what
+   the tracer reads back. */
+vector<Open> trace_opens( const string & path, const vector<long> & traced_syscalls )
+{
+  vector<Open> opens;
+  size_t other_syscalls = 0;
+
+  Tracer tracer {
+    "tracee",
+    [&path] ()
+    {
+      CheckSystemCall( "close", close( open( path.c_str(), O_RDONLY | O_NOCTTY ) ) );
+      CheckSystemCall( "close", close( syscall( SYS_open, path.c_str(), O_RDONLY ) ) );
+      open( ( path + ".missing" ).c_str(), O_RDONLY | O_NOCTTY );
+
+      /* only there if the tracer points the open somewhere else */
+      CheckSystemCall( "close", close( CheckSystemCall( "open",
+        open( ( path + ".redirected" ).c_str(), O_RDONLY ) ) ) );
+
+      /* newer than any syscall table */
+      syscall( 1000 );
+
+      return 0;
+    },
+    [&path] ( TracedThreadInfo & tcb, TracerFlock & )
+    {
+      SystemCallInvocation & invocation = *tcb.syscall_invocation;
+
+      if ( invocation.syscall_no() != SYS_open and invocation.syscall_no() != SYS_openat ) {
+        return;
+      }
+
+      invocation.fetch_arguments();
+
+      const size_t path_index = ( invocation.syscall_no() == SYS_openat ) ? 1 : 0;
+
+      if ( invocation.arguments()->at( path_index ).value<string>() == path + ".redirected" ) {
+        invocation.set_argument( path_index, path );
+
+        /* the arguments are read again, as they are now */
+        invocation.fetch_arguments();
+      }
+    },
+    [&] ( const TracedThreadInfo & tcb )
+    {
+      const SystemCallInvocation & invocation = *tcb.syscall_invocation;
+
+      if ( invocation.syscall_no() != SYS_open and invocation.syscall_no() != SYS_openat ) {
+        other_syscalls++;
+        return;
+      }
+
+      const size_t path_index = ( invocation.syscall_no() == SYS_openat ) ? 1 : 0;
+      const vector<Argument> & arguments = *invocation.arguments();
+      const string opened = arguments.at( path_index ).value<string>();
+
+      if ( opened.compare( 0, path.length(), path ) == 0 ) {
+        opens.push_back( { invocation.syscall_no(), opened,
+                           arguments.at( path_index + 1 ).value<int>(),
+                           *invocation.retval() } );
+      }
+    },
+    [](){},
+    traced_syscalls
+  };
+
+  tracer.loop_until_done();
+
+  if ( traced_syscalls.size() and other_syscalls > 1 /* the unknown one */ ) {
+    throw runtime_error( "untraced syscalls were reported" );
+  }
+
+  return opens;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const string path = safe_getenv_or( "TEST_TMPDIR", "/tmp" ) + "/traced-file";
+    CheckSystemCall( "close", close( CheckSystemCall( "open",
+      open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600 ) ) ) );
+
+    for ( const vector<long> & traced_syscalls : { vector<long> {},
+                                                   vector<long> { SYS_open, SYS_openat } } ) {
+      const vector<Open> opens = trace_opens( path, traced_syscalls );
+
+      if ( opens.size() != 4 or
+           opens[ 0 ].path != path or opens[ 0 ].retval < 0 or
+           ( opens[ 0 ].flags & ( O_ACCMODE | O_NOCTTY ) ) != ( O_RDONLY | O_NOCTTY ) or
+           opens[ 1 ].syscall_no != SYS_open or opens[ 1 ].path != path or
+           opens[ 1 ].retval < 0 or ( opens[ 1 ].flags & O_NOCTTY ) or
+           opens[ 2 ].path != path + ".missing" or opens[ 2 ].retval != -ENOENT or
+           opens[ 3 ].path != path or opens[ 3 ].retval < 0 ) {
+        cerr << "the opens weren't traced right, tracing "
+             << ( traced_syscalls.empty() ? "everything" : "only opens" ) << endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <string>
+#include <set>
+#include <stdexcept>
+#include <poll.h>
+
+#include "storage/transfer_agent.hh"
+#include "util/exception.hh"
+
+using namespace std;
+using namespace storage;
+
+void usage( const char * argv0 )
+{
+  cerr << argv0 << endl;
+}
+
+/* downloads "good" objects, throws on "broken" ones, and quietly skips
+   "lost" ones */
+class FlakyBackend : public StorageBackend
+{
+public:
+  void put( const vector<PutRequest> & requests,
+            const PutCallback & success_callback ) override
+  {
+    for ( const PutRequest & request : requests ) {
+      success_callback( request );
+    }
+  }
+
+  void get( const vector<GetRequest> & requests,
+            const GetCallback & success_callback ) override
+  {
+    for ( const GetRequest & request : requests ) {
+      if ( request.object_key.compare( 0, 6, "broken" ) == 0 ) {
+        throw runtime_error( "cannot get " + request.object_key );
+      }
+      else if ( request.object_key.compare( 0, 4, "lost" ) != 0 ) {
+        success_callback( request );
+      }
+    }
+  }
+};
+
+/* waits for the agent and runs its callbacks until nothing is pending;
+   returns the number of errors */
+size_t drain( TransferAgent & agent )
+{
+  size_t errors = 0;
+
+  while ( agent.pending() ) {
+    pollfd notification { agent.fd().fd_num(), POLLIN, 0 };
+    CheckSystemCall( "poll", poll( &notification, 1, 10000 ) );
+
+    if ( not ( notification.revents & POLLIN ) ) {
+      throw runtime_error( "timed out with " + to_string( agent.pending() ) +
+                           " transfers pending" );
+    }
+
+    try {
+      agent.process_completions();
+    }
+    catch ( const runtime_error & ) {
+      errors++;
+    }
+  }
+
+  return errors;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc != 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    FlakyBackend backend;
+
+    /* everything goes through */
+    {
+      TransferAgent agent { backend, 2, 4 };
+      set<string> done;
+
+      for ( size_t i = 0; i < 10; i++ ) {
+        const string key = "good" + to_string( i );
+        agent.upload( { "/dev/null", key, {} },
+                      [&done] ( const string & object_key ) { done.insert( object_key ); } );
+      }
+
+      if ( drain( agent ) != 0 or done.size() != 10 ) {
+        cerr << "uploads didn't all complete" << endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    /* failed transfers, thrown or not, are no longer pending, and their
+       callbacks never run; the others' still do */
+    {
+      TransferAgent agent { backend, 1, 2 };
+      set<string> done;
+
+      for ( const string key : { "good0", "broken0", "good1", "lost0", "good2" } ) {
+        agent.download( { key, "/dev/null" },
+                        [&done] ( const string & object_key ) { done.insert( object_key ); } );
+      }
+
+      if ( drain( agent ) == 0 ) {
+        cerr << "the failures weren't reported" << endl;
+        return EXIT_FAILURE;
+      }
+
+      if ( done.count( "broken0" ) or done.count( "lost0" ) or not done.count( "good2" ) ) {
+        cerr << "wrong callbacks" << endl;
+        return EXIT_FAILURE;
+      }
+
+      /* each failure is only reported once */
+      agent.download( { "good3", "/dev/null" },
+                      [&done] ( const string & object_key ) { done.insert( object_key ); } );
+
+      if ( drain( agent ) != 0 or not done.count( "good3" ) ) {
+        cerr << "a failure was reported again" << endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
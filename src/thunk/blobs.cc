@@ -0,0 +1,604 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "blobs.hh"
+
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ggutils.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/mmap.hh"
+#include "util/tokenize.hh"
+
+using namespace std;
+
+namespace {
+
+  /* a pack is a pair of files: `N.pack` holds the objects back to back, and
+     `N.idx` is an array of these entries, one per object. both files are
+     only ever appended to, under a lock on the pack file. */
+  struct IndexEntry
+  {
+    char hash[ gg::hash::length ];
+    uint32_t mode;
+    uint64_t offset;
+  };
+
+  static_assert( sizeof( IndexEntry ) == 64, "unexpected index entry size" );
+
+  /* when the last pack grows past this size, a new one is started */
+  constexpr off_t MAX_PACK_SIZE = 256 * 1024 * 1024;
+
+  off_t file_size( const FileDescriptor & fd )
+  {
+    struct stat info;
+    CheckSystemCall( "fstat", fstat( fd.fd_num(), &info ) );
+    return info.st_size;
+  }
+
+  bool is_unlinked( const FileDescriptor & fd )
+  {
+    struct stat info;
+    CheckSystemCall( "fstat", fstat( fd.fd_num(), &info ) );
+    return info.st_nlink == 0;
+  }
+
+  /* records that the file was just used. the time is set explicitly, so
+     this works on file systems mounted with noatime, too. failures are
+     ignored, as the file might have been evicted in the meantime. */
+  void touch( const roost::path & path )
+  {
+    const timespec times[ 2 ] = { { 0, UTIME_NOW }, { 0, UTIME_OMIT } };
+    utimensat( AT_FDCWD, path.string().c_str(), times, 0 );
+  }
+
+  /* pins are created and objects are evicted under a lock on the pins
+     directory, so that an object can't be evicted between the time an
+     evictor has collected the pins and a new pin for it appears */
+  FileDescriptor lock_pins()
+  {
+    FileDescriptor pins { CheckSystemCall( "open (" + gg::paths::pins().string() + ")",
+                                           open( gg::paths::pins().string().c_str(),
+                                                 O_RDONLY | O_DIRECTORY | O_CLOEXEC ) ) };
+    pins.block_for_exclusive_lock();
+    return pins;
+  }
+
+  /* collects the objects that are pinned by live processes, and removes the
+     pins that were left behind by dead ones */
+  unordered_set<string> pinned_objects()
+  {
+    unordered_set<string> pinned;
+
+    for ( const string & name : roost::list_directory( gg::paths::pins() ) ) {
+      if ( name == "." or name == ".." ) {
+        continue;
+      }
+
+      const roost::path path = gg::paths::pins() / name;
+      const int fd_num = open( path.string().c_str(), O_RDONLY );
+
+      if ( fd_num < 0 ) {
+        /* somebody else removed it */
+        continue;
+      }
+
+      FileDescriptor pin { fd_num };
+
+      /* the owner holds the lock for as long as it's alive. (it also lets go
+         of it right after removing its pin, so this can find it gone.) */
+      if ( pin.try_exclusive_lock() ) {
+        unlink( path.string().c_str() );
+        continue;
+      }
+
+      for ( string & hash : split( pin.read_exactly( file_size( pin ) ), "\n" ) ) {
+        if ( hash.length() ) {
+          pinned.emplace( move( hash ) );
+        }
+      }
+    }
+
+    return pinned;
+  }
+
+  class PackStore
+  {
+  private:
+    struct Pack
+    {
+      FileDescriptor data;
+      FileDescriptor index;
+      size_t indexed_entries { 0 };
+
+      Pack( FileDescriptor && data_fd, FileDescriptor && index_fd )
+        : data( move( data_fd ) ), index( move( index_fd ) )
+      {}
+    };
+
+    struct Location
+    {
+      size_t pack;
+      uint64_t offset;
+      uint32_t mode;
+    };
+
+    mutex mutex_ {};
+    vector<unique_ptr<Pack>> packs_ {};
+    unordered_map<string, Location> locations_ {};
+
+    roost::path data_path( const size_t pack ) const
+    {
+      return gg::paths::packs() / ( to_string( pack ) + ".pack" );
+    }
+
+    roost::path index_path( const size_t pack ) const
+    {
+      return gg::paths::packs() / ( to_string( pack ) + ".idx" );
+    }
+
+    /* opens the next pack; returns false if it doesn't exist (and
+       `create` isn't set) */
+    bool open_next( const bool create )
+    {
+      const size_t number = packs_.size();
+      const string index_name = index_path( number ).string();
+
+      if ( not create and not roost::exists( index_name ) ) {
+        return false;
+      }
+
+      const int flags = O_RDWR | O_APPEND | ( create ? O_CREAT : 0 );
+
+      /* the data file is created first, so that readers who see the index
+         can always open it */
+      FileDescriptor data { CheckSystemCall( "open (" + data_path( number ).string() + ")",
+                                             open( data_path( number ).string().c_str(),
+                                                   flags, 0644 ) ) };
+      FileDescriptor index { CheckSystemCall( "open (" + index_name + ")",
+                                              open( index_name.c_str(), flags, 0644 ) ) };
+
+      packs_.emplace_back( new Pack { move( data ), move( index ) } );
+      return true;
+    }
+
+    /* picks up the objects added since the last refresh, by us or by
+       anybody else */
+    void refresh()
+    {
+      if ( packs_.empty() and not open_next( false ) ) {
+        return;
+      }
+
+      for ( size_t number = 0; number < packs_.size(); number++ ) {
+        Pack & pack = *packs_[ number ];
+        const size_t entry_count = file_size( pack.index ) / sizeof( IndexEntry );
+
+        if ( entry_count > pack.indexed_entries ) {
+          const MappedFile index { pack.index, entry_count * sizeof( IndexEntry ) };
+          const IndexEntry * entries = reinterpret_cast<const IndexEntry *>( index.data() );
+
+          for ( size_t i = pack.indexed_entries; i < entry_count; i++ ) {
+            locations_.emplace( string { entries[ i ].hash, gg::hash::length },
+                                Location { number, entries[ i ].offset, entries[ i ].mode } );
+          }
+
+          pack.indexed_entries = entry_count;
+        }
+
+        /* a writer has moved on to a new pack */
+        if ( number == packs_.size() - 1 ) {
+          open_next( false );
+        }
+      }
+    }
+
+    Optional<Location> find( const string & hash )
+    {
+      auto location = locations_.find( hash );
+
+      if ( location == locations_.end() ) {
+        refresh();
+        location = locations_.find( hash );
+      }
+
+      if ( location == locations_.end() ) {
+        return {};
+      }
+
+      return { true, location->second };
+    }
+
+  public:
+    bool contains( const string & hash )
+    {
+      unique_lock<mutex> lock { mutex_ };
+      return find( hash ).initialized();
+    }
+
+    Optional<string> read( const string & hash, uint32_t * mode = nullptr )
+    {
+      unique_lock<mutex> lock { mutex_ };
+      const Optional<Location> location = find( hash );
+
+      if ( not location.initialized() ) {
+        return {};
+      }
+
+      string contents( gg::hash::size( hash ), '\0' );
+      const int fd = packs_.at( location->pack )->data.fd_num();
+
+      size_t done = 0;
+      while ( done < contents.size() ) {
+        const ssize_t bytes_read = CheckSystemCall( "pread",
+          pread( fd, &contents[ done ], contents.size() - done, location->offset + done ) );
+
+        if ( bytes_read == 0 ) {
+          throw runtime_error( "pack is truncated: " + hash );
+        }
+
+        done += bytes_read;
+      }
+
+      if ( mode != nullptr ) {
+        *mode = location->mode;
+      }
+
+      return { true, move( contents ) };
+    }
+
+    void append( const string & hash, const string & contents, const uint32_t mode )
+    {
+      if ( hash.length() != gg::hash::length ) {
+        throw runtime_error( "cannot pack object: " + hash );
+      }
+
+      unique_lock<mutex> lock { mutex_ };
+
+      refresh();
+
+      if ( packs_.empty() ) {
+        open_next( true );
+      }
+
+      while ( true ) {
+        Pack & pack = *packs_.back();
+        pack.data.block_for_exclusive_lock();
+
+        /* the packs were evicted; start over with new ones */
+        if ( is_unlinked( pack.data ) ) {
+          pack.data.release_lock();
+          packs_.clear();
+          locations_.clear();
+          open_next( true );
+          continue;
+        }
+
+        /* somebody might have added it, or started a new pack, while we
+           were waiting for the lock */
+        refresh();
+
+        if ( locations_.count( hash ) ) {
+          pack.data.release_lock();
+          return;
+        }
+
+        if ( &pack != packs_.back().get() ) {
+          pack.data.release_lock();
+          continue;
+        }
+
+        const off_t offset = file_size( pack.data );
+
+        if ( offset + static_cast<off_t>( contents.size() ) > MAX_PACK_SIZE and offset > 0 ) {
+          open_next( true );
+          pack.data.release_lock();
+          continue;
+        }
+
+        if ( contents.size() ) {
+          pack.data.write( contents );
+        }
+
+        IndexEntry entry;
+        memcpy( entry.hash, hash.data(), gg::hash::length );
+        entry.mode = mode;
+        entry.offset = offset;
+
+        /* the object becomes visible once its index entry is written */
+        pack.index.write( string { reinterpret_cast<const char *>( &entry ), sizeof( entry ) } );
+        pack.data.release_lock();
+        return;
+      }
+    }
+
+    /* the total size of the packs, with their indices */
+    uint64_t size()
+    {
+      unique_lock<mutex> lock { mutex_ };
+
+      refresh();
+
+      uint64_t total = 0;
+      for ( const auto & pack : packs_ ) {
+        total += file_size( pack->data ) + file_size( pack->index );
+      }
+
+      return total;
+    }
+
+    /* forgets about the packs and deletes them. objects that were already
+       found can still be read, since the files stay open. */
+    void clear()
+    {
+      unique_lock<mutex> lock { mutex_ };
+
+      refresh();
+
+      /* taking the locks waits for any appends in progress; writers that
+         come later see that the pack is gone */
+      for ( size_t number = 0; number < packs_.size(); number++ ) {
+        packs_[ number ]->data.block_for_exclusive_lock();
+        roost::remove( data_path( number ) );
+        roost::remove( index_path( number ) );
+        packs_[ number ]->data.release_lock();
+      }
+
+      packs_.clear();
+      locations_.clear();
+    }
+  };
+
+  PackStore & pack_store()
+  {
+    static PackStore store;
+    return store;
+  }
+
+  bool is_packable( const string & hash )
+  {
+    return hash.length() == gg::hash::length and
+           gg::hash::size( hash ) <= gg::blobs::PACKED_OBJECT_SIZE;
+  }
+
+  /* the blobs directory also has the temporary files that objects are
+     written to (`<hash>.XXXXXX`) before they're renamed into place, so only
+     the files that are named after a hash are objects */
+  bool is_object_name( const string & name )
+  {
+    if ( gg::hash::to_binary( name ).initialized() ) {
+      return true;
+    }
+
+    /* objects of 4 GiB or more have a longer size */
+    const size_t digest_end = gg::hash::length - 8;
+
+    return name.length() > gg::hash::length and name.length() <= digest_end + 16 and
+           gg::hash::to_binary( name.substr( 0, digest_end ) + "00000000" ).initialized() and
+           name.find_first_not_of( "0123456789abcdef", digest_end ) == string::npos;
+  }
+
+}
+
+namespace gg {
+  namespace blobs {
+    bool exists( const string & hash )
+    {
+      return roost::exists( paths::blob_path( hash ) ) or
+             ( is_packable( hash ) and pack_store().contains( hash ) );
+    }
+
+    string read( const string & hash )
+    {
+      if ( is_packable( hash ) ) {
+        Optional<string> contents = pack_store().read( hash );
+
+        if ( contents.initialized() ) {
+          return move( *contents );
+        }
+      }
+
+      const roost::path path = paths::blob_path( hash );
+      FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                             open( path.string().c_str(), O_RDONLY ) ) };
+      touch( path );
+      return file.read_exactly( file_size( file ) );
+    }
+
+    void write( const string & hash, const string & contents )
+    {
+      if ( is_packable( hash ) ) {
+        pack_store().append( hash, contents, 0 );
+      }
+      else if ( not roost::exists( paths::blob_path( hash ) ) ) {
+        roost::atomic_create( contents, paths::blob_path( hash ) );
+      }
+    }
+
+    void insert( const string & hash, const roost::path & source, const bool consume )
+    {
+      if ( is_packable( hash ) ) {
+        if ( not pack_store().contains( hash ) ) {
+          FileDescriptor file { CheckSystemCall( "open (" + source.string() + ")",
+                                                 open( source.string().c_str(), O_RDONLY ) ) };
+          struct stat info;
+          CheckSystemCall( "fstat", fstat( file.fd_num(), &info ) );
+
+          pack_store().append( hash, file.read_exactly( info.st_size ),
+                               info.st_mode & 07777 );
+        }
+
+        if ( consume ) {
+          roost::remove( source );
+        }
+      }
+      else if ( roost::exists( paths::blob_path( hash ) ) ) {
+        if ( consume ) {
+          roost::remove( source );
+        }
+      }
+      else if ( consume ) {
+        roost::move_file( source, paths::blob_path( hash ) );
+      }
+      else {
+        roost::copy_then_rename( source, paths::blob_path( hash ) );
+      }
+    }
+
+    roost::path materialize( const string & hash )
+    {
+      const roost::path path = paths::blob_path( hash );
+
+      if ( roost::exists( path ) ) {
+        touch( path );
+        return path;
+      }
+
+      if ( not is_packable( hash ) ) {
+        return path;
+      }
+
+      uint32_t mode = 0;
+      const Optional<string> contents = pack_store().read( hash, &mode );
+
+      if ( contents.initialized() ) {
+        roost::atomic_create( *contents, path, mode != 0, mode );
+      }
+
+      return path;
+    }
+
+    void retain_only( const unordered_set<string> & keep )
+    {
+      for ( const string & hash : keep ) {
+        materialize( hash );
+      }
+
+      pack_store().clear();
+
+      for ( const string & blob : roost::list_directory( paths::blobs() ) ) {
+        const roost::path path = paths::blob_path( blob );
+
+        if ( ( not roost::is_directory( path ) ) and keep.count( blob ) == 0 ) {
+          roost::remove( path );
+        }
+      }
+    }
+
+    Pin::Pin( const unordered_set<string> & hashes )
+      : file_( ( paths::scratch() / "pin" ).string() )
+    {
+      file_.fd().block_for_exclusive_lock();
+
+      string contents;
+      for ( const string & hash : hashes ) {
+        contents += hash + "\n";
+      }
+
+      file_.write( contents );
+
+      /* the pin only becomes visible once it's complete and locked */
+      const FileDescriptor pins_lock = lock_pins();
+      path_ = paths::pins() / roost::rbasename( file_.name() );
+      roost::rename( file_.name(), path_ );
+    }
+
+    void Pin::add( const unordered_set<string> & hashes )
+    {
+      string contents;
+      for ( const string & hash : hashes ) {
+        contents += hash + "\n";
+      }
+
+      const FileDescriptor pins_lock = lock_pins();
+      file_.write( contents );
+    }
+
+    Pin::~Pin()
+    {
+      try {
+        roost::remove( path_ );
+      }
+      catch ( const exception & e ) {
+        print_exception( "Pin", e );
+      }
+    }
+
+    void evict( const uint64_t budget )
+    {
+      struct LooseObject
+      {
+        string hash;
+        uint64_t size;
+        timespec used;
+      };
+
+      const FileDescriptor pins_lock = lock_pins();
+      const unordered_set<string> pinned = pinned_objects();
+      vector<LooseObject> candidates;
+
+      const uint64_t packed_size = pack_store().size();
+      uint64_t total = packed_size;
+
+      for ( string & blob : roost::list_directory( paths::blobs() ) ) {
+        struct stat info;
+
+        if ( not is_object_name( blob ) or
+             lstat( paths::blob_path( blob ).string().c_str(), &info ) != 0 or
+             not S_ISREG( info.st_mode ) ) {
+          continue;
+        }
+
+        total += info.st_size;
+
+        if ( pinned.count( blob ) == 0 ) {
+          candidates.push_back( { move( blob ), static_cast<uint64_t>( info.st_size ),
+                                  info.st_atim } );
+        }
+      }
+
+      if ( total <= budget ) {
+        return;
+      }
+
+      sort( candidates.begin(), candidates.end(),
+            [] ( const LooseObject & a, const LooseObject & b )
+            {
+              return a.used.tv_sec != b.used.tv_sec ? a.used.tv_sec < b.used.tv_sec
+                                                    : a.used.tv_nsec < b.used.tv_nsec;
+            } );
+
+      for ( const LooseObject & object : candidates ) {
+        if ( total <= budget ) {
+          return;
+        }
+
+        roost::remove( paths::blob_path( object.hash ) );
+        total -= object.size;
+      }
+
+      if ( total <= budget or packed_size == 0 ) {
+        return;
+      }
+
+      /* packs only go as a whole, after the pinned objects in them are
+         moved out */
+      for ( const string & hash : pinned ) {
+        if ( is_packable( hash ) and not roost::exists( paths::blob_path( hash ) ) and
+             pack_store().contains( hash ) ) {
+          materialize( hash );
+        }
+      }
+
+      pack_store().clear();
+    }
+  }
+}
@@ -0,0 +1,72 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef BLOBS_HH
+#define BLOBS_HH
+
+#include <string>
+#include <unordered_set>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "util/path.hh"
+#include "util/temp_file.hh"
+
+/* The local blob store. Small objects are appended to pack files, with an
+   index that maps each hash to its offset; the rest are kept as individual
+   files in the blobs directory. Code that needs an actual file for an
+   object (e.g. to pass it to a program) should ask for it through
+   `materialize()`.
+
+   Loose files are stamped with the time they were last used, so that a
+   worker can keep a bounded store of recently used objects (see `evict()`)
+   instead of starting from scratch for every thunk. */
+
+namespace gg {
+  namespace blobs {
+    /* objects up to this size are packed */
+    constexpr size_t PACKED_OBJECT_SIZE = 16 * 1024;
+
+    bool exists( const std::string & hash );
+    std::string read( const std::string & hash );
+
+    void write( const std::string & hash, const std::string & contents );
+
+    /* adds the file to the store, unless the object is already there. if
+       `consume` is set, the source file is moved or removed. */
+    void insert( const std::string & hash, const roost::path & source,
+                 const bool consume = false );
+
+    /* makes sure the object is available as a file at its blob path, and
+       returns that path */
+    roost::path materialize( const std::string & hash );
+
+    /* removes every object, except for the ones in `keep`; those are left
+       as files */
+    void retain_only( const std::unordered_set<std::string> & keep );
+
+    /* keeps the objects from being evicted, by any process, for as long as
+       the pin is alive */
+    class Pin
+    {
+    private:
+      UniqueFile file_;
+      roost::path path_ {};
+
+    public:
+      Pin( const std::unordered_set<std::string> & hashes );
+      ~Pin();
+
+      /* pins more objects */
+      void add( const std::unordered_set<std::string> & hashes );
+
+      Pin( const Pin & other ) = delete;
+      Pin & operator=( const Pin & other ) = delete;
+    };
+
+    /* removes the least recently used objects that aren't pinned, until the
+       store fits in `budget` bytes. does nothing if it already fits. */
+    void evict( const uint64_t budget );
+  }
+}
+
+#endif /* BLOBS_HH */
@@ -0,0 +1,108 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "bundle.hh"
+
+#include <vector>
+#include <stdexcept>
+
+#include "blobs.hh"
+#include "ggutils.hh"
+
+using namespace std;
+using namespace gg;
+using namespace gg::thunk;
+
+const string FileBundle::FILENAME = "/__gg__/bundle";
+
+void FileBundle::add( const string & filename, const string & hash )
+{
+  entries_[ filename ] = hash;
+}
+
+string FileBundle::serialize() const
+{
+  string output;
+
+  for ( const auto & entry : entries_ ) {
+    output += entry.first;
+    output += '\0';
+    output += entry.second;
+    output += '\0';
+  }
+
+  return output;
+}
+
+FileBundle FileBundle::parse( const string & data )
+{
+  FileBundle bundle;
+  size_t offset = 0;
+
+  while ( offset < data.length() ) {
+    const size_t filename_end = data.find( '\0', offset );
+    const size_t hash_end = ( filename_end == string::npos )
+                            ? string::npos
+                            : data.find( '\0', filename_end + 1 );
+
+    if ( hash_end == string::npos ) {
+      throw runtime_error( "bundle is truncated" );
+    }
+
+    bundle.add( data.substr( offset, filename_end - offset ),
+                data.substr( filename_end + 1, hash_end - filename_end - 1 ) );
+
+    offset = hash_end + 1;
+  }
+
+  return bundle;
+}
+
+FileBundle FileBundle::read( const string & hash )
+{
+  return parse( blobs::read( hash ) );
+}
+
+string FileBundle::store() const
+{
+  const string data = serialize();
+  const string hash = gg::hash::compute( data, ObjectType::Value );
+
+  if ( not blobs::exists( hash ) ) {
+    blobs::write( hash, data );
+  }
+
+  return hash;
+}
+
+bool FileBundle::has_bundles( const Thunk & thunk )
+{
+  for ( const Thunk::DataItem & item : thunk.values() ) {
+    if ( is_bundle( item ) ) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+Thunk FileBundle::expand( const Thunk & thunk )
+{
+  vector<Thunk::DataItem> values;
+  vector<Thunk::DataItem> thunks { thunk.thunks().begin(), thunk.thunks().end() };
+  vector<Thunk::DataItem> executables { thunk.executables().begin(),
+                                        thunk.executables().end() };
+
+  for ( const Thunk::DataItem & item : thunk.values() ) {
+    if ( not is_bundle( item ) ) {
+      values.emplace_back( item );
+      continue;
+    }
+
+    for ( const auto & entry : read( item.first ).entries() ) {
+      values.emplace_back( entry.second, entry.first );
+    }
+  }
+
+  return { Function { thunk.function() }, move( values ), move( thunks ),
+           move( executables ), vector<string> { thunk.outputs() } };
+}
@@ -0,0 +1,56 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef BUNDLE_HH
+#define BUNDLE_HH
+
+#include <map>
+#include <string>
+
+#include "thunk.hh"
+
+/* A bundle is a value that stands for a set of files, e.g. the headers that
+   a thunk reads from one include directory. A thunk lists it once, with
+   FILENAME as its name, instead of listing each of the files; before the
+   function runs, the bundle is expanded into the files that it holds.
+
+   The entries are kept sorted, so the same set of files always makes the
+   same bundle, and thunks that use the same files share a single object. */
+
+class FileBundle
+{
+public:
+  static const std::string FILENAME;
+
+private:
+  /* filename => hash */
+  std::map<std::string, std::string> entries_ {};
+
+public:
+  FileBundle() {}
+
+  void add( const std::string & filename, const std::string & hash );
+
+  const std::map<std::string, std::string> & entries() const { return entries_; }
+  bool empty() const { return entries_.empty(); }
+
+  std::string serialize() const;
+  static FileBundle parse( const std::string & data );
+
+  /* reads the bundle from the blob store */
+  static FileBundle read( const std::string & hash );
+
+  /* adds the bundle to the blob store, and returns its hash */
+  std::string store() const;
+
+  static bool is_bundle( const gg::thunk::Thunk::DataItem & item )
+  {
+    return item.second == FILENAME;
+  }
+
+  static bool has_bundles( const gg::thunk::Thunk & thunk );
+
+  /* the thunk, with each of its bundles replaced by the files in it */
+  static gg::thunk::Thunk expand( const gg::thunk::Thunk & thunk );
+};
+
+#endif /* BUNDLE_HH */
@@ -3,9 +3,11 @@
 #include "factory.hh"
 
 #include <algorithm>
+#include <mutex>
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include "blobs.hh"
 #include "ggutils.hh"
 #include "manifest.hh"
 #include "placeholder.hh"
@@ -14,6 +16,7 @@
 #include "util/exception.hh"
 #include "util/file_descriptor.hh"
 #include "util/optional.hh"
+#include "util/parallel.hh"
 #include "util/path.hh"
 #include "util/tokenize.hh"
 
@@ -45,6 +48,48 @@ ThunkFactory::Data::Data( const string & filename,
   }
 }
 
+/* the hash cache is keyed by the file name and its stat info */
+static Optional<string> cached_hash( const string & real_filename,
+                                     const struct stat & file_stat )
+{
+  const auto cache_entry_path = gg::paths::hash_cache_entry( real_filename, file_stat );
+  const Optional<string> cache_entry = gg::cache_entries::read( cache_entry_path );
+
+  if ( not cache_entry.initialized() ) {
+    return {};
+  }
+
+  vector<string> cache_contents = split( *cache_entry, " " );
+
+  if ( cache_contents.size() != 6 ) {
+    throw runtime_error( "bad cache entry: " + cache_entry_path.string() );
+  }
+
+  if ( cache_contents.at( 0 ) == to_string( file_stat.st_size )
+       and cache_contents.at( 1 ) == to_string( file_stat.st_mtim.tv_sec )
+       and cache_contents.at( 2 ) == to_string( file_stat.st_mtim.tv_nsec )
+       and cache_contents.at( 3 ) == to_string( file_stat.st_ctim.tv_sec )
+       and cache_contents.at( 4 ) == to_string( file_stat.st_ctim.tv_nsec ) ) {
+    /* cache hit! */
+    return { true, cache_contents.at( 5 ) };
+  }
+
+  return {};
+}
+
+static void insert_cached_hash( const string & real_filename,
+                                const struct stat & file_stat,
+                                const string & hash )
+{
+  gg::cache_entries::write( to_string( file_stat.st_size ) + " "
+                            + to_string( file_stat.st_mtim.tv_sec ) + " "
+                            + to_string( file_stat.st_mtim.tv_nsec ) + " "
+                            + to_string( file_stat.st_ctim.tv_sec ) + " "
+                            + to_string( file_stat.st_ctim.tv_nsec ) + " "
+                            + hash,
+                            gg::paths::hash_cache_entry( real_filename, file_stat ) );
+}
+
 string ThunkFactory::Data::compute_hash( const string & real_filename,
                                          const gg::ObjectType type )
 {
@@ -52,50 +97,90 @@ string ThunkFactory::Data::compute_hash( const string & real_filename,
   struct stat file_stat;
   CheckSystemCall( "stat", stat( real_filename.c_str(), &file_stat ) );
 
-  const auto cache_entry_path = gg::paths::hash_cache_entry( real_filename, file_stat );
+  const Optional<string> cache_entry = cached_hash( real_filename, file_stat );
 
-  if ( roost::exists( cache_entry_path ) ) {
-    FileDescriptor cache_file { CheckSystemCall( "open",
-                                                 open( cache_entry_path.string().c_str(), O_RDONLY ) ) };
-    string cache_entry;
-    while ( not cache_file.eof() ) { cache_entry += cache_file.read(); }
+  if ( cache_entry.initialized() ) {
+    return *cache_entry;
+  }
 
-    vector<string> cache_contents = split( cache_entry, " " );
+  /* not a cache hit, so need to compute hash ourselves */
+  const string computed_hash = gg::hash::file( real_filename, type );
 
-    if ( cache_contents.size() != 6 ) {
-      throw runtime_error( "bad cache entry: " + cache_entry_path.string() );
-    }
+  /* make a cache entry */
+  insert_cached_hash( real_filename, file_stat, computed_hash );
 
-    if ( cache_contents.at( 0 ) == to_string( file_stat.st_size )
-         and cache_contents.at( 1 ) == to_string( file_stat.st_mtim.tv_sec )
-         and cache_contents.at( 2 ) == to_string( file_stat.st_mtim.tv_nsec )
-         and cache_contents.at( 3 ) == to_string( file_stat.st_ctim.tv_sec )
-         and cache_contents.at( 4 ) == to_string( file_stat.st_ctim.tv_nsec ) ) {
-      /* cache hit! */
-      return cache_contents.at( 5 );
-    }
-  }
+  return computed_hash;
+}
 
-  /* not a cache hit, so need to compute hash ourselves */
+vector<ThunkFactory::Data> ThunkFactory::Data::from_files( const vector<string> & filenames,
+                                                           const gg::ObjectType type )
+{
+  struct Entry
+  {
+    string real_filename {};
+    struct stat file_stat {};
+    gg::ObjectType type { gg::ObjectType::Value };
+    string hash {};
+  };
+
+  vector<Entry> entries( filenames.size() );
+  vector<size_t> misses;
+  mutex misses_mutex;
+
+  /* first, the placeholders and the hash cache */
+  parallel_for( filenames.size(),
+    [&] ( const size_t i )
+    {
+      Entry & entry = entries[ i ];
+      entry.real_filename = roost::path( filenames[ i ] ).lexically_normal().string();
+
+      Optional<ThunkPlaceholder> placeholder = ThunkPlaceholder::read( entry.real_filename );
+
+      if ( placeholder.initialized() ) {
+        entry.type = gg::ObjectType::Thunk;
+        entry.hash = placeholder->content_hash();
+        return;
+      }
 
-  FileDescriptor file { CheckSystemCall( "open (" + real_filename + ")",
-                                         open( real_filename.c_str(), O_RDONLY ) ) };
+      entry.type = type;
 
-  string contents;
-  while ( not file.eof() ) { contents += file.read(); }
+      CheckSystemCall( "stat", stat( entry.real_filename.c_str(), &entry.file_stat ) );
+      const Optional<string> cache_entry = cached_hash( entry.real_filename, entry.file_stat );
 
-  const string computed_hash = gg::hash::compute( contents, type );
+      if ( cache_entry.initialized() ) {
+        entry.hash = *cache_entry;
+      }
+      else {
+        unique_lock<mutex> lock { misses_mutex };
+        misses.push_back( i );
+      }
+    } );
 
-  /* make a cache entry */
-  roost::atomic_create( to_string( file_stat.st_size ) + " "
-                        + to_string( file_stat.st_mtim.tv_sec ) + " "
-                        + to_string( file_stat.st_mtim.tv_nsec ) + " "
-                        + to_string( file_stat.st_ctim.tv_sec ) + " "
-                        + to_string( file_stat.st_ctim.tv_nsec ) + " "
-                        + computed_hash,
-                        cache_entry_path );
+  /* then, everything else at once */
+  vector<roost::path> to_hash;
+  for ( const size_t i : misses ) {
+    to_hash.emplace_back( entries[ i ].real_filename );
+  }
 
-  return computed_hash;
+  const vector<string> hashes = gg::hash::files( to_hash, type );
+
+  parallel_for( misses.size(),
+    [&] ( const size_t i )
+    {
+      Entry & entry = entries[ misses[ i ] ];
+      entry.hash = hashes[ i ];
+      insert_cached_hash( entry.real_filename, entry.file_stat, entry.hash );
+    } );
+
+  vector<Data> output;
+  output.reserve( filenames.size() );
+
+  for ( size_t i = 0; i < filenames.size(); i++ ) {
+    output.emplace_back( filenames[ i ], entries[ i ].real_filename,
+                         entries[ i ].type, entries[ i ].hash );
+  }
+
+  return output;
 }
 
 Thunk ThunkFactory::create_thunk( const Function & function,
@@ -179,8 +264,7 @@ std::string ThunkFactory::generate( const Function & function,
     string manifest_hash = gg::hash::compute( manifest_data,
                                               ObjectType::Value );
     thunk_data.emplace_back( manifest_hash, string {} );
-    roost::atomic_create( manifest_data,
-                          gg::paths::blob_path( manifest_hash ) );
+    gg::blobs::write( manifest_hash, manifest_data );
     thunk_function.envars().push_back( "GG_MANIFEST=" + thunk::data_placeholder( manifest_hash ) );
   }
 
@@ -188,12 +272,7 @@ std::string ThunkFactory::generate( const Function & function,
     auto fn_collect =
       [] ( const Data & datum )
       {
-        roost::path source_path = datum.real_filename();
-        roost::path target_path = gg::paths::blob_path( datum.hash() );
-
-        if ( not roost::exists( target_path ) ) {
-          roost::copy_then_rename( source_path, target_path );
-        }
+        gg::blobs::insert( datum.hash(), datum.real_filename() );
       };
 
     for ( const Data & datum : data ) { fn_collect( datum ); }
@@ -214,6 +293,8 @@ std::string ThunkFactory::generate( const Function & function,
     else {
       placeholder.write( outputs.at( 0 ).tag() );
     }
+
+    gg::speculation::notify( hash );
   }
 
   return hash;
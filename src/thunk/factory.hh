@@ -43,6 +43,11 @@ public:
 
     static std::string compute_hash( const std::string & real_filename,
                                      const gg::ObjectType type );
+
+    /* same as constructing a Data for each file, but the files are
+       hashed in parallel */
+    static std::vector<Data> from_files( const std::vector<std::string> & filenames,
+                                         const gg::ObjectType type = gg::ObjectType::Value );
   };
 
   using Function = gg::thunk::Function;
@@ -8,6 +8,8 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <cctype>
+#include <algorithm>
 
 using namespace std;
 using namespace gg;
@@ -52,3 +54,120 @@ bool Function::operator==( const Function & other ) const
          ( args_ == other.args_ ) and
          ( envars_ == other.envars_ );
 }
+
+string & Function::placeholder_string( const Placeholder & placeholder )
+{
+  return placeholder.in_envars ? envars_.at( placeholder.index )
+                               : args_.at( placeholder.index );
+}
+
+const string & Function::placeholder_string( const Placeholder & placeholder ) const
+{
+  return placeholder.in_envars ? envars_.at( placeholder.index )
+                               : args_.at( placeholder.index );
+}
+
+/* a single pass over the args and envars, looking for the same thing as
+   @\{GGHASH:([a-zA-Z0-9_.]+)\} would */
+const Function::PlaceholderIndex & Function::placeholder_index() const
+{
+  if ( placeholders_.initialized() ) {
+    return *placeholders_;
+  }
+
+  PlaceholderIndex index;
+
+  auto scan =
+    [&index] ( const vector<string> & strings, const bool in_envars )
+    {
+      for ( size_t i = 0; i < strings.size(); i++ ) {
+        const string & str = strings[ i ];
+        size_t start = 0;
+
+        while ( ( start = str.find( DATA_PLACEHOLDER_START, start ) ) != string::npos ) {
+          const size_t hash_start = start + DATA_PLACEHOLDER_START.length();
+          size_t hash_end = hash_start;
+
+          while ( hash_end < str.length() and
+                  ( isalnum( static_cast<unsigned char>( str[ hash_end ] ) ) or
+                    str[ hash_end ] == '_' or str[ hash_end ] == '.' ) ) {
+            hash_end++;
+          }
+
+          if ( hash_end > hash_start and
+               str.compare( hash_end, DATA_PLACEHOLDER_END.length(), DATA_PLACEHOLDER_END ) == 0 ) {
+            const size_t end = hash_end + DATA_PLACEHOLDER_END.length();
+            index.by_hash[ str.substr( hash_start, hash_end - hash_start ) ].push_back( index.all.size() );
+            index.all.push_back( { in_envars, i, start, end - start } );
+            start = end;
+          }
+          else {
+            start++;
+          }
+        }
+      }
+    };
+
+  scan( args_, false );
+  scan( envars_, true );
+
+  placeholders_.initialize( move( index ) );
+  return *placeholders_;
+}
+
+const vector<Function::Placeholder> & Function::placeholders() const
+{
+  return placeholder_index().all;
+}
+
+string Function::placeholder_hash( const Placeholder & placeholder ) const
+{
+  return placeholder_string( placeholder ).substr(
+    placeholder.offset + DATA_PLACEHOLDER_START.length(),
+    placeholder.length - DATA_PLACEHOLDER_START.length() - DATA_PLACEHOLDER_END.length() );
+}
+
+void Function::replace_placeholders( const string & old_hash, const string & new_hash )
+{
+  placeholder_index();
+
+  auto old_entry = placeholders_->by_hash.find( old_hash );
+
+  if ( old_entry == placeholders_->by_hash.end() or old_hash == new_hash ) {
+    return;
+  }
+
+  /* back to front, so a replacement doesn't move the ones before it */
+  vector<size_t> indices = move( old_entry->second );
+  placeholders_->by_hash.erase( old_entry );
+  sort( indices.rbegin(), indices.rend() );
+
+  for ( const size_t i : indices ) {
+    const Placeholder & placeholder = placeholders_->all[ i ];
+    placeholder_string( placeholder ).replace(
+      placeholder.offset + DATA_PLACEHOLDER_START.length(), old_hash.length(), new_hash );
+  }
+
+  if ( old_hash.length() != new_hash.length() ) {
+    placeholders_.clear();
+  }
+  else {
+    vector<size_t> & new_indices = placeholders_->by_hash[ new_hash ];
+    new_indices.insert( new_indices.end(), indices.begin(), indices.end() );
+  }
+}
+
+void Function::expand_placeholders( const function<string( const string & )> & replacement,
+                                    vector<string> & args,
+                                    vector<string> & envars ) const
+{
+  args = args_;
+  envars = envars_;
+
+  const vector<Placeholder> & all_placeholders = placeholders();
+
+  for ( auto it = all_placeholders.rbegin(); it != all_placeholders.rend(); it++ ) {
+    string & str = it->in_envars ? envars.at( it->index ) : args.at( it->index );
+    str.replace( it->offset, it->length, replacement( placeholder_hash( *it ) ) );
+  }
+}
@@ -3,19 +3,28 @@
 #include "ggutils.hh"
 
 #include <sstream>
+#include <unordered_map>
+#include <mutex>
 #include <iomanip>
+#include <cinttypes>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/fcntl.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <cstring>
 #include <crypto++/sha.h>
 #include <crypto++/hex.h>
 #include <crypto++/base64.h>
 
 #include "thunk_reader.hh"
-#include "util/digest.hh"
 #include "util/exception.hh"
 #include "util/file_descriptor.hh"
+#include "util/mmap.hh"
+#include "util/parallel.hh"
+#include "util/sha256.hh"
 #include "util/tokenize.hh"
 #include "util/util.hh"
 
@@ -87,6 +96,12 @@ namespace gg {
       return blobs_path;
     }
 
+    roost::path packs()
+    {
+      const static roost::path packs_path = get_inner_directory( "packs" );
+      return packs_path;
+    }
+
     roost::path reductions()
     {
       const static roost::path reductions_path = get_inner_directory( "reductions" );
@@ -111,6 +126,30 @@ namespace gg {
       return cache_path;
     }
 
+    roost::path specs_cache()
+    {
+      const static roost::path cache_path = get_inner_directory( "specs" );
+      return cache_path;
+    }
+
+    roost::path chunk_index()
+    {
+      const static roost::path index_path = get_inner_directory( "chunks" );
+      return index_path;
+    }
+
+    roost::path scratch()
+    {
+      const static roost::path scratch_path = get_inner_directory( "tmp" );
+      return scratch_path;
+    }
+
+    roost::path pins()
+    {
+      const static roost::path pins_path = get_inner_directory( "pins" );
+      return pins_path;
+    }
+
     roost::path blob_path( const string & hash )
     {
       return blobs() / hash;
@@ -133,6 +172,16 @@ namespace gg {
       return dependency_cache() / cache_key;
     }
 
+    roost::path specs_cache_entry( const string & toolchain_hash )
+    {
+      return specs_cache() / toolchain_hash;
+    }
+
+    roost::path chunk_index_entry( const string & chunk_hash )
+    {
+      return chunk_index() / chunk_hash;
+    }
+
     void fix_path_envar()
     {
       if ( getenv( "GG_REALPATH" ) != nullptr ) {
@@ -179,15 +228,78 @@ namespace gg {
       return uri;
     }
 
-    pair<string, uint16_t> runner_server()
+    vector<RunnerServer> runner_servers()
     {
-      const static string address = safe_getenv( "GG_RUNNER_SERVER" );
-      if ( address.length() == 0 ) {
+      const static string addresses = safe_getenv( "GG_RUNNER_SERVER" );
+      if ( addresses.length() == 0 ) {
         throw runtime_error( "GG_RUNNER_SERVER environment variable not set" );
       }
-      vector<string> data = split( address, ":" );
 
-      return { data.at( 0 ), stoul( data.at( 1 ) ) };
+      vector<RunnerServer> servers;
+
+      for ( const string & address : split( addresses, "," ) ) {
+        if ( address.empty() ) {
+          continue;
+        }
+
+        vector<string> data = split( address, "/" );
+        vector<string> ip_port = split( data.at( 0 ), ":" );
+
+        if ( ip_port.size() != 2 or data.size() > 2 ) {
+          throw runtime_error( "invalid runner address: " + address );
+        }
+
+        servers.push_back( { ip_port[ 0 ], static_cast<uint16_t>( stoul( ip_port[ 1 ] ) ),
+                             data.size() == 2 ? stoul( data[ 1 ] ) : 0 } );
+      }
+
+      if ( servers.empty() ) {
+        throw runtime_error( "GG_RUNNER_SERVER has no runners" );
+      }
+
+      return servers;
+    }
+  }
+
+  namespace speculation {
+    static void send_message( const string & socket_path, const string & message,
+                              const int flags )
+    {
+      sockaddr_un address;
+      memset( &address, 0, sizeof( address ) );
+      address.sun_family = AF_UNIX;
+
+      if ( socket_path.length() >= sizeof( address.sun_path ) ) {
+        return;
+      }
+
+      memcpy( address.sun_path, socket_path.c_str(), socket_path.length() );
+
+      const int sock = socket( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+
+      if ( sock < 0 ) {
+        return;
+      }
+
+      /* if it's not there, or it can't keep up, it just doesn't speculate */
+      sendto( sock, message.data(), message.length(), flags,
+              reinterpret_cast<const sockaddr *>( &address ), sizeof( address ) );
+      close( sock );
+    }
+
+    void notify( const string & thunk_hash )
+    {
+      const char * socket_path = getenv( "GG_SPECULATE_SOCKET" );
+
+      if ( socket_path != nullptr ) {
+        send_message( socket_path, thunk_hash, MSG_DONTWAIT );
+      }
+    }
+
+    void finish( const string & socket_path )
+    {
+      /* this one has to get through */
+      send_message( socket_path, {}, 0 );
     }
   }
 
@@ -213,36 +325,330 @@ namespace gg {
     }
   }
 
+  namespace cache_entries {
+    static bool in_memory = false;
+    static unordered_map<string, string> memory;
+    static int report_fd = -1;
+
+    /* the hash cache is looked up from several threads at once */
+    static mutex memory_mutex;
+
+    static string encode_length( const size_t length )
+    {
+      const uint32_t value = length;
+      string output( 4, '\0' );
+
+      for ( size_t i = 0; i < 4; i++ ) {
+        output[ i ] = static_cast<char>( ( value >> ( 8 * i ) ) & 0xff );
+      }
+
+      return output;
+    }
+
+    static uint32_t decode_length( const string & data, const size_t offset )
+    {
+      const uint8_t * bytes = reinterpret_cast<const uint8_t *>( data.data() + offset );
+      return bytes[ 0 ] | ( bytes[ 1 ] << 8 ) | ( bytes[ 2 ] << 16 ) |
+             ( static_cast<uint32_t>( bytes[ 3 ] ) << 24 );
+    }
+
+    static void remember( const string & entry_path, const string & contents )
+    {
+      if ( not in_memory ) {
+        return;
+      }
+
+      unique_lock<mutex> lock { memory_mutex };
+      memory[ entry_path ] = contents;
+
+      if ( report_fd < 0 ) {
+        return;
+      }
+
+      const string record = encode_length( entry_path.length() ) + entry_path
+                            + encode_length( contents.length() ) + contents;
+
+      /* one record per write, so that they can't be interleaved; the
+         report is only a hint, so a record that's too big is dropped */
+      if ( ::write( report_fd, record.data(), record.length() ) < 0 ) {
+        return;
+      }
+    }
+
+    Optional<string> read( const roost::path & entry_path )
+    {
+      if ( in_memory ) {
+        unique_lock<mutex> lock { memory_mutex };
+        auto entry = memory.find( entry_path.string() );
+
+        if ( entry != memory.end() ) {
+          return { true, entry->second };
+        }
+      }
+
+      if ( not roost::exists( entry_path ) ) {
+        return {};
+      }
+
+      FileDescriptor entry_file { CheckSystemCall( "open (" + entry_path.string() + ")",
+                                                   open( entry_path.string().c_str(), O_RDONLY ) ) };
+      string contents;
+      while ( not entry_file.eof() ) { contents += entry_file.read(); }
+
+      remember( entry_path.string(), contents );
+      return { true, move( contents ) };
+    }
+
+    void write( const string & contents, const roost::path & entry_path )
+    {
+      roost::atomic_create( contents, entry_path );
+      remember( entry_path.string(), contents );
+    }
+
+    void keep_in_memory()
+    {
+      in_memory = true;
+    }
+
+    void report_to( const int fd )
+    {
+      report_fd = fd;
+    }
+
+    void apply_report( string & report )
+    {
+      size_t offset = 0;
+
+      while ( true ) {
+        if ( report.length() < offset + 4 ) { break; }
+        const size_t path_length = decode_length( report, offset );
+
+        if ( report.length() < offset + 8 + path_length ) { break; }
+        const size_t contents_length = decode_length( report, offset + 4 + path_length );
+
+        const size_t record_length = 8 + path_length + contents_length;
+        if ( report.length() < offset + record_length ) { break; }
+
+        memory[ report.substr( offset + 4, path_length ) ] =
+          report.substr( offset + 8 + path_length, contents_length );
+
+        offset += record_length;
+      }
+
+      report.erase( 0, offset );
+    }
+  }
+
   namespace hash {
     string for_output( const string & thunk_hash, const string & output_tag )
     {
       return thunk_hash + "#" + output_tag;
     }
 
+    /* type + base64url( sha256 ), with '.' instead of '-' and without the
+       padding, + the size in hex */
+    static string encode( const char * digest, const size_t digest_length,
+                          const ObjectType type, const uint64_t size )
+    {
+      static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "abcdefghijklmnopqrstuvwxyz"
+                                     "0123456789._";
+
+      /* this is on the path of every thunk load, so the output is built
+         up in place */
+      const size_t encoded_length = 1 + ( digest_length * 4 + 2 ) / 3;
+      string output( encoded_length + 8, '\0' );
+      char * out = &output[ 0 ];
+      *out++ = to_underlying( type );
+
+      const uint8_t * data = reinterpret_cast<const uint8_t *>( digest );
+
+      for ( size_t i = 0; i < digest_length; i += 3 ) {
+        const size_t available = min<size_t>( 3, digest_length - i );
+        uint32_t group = data[ i ] << 16;
+        if ( available > 1 ) { group |= data[ i + 1 ] << 8; }
+        if ( available > 2 ) { group |= data[ i + 2 ]; }
+
+        *out++ = alphabet[ ( group >> 18 ) & 0x3f ];
+        *out++ = alphabet[ ( group >> 12 ) & 0x3f ];
+        if ( available > 1 ) { *out++ = alphabet[ ( group >> 6 ) & 0x3f ]; }
+        if ( available > 2 ) { *out++ = alphabet[ group & 0x3f ]; }
+      }
+
+      if ( size >> 32 ) {
+        char size_hex[ 17 ];
+        snprintf( size_hex, sizeof( size_hex ), "%08" PRIx64, size );
+        output.replace( encoded_length, string::npos, size_hex );
+      }
+      else {
+        for ( int shift = 28; shift >= 0; shift -= 4 ) {
+          *out++ = "0123456789abcdef"[ ( size >> shift ) & 0xf ];
+        }
+      }
+
+      return output;
+    }
+
+    static string encode( const string & digest, const ObjectType type,
+                          const uint64_t size )
+    {
+      return encode( digest.data(), digest.length(), type, size );
+    }
+
+    string from_digest( const string & digest, const ObjectType type, const uint64_t size )
+    {
+      return encode( digest, type, size );
+    }
+
+    static ObjectType detect_type( const char * data, const size_t size )
+    {
+      return ( size >= thunk::MAGIC_NUMBER.size() and
+               thunk::MAGIC_NUMBER.compare( 0, string::npos, data, thunk::MAGIC_NUMBER.size() ) == 0 )
+             ? ObjectType::Thunk : ObjectType::Value;
+    }
+
     string compute( const string & input, const ObjectType type )
     {
-      string ret { move( digest::sha256( input ) ) };
-      ostringstream output_sstr;
+      return compute( input.data(), input.length(), type );
+    }
 
-      replace( ret.begin(), ret.end(), '-', '.' );
-      output_sstr << to_underlying( type ) << ret << setfill( '0' )
-                  << setw( 8 ) << hex << input.length();
-      return output_sstr.str();
+    string compute( const char * input, const size_t length, const ObjectType type )
+    {
+      digest::SHA256 hasher;
+      hasher.update( input, length );
+      return encode( hasher.digest(), type, length );
     }
 
-    string file( const roost::path & path )
+    /* hashes the file without holding a copy of it in memory: regular files
+       are mapped, anything else is read in fixed-size pieces */
+    static string hash_file( const roost::path & path, const ObjectType * type )
     {
       FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
                                              open( path.string().c_str(), O_RDONLY ) ) };
 
-      string contents;
-      while ( not file.eof() ) { contents += file.read(); }
+      struct stat file_stat;
+      CheckSystemCall( "fstat", fstat( file.fd_num(), &file_stat ) );
+
+      digest::SHA256 hasher;
+
+      if ( S_ISREG( file_stat.st_mode ) ) {
+        MappedFile mapping { file, static_cast<size_t>( file_stat.st_size ) };
+
+        /* hash a window at a time, so the pages we're done with can go */
+        for ( size_t offset = 0; offset < mapping.size(); offset += BUFFER_SIZE ) {
+          hasher.update( mapping.data() + offset, min( BUFFER_SIZE, mapping.size() - offset ) );
+        }
+
+        return encode( hasher.digest(),
+                       type ? *type : detect_type( mapping.data(), mapping.size() ),
+                       mapping.size() );
+      }
+
+      string head;
+
+      while ( not file.eof() ) {
+        const string buffer = file.read();
 
-      const ObjectType type = ( contents.size() >= thunk::MAGIC_NUMBER.size() and
-                                contents.compare( 0, thunk::MAGIC_NUMBER.size(), gg::thunk::MAGIC_NUMBER ) == 0 )
-                              ? ObjectType::Thunk : ObjectType::Value;
+        if ( head.length() < thunk::MAGIC_NUMBER.size() ) {
+          head += buffer.substr( 0, thunk::MAGIC_NUMBER.size() - head.length() );
+        }
+
+        hasher.update( buffer );
+      }
+
+      return encode( hasher.digest(),
+                     type ? *type : detect_type( head.data(), head.size() ),
+                     hasher.length() );
+    }
+
+    string file( const roost::path & path )
+    {
+      return hash_file( path, nullptr );
+    }
 
-      return gg::hash::compute( contents, type );
+    string file( const roost::path & path, const ObjectType type )
+    {
+      return hash_file( path, &type );
+    }
+
+    /* with multi-buffer hashing, files up to this size are read in whole
+       and hashed in groups */
+    static constexpr off_t SMALL_FILE_SIZE = 64 * 1024;
+    static constexpr size_t SMALL_FILE_GROUP = 64;
+
+    static vector<string> hash_files( const vector<roost::path> & paths,
+                                      const ObjectType * type )
+    {
+      vector<string> hashes( paths.size() );
+
+      if ( not digest::SHA256::multi_buffer_preferred() ) {
+        parallel_for( paths.size(),
+                      [&] ( const size_t i ) { hashes[ i ] = hash_file( paths[ i ], type ); } );
+        return hashes;
+      }
+
+      vector<size_t> small_files;
+      vector<size_t> large_files;
+
+      for ( size_t i = 0; i < paths.size(); i++ ) {
+        struct stat file_stat;
+
+        if ( stat( paths[ i ].string().c_str(), &file_stat ) == 0 and
+             S_ISREG( file_stat.st_mode ) and file_stat.st_size <= SMALL_FILE_SIZE ) {
+          small_files.push_back( i );
+        }
+        else {
+          large_files.push_back( i );
+        }
+      }
+
+      const size_t group_count = ( small_files.size() + SMALL_FILE_GROUP - 1 ) / SMALL_FILE_GROUP;
+
+      parallel_for( large_files.size() + group_count,
+        [&] ( const size_t task )
+        {
+          if ( task < large_files.size() ) {
+            const size_t index = large_files[ task ];
+            hashes[ index ] = hash_file( paths[ index ], type );
+            return;
+          }
+
+          const size_t first = ( task - large_files.size() ) * SMALL_FILE_GROUP;
+          const size_t last = min( first + SMALL_FILE_GROUP, small_files.size() );
+
+          vector<string> contents;
+
+          for ( size_t i = first; i < last; i++ ) {
+            const roost::path & path = paths[ small_files[ i ] ];
+            FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                                   open( path.string().c_str(), O_RDONLY ) ) };
+            string data;
+            while ( not file.eof() ) { data += file.read(); }
+            contents.push_back( move( data ) );
+          }
+
+          const vector<string> digests = digest::SHA256::digest_many( contents );
+
+          for ( size_t i = first; i < last; i++ ) {
+            const string & data = contents[ i - first ];
+            hashes[ small_files[ i ] ] =
+              encode( digests[ i - first ],
+                      type ? *type : detect_type( data.data(), data.size() ),
+                      data.size() );
+          }
+        } );
+
+      return hashes;
+    }
+
+    vector<string> files( const vector<roost::path> & paths )
+    {
+      return hash_files( paths, nullptr );
+    }
+
+    vector<string> files( const vector<roost::path> & paths, const ObjectType type )
+    {
+      return hash_files( paths, &type );
     }
 
     string to_hex( const string & gghash )
@@ -266,6 +672,72 @@ namespace gg {
       }
     }
 
+    Optional<string> to_binary( const string & gghash )
+    {
+      if ( gghash.length() != length or
+           ( gghash[ 0 ] != to_underlying( ObjectType::Value ) and
+             gghash[ 0 ] != to_underlying( ObjectType::Thunk ) ) ) {
+        return {};
+      }
+
+      string output;
+      output.reserve( binary_length );
+      output += gghash[ 0 ];
+
+      /* base64 back to bytes, four characters at a time */
+      uint32_t group = 0;
+      size_t bits = 0;
+
+      for ( size_t i = 1; i < length - 8; i++ ) {
+        const char c = gghash[ i ];
+        uint32_t value;
+
+        if ( c >= 'A' and c <= 'Z' ) { value = c - 'A'; }
+        else if ( c >= 'a' and c <= 'z' ) { value = c - 'a' + 26; }
+        else if ( c >= '0' and c <= '9' ) { value = c - '0' + 52; }
+        else if ( c == '.' ) { value = 62; }
+        else if ( c == '_' ) { value = 63; }
+        else { return {}; }
+
+        group = ( group << 6 ) | value;
+        bits += 6;
+
+        if ( bits >= 8 ) {
+          bits -= 8;
+          output += static_cast<char>( ( group >> bits ) & 0xff );
+        }
+      }
+
+      const string size_hex = gghash.substr( length - 8 );
+
+      if ( size_hex.find_first_not_of( "0123456789abcdef" ) != string::npos ) {
+        return {};
+      }
+
+      const uint32_t object_size = stoul( size_hex, nullptr, 16 );
+
+      for ( int shift = 24; shift >= 0; shift -= 8 ) {
+        output += static_cast<char>( ( object_size >> shift ) & 0xff );
+      }
+
+      /* leftover bits in the last character would be lost */
+      if ( from_binary( output.data() ) != gghash ) {
+        return {};
+      }
+
+      return { true, move( output ) };
+    }
+
+    string from_binary( const char * data )
+    {
+      const uint8_t * bytes = reinterpret_cast<const uint8_t *>( data );
+      const uint32_t object_size = ( static_cast<uint32_t>( bytes[ 33 ] ) << 24 ) |
+                                   ( bytes[ 34 ] << 16 ) | ( bytes[ 35 ] << 8 ) | bytes[ 36 ];
+
+      return encode( data + 1, 32, static_cast<ObjectType>( data[ 0 ] ),
+                     object_size );
+    }
+
     uint32_t size( const string & hash )
     {
       assert( hash.length() >= 8 );
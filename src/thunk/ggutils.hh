@@ -16,15 +16,22 @@
 namespace gg {
   namespace paths {
     roost::path blobs();
+    roost::path packs();
     roost::path reductions();
     roost::path remote_index();
     roost::path hash_cache();
     roost::path dependency_cache();
+    roost::path specs_cache();
+    roost::path chunk_index();
+    roost::path scratch();
+    roost::path pins();
 
     roost::path blob_path( const std::string & hash );
     roost::path reduction_path( const std::string & hash );
     roost::path hash_cache_entry( const std::string & filename, const struct stat & stat_entry );
     roost::path dependency_cache_entry( const std::string & cache_key );
+    roost::path specs_cache_entry( const std::string & toolchain_hash );
+    roost::path chunk_index_entry( const std::string & chunk_hash );
 
     void fix_path_envar();
   }
@@ -34,7 +41,25 @@ namespace gg {
     void set_available( const std::string & hash );
 
     std::string storage_backend_uri();
-    std::pair<std::string, uint16_t> runner_server();
+
+    struct RunnerServer
+    {
+      std::string ip;
+      uint16_t port;
+      size_t max_jobs; /* 0 if there's no limit */
+    };
+
+    /* GG_RUNNER_SERVER is a comma-separated list of ip:port[/max-jobs] */
+    std::vector<RunnerServer> runner_servers();
+  }
+
+  /* gg-infer can start reducing the thunks while they're still being
+     created: the models tell a speculative reductor, listening on the
+     datagram socket in GG_SPECULATE_SOCKET, about every thunk they write.
+     an empty message means that no more thunks are coming. */
+  namespace speculation {
+    void notify( const std::string & thunk_hash );
+    void finish( const std::string & socket_path );
   }
 
   namespace cache {
@@ -47,15 +72,52 @@ namespace gg {
     void insert( const std::string & old_hash, const std::string & new_hash );
   }
 
+  /* the hash, dependency and specs caches are made of small entries under
+     .gg. a long-lived process (gg-modeld) can keep them in memory as well,
+     and have the processes it forks report back the entries they load from
+     disk or write. */
+  namespace cache_entries {
+    Optional<std::string> read( const roost::path & entry_path );
+    void write( const std::string & contents, const roost::path & entry_path );
+
+    void keep_in_memory();
+
+    /* each entry is reported with a single write on `fd` (a datagram
+       socket), as (uint32 length, path, uint32 length, contents), with the
+       lengths in little-endian */
+    void report_to( const int fd );
+
+    /* adds the complete records at the start of `report` to memory, and
+       removes them from it */
+    void apply_report( std::string & report );
+  }
+
   namespace hash {
     constexpr size_t length = 1 /* type */ + 256 / 6 /* base64(sha256) */ + 1 /* round up */ + 8 /* length */;
 
     std::string for_output( const std::string & thunk_hash, const std::string & output_tag );
 
     std::string compute( const std::string & input, const ObjectType type );
+    std::string compute( const char * input, const size_t length, const ObjectType type );
     std::string file( const roost::path & path );
+    std::string file( const roost::path & path, const ObjectType type );
+
+    /* the hash of an object that was fed to a digest::SHA256 in pieces */
+    std::string from_digest( const std::string & digest, const ObjectType type,
+                             const uint64_t size );
+
+    /* hashes many files in parallel */
+    std::vector<std::string> files( const std::vector<roost::path> & paths );
+    std::vector<std::string> files( const std::vector<roost::path> & paths, const ObjectType type );
     std::string to_hex( const std::string & gghash );
 
+    /* fixed-width form of a hash: type, raw digest and size (big-endian) */
+    constexpr size_t binary_length = 1 + 32 + 4;
+
+    /* not initialized if the hash isn't in its canonical form */
+    Optional<std::string> to_binary( const std::string & gghash );
+    std::string from_binary( const char * data );
+
     uint32_t size( const std::string & gghash );
     ObjectType type( const std::string & gghash );
   }
@@ -4,6 +4,8 @@
 
 #include <stdexcept>
 
+#include "blobs.hh"
+#include "bundle.hh"
 #include "ggutils.hh"
 #include "thunk.hh"
 #include "thunk_reader.hh"
@@ -24,13 +26,20 @@ string ExecutionGraph::add_thunk( const string & hash )
     return hash;
   }
 
-  Thunk thunk { move( ThunkReader::read( gg::paths::blob_path( hash ), hash ) ) };
+  Thunk thunk { move( ThunkReader::parse( gg::blobs::read( hash ), hash ) ) };
 
   /* creating the entry */
   referencing_thunks_[ hash ];
 
   for ( const Thunk::DataItem & item : thunk.values() ) {
-    value_dependencies_.emplace( item.first );
+    const bool new_value = value_dependencies_.emplace( item.first ).second;
+
+    /* the files in a bundle are needed as well (once per bundle) */
+    if ( new_value and FileBundle::is_bundle( item ) ) {
+      for ( const auto & entry : FileBundle::read( item.first ).entries() ) {
+        value_dependencies_.emplace( entry.second );
+      }
+    }
   }
 
   for ( const Thunk::DataItem & item : thunk.executables() ) {
@@ -8,7 +8,6 @@
 #include <unordered_map>
 #include <algorithm>
 #include <numeric>
-#include <regex>
 #include <google/protobuf/util/json_util.h>
 
 #include "thunk/ggutils.hh"
@@ -160,26 +159,13 @@ int Thunk::execute() const
   bool verbose = ( getenv( "GG_VERBOSE" ) != nullptr );
 
   // preparing argv
-  vector<string> args = function_.args();
-  vector<string> envars { function_.envars() };
-
-  auto replace_data_placeholder =
-    []( string & str ) -> void
-    {
-      if ( regex_search( str, DATA_PLACEHOLDER_REGEX ) ) {
-        string new_path = regex_replace( str, DATA_PLACEHOLDER_REGEX, gg::paths::blob_path( "$1" ).string() );
-        swap( str, new_path );
-      }
-    };
+  vector<string> args;
+  vector<string> envars;
 
   /* do we need to replace a hash placeholder with the actual path? */
-  for ( string & arg : args ) {
-    replace_data_placeholder( arg );
-  }
-
-  for ( string & envar : envars ) {
-    replace_data_placeholder( envar );
-  }
+  function_.expand_placeholders(
+    [] ( const string & hash ) { return gg::paths::blob_path( hash ).string(); },
+    args, envars );
 
   const roost::path thunk_path = gg::paths::blob_path( hash() );
 
@@ -320,31 +306,7 @@ void Thunk::update_data( const string & old_hash, const string & new_hash )
   }
 
   /* let's update the args/envs as necessary */
-  const string srcstr = data_placeholder( old_hash );
-  const string dststr = data_placeholder( new_hash );
-
-  assert( srcstr.length() == dststr.length() );
-
-  auto update_placeholder =
-    []( string & str, const string & src, const string & dst )
-    {
-      size_t index = 0;
-
-      while ( true ) {
-        index = str.find( src, index );
-        if ( index == string::npos ) break;
-        str.replace( index, dst.length(), dst );
-        index += dst.length();
-      }
-    };
-
-  for ( string & arg : function_.args() ) {
-    update_placeholder( arg, srcstr, dststr );
-  }
-
-  for ( string & envar : function_.envars() ) {
-    update_placeholder( envar, srcstr, dststr );
-  }
+  function_.replace_placeholders( old_hash, new_hash );
 }
 
 unordered_map<string, Permissions>
@@ -9,7 +9,6 @@
 #include <map>
 #include <unordered_map>
 #include <limits>
-#include <regex>
 #include <sys/types.h>
 #include <crypto++/base64.h>
 #include <crypto++/files.h>
@@ -35,17 +34,41 @@ namespace gg {
 
     const std::string DATA_PLACEHOLDER_START = "@{GGHASH:";
     const std::string DATA_PLACEHOLDER_END = "}";
-    const std::regex DATA_PLACEHOLDER_REGEX { R"X(@\{GGHASH:([a-zA-Z0-9_.]+)\})X" };
 
     std::string data_placeholder( const std::string & hash );
 
     class Function
     {
+    public:
+      /* where a data placeholder appears in the args or envars */
+      struct Placeholder
+      {
+        bool in_envars;
+        size_t index;
+        size_t offset;
+        size_t length;
+      };
+
     private:
       std::string hash_ {};
       std::vector<std::string> args_;
       std::vector<std::string> envars_ {};
 
+      struct PlaceholderIndex
+      {
+        std::vector<Placeholder> all {};
+        std::unordered_map<std::string, std::vector<size_t>> by_hash {};
+      };
+
+      /* found on first use, and forgotten whenever the args or envars are
+         handed out for modification */
+      mutable Optional<PlaceholderIndex> placeholders_ {};
+
+      const PlaceholderIndex & placeholder_index() const;
+
+      std::string & placeholder_string( const Placeholder & placeholder );
+      const std::string & placeholder_string( const Placeholder & placeholder ) const;
+
     public:
       Function( const std::string & hash,
                 const std::vector<std::string> & args,
@@ -62,8 +85,22 @@ namespace gg {
       const std::vector<std::string> & args() const { return args_; }
       const std::vector<std::string> & envars() const { return envars_; }
 
-      std::vector<std::string> & args() { return args_; }
-      std::vector<std::string> & envars() { return envars_; }
+      std::vector<std::string> & args() { placeholders_.clear(); return args_; }
+      std::vector<std::string> & envars() { placeholders_.clear(); return envars_; }
+
+      const std::vector<Placeholder> & placeholders() const;
+      std::string placeholder_hash( const Placeholder & placeholder ) const;
+
+      /* points the placeholders for `old_hash` to `new_hash`, which must be
+         of the same length */
+      void replace_placeholders( const std::string & old_hash,
+                                 const std::string & new_hash );
+
+      /* the args and envars, with each placeholder replaced by
+         `replacement( hash )` */
+      void expand_placeholders( const std::function<std::string( const std::string & )> & replacement,
+                                std::vector<std::string> & args,
+                                std::vector<std::string> & envars ) const;
 
       gg::protobuf::Function to_protobuf() const;
 
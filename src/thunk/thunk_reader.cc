@@ -1,10 +1,14 @@
 /* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
 
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include "thunk/thunk_reader.hh"
+#include "thunk/thunk_view.hh"
+#include "thunk/ggutils.hh"
 #include "util/exception.hh"
 #include "util/file_descriptor.hh"
+#include "util/mmap.hh"
 #include "util/serialization.hh"
 
 using namespace std;
@@ -26,22 +30,50 @@ bool ThunkReader::is_thunk( const roost::path & path )
 
 Thunk ThunkReader::read( const std::string & path, const std::string & hash )
 {
-  ProtobufDeserializer deserializer { path };
-  protobuf::Thunk thunk_proto;
-
-  deserializer.read_string( MAGIC_NUMBER.length() ); /* skipping the magic number */
-  deserializer.read_protobuf( thunk_proto );
-
-  Thunk thunk { thunk_proto };
-
-  if ( hash.length() > 0 ) {
-    thunk.set_hash( hash );
-  }
+  FileDescriptor file { CheckSystemCall( "open (" + path + ")",
+                                         open( path.c_str(), O_RDONLY ) ) };
+  struct stat file_stat;
+  CheckSystemCall( "fstat", fstat( file.fd_num(), &file_stat ) );
 
-  return thunk;
+  const MappedFile data { file, static_cast<size_t>( file_stat.st_size ) };
+  return parse( data.data(), data.size(), hash );
 }
 
 Thunk ThunkReader::read( const roost::path & path, const std::string & hash )
 {
   return move( ThunkReader::read( path.string(), hash ) );
 }
+
+Thunk ThunkReader::parse( const string & data, const string & hash )
+{
+  return parse( data.data(), data.length(), hash );
+}
+
+Thunk ThunkReader::parse( const char * data, const size_t length, const string & hash )
+{
+  Optional<Thunk> thunk;
+
+  if ( ThunkView::is_binary( data, length ) ) {
+    thunk.initialize( ThunkView { data, length }.to_thunk() );
+  }
+  else {
+    protobuf::Thunk thunk_proto;
+
+    if ( length < MAGIC_NUMBER.length() or
+         MAGIC_NUMBER.compare( 0, string::npos, data, MAGIC_NUMBER.length() ) != 0 or
+         not thunk_proto.ParseFromArray( data + MAGIC_NUMBER.length(),
+                                         length - MAGIC_NUMBER.length() ) ) {
+      throw runtime_error( "could not parse thunk" );
+    }
+
+    thunk.initialize( thunk_proto );
+  }
+
+  /* a thunk's hash is the hash of its encoding. thunks in the older format
+     would hash differently if they were written out again, so they keep
+     the hash of the bytes they came in. */
+  thunk->set_hash( hash.length() > 0 ? hash
+                                     : gg::hash::compute( data, length, ObjectType::Thunk ) );
+
+  return move( *thunk );
+}
@@ -21,4 +21,9 @@ public:
 
   static gg::thunk::Thunk read( const std::string & path, const std::string & hash = {} );
   static gg::thunk::Thunk read( const roost::path & path, const std::string & hash = {} );
+
+  /* parses a serialized thunk, in either encoding */
+  static gg::thunk::Thunk parse( const std::string & data, const std::string & hash = {} );
+  static gg::thunk::Thunk parse( const char * data, const size_t length,
+                                 const std::string & hash = {} );
 };
@@ -0,0 +1,185 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "thunk_view.hh"
+
+#include <vector>
+#include <stdexcept>
+
+#include "thunk/ggutils.hh"
+
+using namespace std;
+using namespace gg;
+using namespace gg::thunk;
+
+namespace {
+
+  /* the lists with hashes come first, in this order */
+  const ThunkView::List DATA_LISTS[] = { ThunkView::List::Values,
+                                         ThunkView::List::Thunks,
+                                         ThunkView::List::Executables };
+
+  const ThunkView::List STRING_LISTS[] = { ThunkView::List::Args,
+                                           ThunkView::List::Envars,
+                                           ThunkView::List::Outputs };
+
+  bool is_data_list( const ThunkView::List list )
+  {
+    return list == ThunkView::List::Values or list == ThunkView::List::Thunks or
+           list == ThunkView::List::Executables;
+  }
+
+  constexpr size_t DATA_ENTRY_SIZE = gg::hash::binary_length + sizeof( uint32_t );
+
+}
+
+bool ThunkView::is_binary( const char * data, const size_t size )
+{
+  return size > MAGIC_NUMBER.length() + 1 and
+         MAGIC_NUMBER.compare( 0, string::npos, data, MAGIC_NUMBER.length() ) == 0 and
+         data[ MAGIC_NUMBER.length() ] == '\0';
+}
+
+ThunkView::ThunkView( const char * data, const size_t size )
+  : data_( data ), size_( size ), counts_(), offsets_()
+{
+  if ( not is_binary( data_, size_ ) ) {
+    throw runtime_error( "not a binary thunk" );
+  }
+
+  if ( static_cast<uint8_t>( data_[ MAGIC_NUMBER.length() + 1 ] ) != VERSION ) {
+    throw runtime_error( "unsupported thunk version" );
+  }
+
+  size_t offset = MAGIC_NUMBER.length() + 2;
+
+  if ( size_ < offset + LIST_COUNT * sizeof( uint32_t ) + gg::hash::binary_length ) {
+    throw runtime_error( "thunk is truncated" );
+  }
+
+  for ( size_t i = 0; i < LIST_COUNT; i++ ) {
+    counts_[ i ] = read_uint32( offset );
+    offset += sizeof( uint32_t );
+  }
+
+  function_hash_offset_ = offset;
+  offset += gg::hash::binary_length;
+
+  for ( const List list : DATA_LISTS ) {
+    offsets_[ static_cast<size_t>( list ) ] = offset;
+    offset += count( list ) * DATA_ENTRY_SIZE;
+  }
+
+  for ( const List list : STRING_LISTS ) {
+    offsets_[ static_cast<size_t>( list ) ] = offset;
+    offset += count( list ) * sizeof( uint32_t );
+  }
+
+  if ( offset + sizeof( uint32_t ) > size_ ) {
+    throw runtime_error( "thunk is truncated" );
+  }
+
+  strings_size_ = read_uint32( offset );
+  strings_offset_ = offset + sizeof( uint32_t );
+
+  if ( strings_offset_ + strings_size_ != size_ ) {
+    throw runtime_error( "thunk has the wrong size" );
+  }
+}
+
+uint32_t ThunkView::read_uint32( const size_t offset ) const
+{
+  const uint8_t * bytes = reinterpret_cast<const uint8_t *>( data_ + offset );
+  return bytes[ 0 ] | ( bytes[ 1 ] << 8 ) | ( bytes[ 2 ] << 16 ) |
+         ( static_cast<uint32_t>( bytes[ 3 ] ) << 24 );
+}
+
+size_t ThunkView::entry_offset( const List list, const size_t index ) const
+{
+  if ( index >= count( list ) ) {
+    throw out_of_range( "thunk entry index out of range" );
+  }
+
+  return offsets_[ static_cast<size_t>( list ) ]
+         + index * ( is_data_list( list ) ? DATA_ENTRY_SIZE : sizeof( uint32_t ) );
+}
+
+ThunkView::StringRef ThunkView::string_at( const uint32_t ref ) const
+{
+  if ( static_cast<size_t>( ref ) + sizeof( uint32_t ) > strings_size_ ) {
+    throw runtime_error( "invalid string reference in thunk" );
+  }
+
+  const uint32_t length = read_uint32( strings_offset_ + ref );
+
+  if ( ref + sizeof( uint32_t ) + length > strings_size_ ) {
+    throw runtime_error( "invalid string reference in thunk" );
+  }
+
+  return { data_ + strings_offset_ + ref + sizeof( uint32_t ), length };
+}
+
+string ThunkView::function_hash() const
+{
+  return gg::hash::from_binary( data_ + function_hash_offset_ );
+}
+
+const char * ThunkView::binary_hash( const List list, const size_t index ) const
+{
+  if ( not is_data_list( list ) ) {
+    throw runtime_error( "thunk list has no hashes" );
+  }
+
+  return data_ + entry_offset( list, index );
+}
+
+string ThunkView::hash( const List list, const size_t index ) const
+{
+  return gg::hash::from_binary( binary_hash( list, index ) );
+}
+
+ThunkView::StringRef ThunkView::filename( const List list, const size_t index ) const
+{
+  return string_at( read_uint32( entry_offset( list, index ) + gg::hash::binary_length ) );
+}
+
+ThunkView::StringRef ThunkView::text( const List list, const size_t index ) const
+{
+  if ( is_data_list( list ) ) {
+    throw runtime_error( "thunk list has no strings" );
+  }
+
+  return string_at( read_uint32( entry_offset( list, index ) ) );
+}
+
+Thunk ThunkView::to_thunk() const
+{
+  auto strings =
+    [this] ( const List list )
+    {
+      vector<string> output;
+      output.reserve( count( list ) );
+
+      for ( size_t i = 0; i < count( list ); i++ ) {
+        output.emplace_back( text( list, i ).str() );
+      }
+
+      return output;
+    };
+
+  auto data_items =
+    [this] ( const List list )
+    {
+      vector<Thunk::DataItem> output;
+      output.reserve( count( list ) );
+
+      for ( size_t i = 0; i < count( list ); i++ ) {
+        output.emplace_back( hash( list, i ), filename( list, i ).str() );
+      }
+
+      return output;
+    };
+
+  return { Function { function_hash(), strings( List::Args ), strings( List::Envars ) },
+           data_items( List::Values ), data_items( List::Thunks ),
+           data_items( List::Executables ), strings( List::Outputs ) };
+}
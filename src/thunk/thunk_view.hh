@@ -0,0 +1,97 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef THUNK_VIEW_HH
+#define THUNK_VIEW_HH
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "thunk/thunk.hh"
+
+/* The binary encoding of a thunk (all integers are little-endian):
+
+     "##GGTHUNK##" 0x00 VERSION
+     uint32 x 6    number of args, envars, values, thunks, executables
+                   and outputs
+     hash          the function's hash
+     (hash, ref)   for each value, thunk and executable: its hash and its
+                   filename
+     ref           for each arg, envar and output
+     uint32        size of the string table
+     table         (uint32 length, bytes) for each distinct string
+
+   Hashes are in their fixed-width binary form (gg::hash::to_binary), and a
+   ref is the offset of a string's entry in the table. Protobufs never begin
+   with a zero byte, which is how this is told apart from the older format.
+
+   ThunkView reads such a thunk in place, e.g. from a mapped file, and only
+   copies the parts that are asked for. */
+
+class ThunkView
+{
+public:
+  static constexpr uint8_t VERSION = 1;
+
+  enum class List { Args = 0, Envars, Values, Thunks, Executables, Outputs };
+
+  class StringRef
+  {
+  private:
+    const char * data_;
+    size_t length_;
+
+  public:
+    StringRef( const char * data, const size_t length )
+      : data_( data ), length_( length ) {}
+
+    StringRef( const StringRef & other ) = default;
+    StringRef & operator=( const StringRef & other ) = default;
+
+    const char * data() const { return data_; }
+    size_t length() const { return length_; }
+    std::string str() const { return { data_, length_ }; }
+  };
+
+private:
+  static constexpr size_t LIST_COUNT = 6;
+
+  const char * data_;
+  size_t size_;
+
+  uint32_t counts_[ LIST_COUNT ];
+  size_t offsets_[ LIST_COUNT ];
+
+  size_t function_hash_offset_ { 0 };
+  size_t strings_offset_ { 0 };
+  size_t strings_size_ { 0 };
+
+  uint32_t read_uint32( const size_t offset ) const;
+  size_t entry_offset( const List list, const size_t index ) const;
+  StringRef string_at( const uint32_t ref ) const;
+
+public:
+  /* throws if the data isn't a well-formed binary thunk */
+  ThunkView( const char * data, const size_t size );
+
+  ThunkView( const ThunkView & other ) = default;
+  ThunkView & operator=( const ThunkView & other ) = default;
+
+  static bool is_binary( const char * data, const size_t size );
+
+  std::string function_hash() const;
+
+  size_t count( const List list ) const { return counts_[ static_cast<size_t>( list ) ]; }
+
+  /* the hashes and filenames of values, thunks and executables */
+  const char * binary_hash( const List list, const size_t index ) const;
+  std::string hash( const List list, const size_t index ) const;
+  StringRef filename( const List list, const size_t index ) const;
+
+  /* args, envars and outputs */
+  StringRef text( const List list, const size_t index ) const;
+
+  gg::thunk::Thunk to_thunk() const;
+};
+
+#endif /* THUNK_VIEW_HH */
@@ -4,8 +4,11 @@
 
 #include <iostream>
 #include <fstream>
+#include <unordered_map>
 
+#include "thunk/blobs.hh"
 #include "thunk/ggutils.hh"
+#include "thunk/thunk_view.hh"
 #include "util/digest.hh"
 #include "util/path.hh"
 #include "util/serialization.hh"
@@ -21,18 +24,122 @@ string ThunkWriter::write( const Thunk & thunk, const roost::path & path )
                                                ObjectType::Thunk );
   thunk.set_hash( thunk_hash );
 
-  roost::path target_path { ( not path.empty() ) ? path
-                                                 : paths::blob_path( thunk_hash ) };
-
-  if ( not roost::exists( target_path ) ) {
-    roost::atomic_create( serialized_thunk, target_path );
+  if ( path.empty() ) {
+    blobs::write( thunk_hash, serialized_thunk );
+  }
+  else if ( not roost::exists( path ) ) {
+    roost::atomic_create( serialized_thunk, path );
   }
 
   return thunk_hash;
 }
 
+namespace {
+
+  void put_uint32( string & output, const uint32_t value )
+  {
+    for ( size_t i = 0; i < 4; i++ ) {
+      output += static_cast<char>( ( value >> ( 8 * i ) ) & 0xff );
+    }
+  }
+
+  /* each distinct string is stored once, in the order it first appears */
+  class StringTable
+  {
+  private:
+    unordered_map<string, uint32_t> refs_ {};
+    string data_ {};
+
+  public:
+    uint32_t add( const string & str )
+    {
+      auto ref = refs_.find( str );
+
+      if ( ref != refs_.end() ) {
+        return ref->second;
+      }
+
+      const uint32_t offset = data_.length();
+      put_uint32( data_, str.length() );
+      data_ += str;
+      refs_.emplace( str, offset );
+      return offset;
+    }
+
+    const string & data() const { return data_; }
+  };
+
+  /* see thunk_view.hh for the layout. not initialized if the thunk
+     refers to something that isn't a canonical hash. */
+  Optional<string> serialize_binary( const Thunk & thunk )
+  {
+    string body;
+    StringTable strings;
+
+    auto add_hash =
+      [&body] ( const string & hash )
+      {
+        const Optional<string> binary = gg::hash::to_binary( hash );
+
+        if ( binary.initialized() ) {
+          body += *binary;
+        }
+
+        return binary.initialized();
+      };
+
+    if ( not add_hash( thunk.function().hash() ) ) {
+      return {};
+    }
+
+    for ( const Thunk::DataList * list : { &thunk.values(), &thunk.thunks(),
+                                           &thunk.executables() } ) {
+      for ( const Thunk::DataItem & item : *list ) {
+        if ( not add_hash( item.first ) ) {
+          return {};
+        }
+
+        put_uint32( body, strings.add( item.second ) );
+      }
+    }
+
+    for ( const vector<string> * list : { &thunk.function().args(),
+                                          &thunk.function().envars(),
+                                          &thunk.outputs() } ) {
+      for ( const string & str : *list ) {
+        put_uint32( body, strings.add( str ) );
+      }
+    }
+
+    string output { MAGIC_NUMBER };
+    output += '\0';
+    output += static_cast<char>( ThunkView::VERSION );
+
+    for ( const size_t count : { thunk.function().args().size(),
+                                 thunk.function().envars().size(),
+                                 thunk.values().size(), thunk.thunks().size(),
+                                 thunk.executables().size(), thunk.outputs().size() } ) {
+      put_uint32( output, count );
+    }
+
+    output += body;
+    put_uint32( output, strings.data().length() );
+    output += strings.data();
+
+    return { true, move( output ) };
+  }
+
+}
+
 string ThunkWriter::serialize( const gg::thunk::Thunk & thunk )
 {
+  Optional<string> binary = serialize_binary( thunk );
+
+  if ( binary.initialized() ) {
+    return move( *binary );
+  }
+
+  /* the older, protobuf-based encoding */
   string ret { MAGIC_NUMBER };
   if ( not thunk.to_protobuf().AppendToString( &ret ) ) {
     throw runtime_error( "could not serialize thunk" );
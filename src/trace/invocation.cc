@@ -5,7 +5,12 @@
 #include <sstream>
 #include <string>
 #include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include <climits>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
 
 #include "util/exception.hh"
 
@@ -14,22 +19,20 @@ using namespace std;
 template<typename T>
 T SystemCallInvocation::get_syscall_arg( const uint8_t argnum ) const
 {
-  return reinterpret_cast<T>( ptrace( PTRACE_PEEKUSER, pid_,
-                                      sizeof( long ) * SYSCALL_ARG_REGS[ argnum ], NULL ) );
+  /* the register numbers are offsets into user_regs_struct, in words */
+  const long * registers = reinterpret_cast<const long *>( &registers_ );
+  return reinterpret_cast<T>( registers[ SYSCALL_ARG_REGS[ argnum ] ] );
 }
 
-template<>
-string SystemCallInvocation::get_syscall_arg( const uint8_t argnum ) const
+static string peek_string( const pid_t pid, char * str_addr )
 {
   string result;
-
-  char * str_addr = get_syscall_arg<char *>( argnum );
   size_t i = 0;
 
   do {
     errno = 0;
 
-    int val = ptrace( PTRACE_PEEKTEXT, pid_, str_addr, NULL );
+    int val = ptrace( PTRACE_PEEKTEXT, pid, str_addr, NULL );
 
     if ( errno and val < 0 ) {
       throw unix_error( "ptrace(PEEKTEXT)" );
@@ -51,15 +54,62 @@ string SystemCallInvocation::get_syscall_arg( const uint8_t argnum ) const
   return result;
 }
 
+template<>
+string SystemCallInvocation::get_syscall_arg( const uint8_t argnum ) const
+{
+  static const size_t page_size = sysconf( _SC_PAGESIZE );
+
+  string result;
+  char * str_addr = get_syscall_arg<char *>( argnum );
+  char buffer[ PATH_MAX ];
+
+  while ( true ) {
+    /* a read that crosses into an unmapped page would fail, so stay on
+       the current page */
+    const size_t to_page_end = page_size - reinterpret_cast<uintptr_t>( str_addr ) % page_size;
+    const size_t length = min( to_page_end, sizeof( buffer ) );
+
+    iovec local { buffer, length };
+    iovec remote { str_addr, length };
+
+    const ssize_t bytes_read = process_vm_readv( pid_, &local, 1, &remote, 1, 0 );
+
+    if ( bytes_read <= 0 ) {
+      /* e.g., no CONFIG_CROSS_MEMORY_ATTACH; PEEKTEXT reports bad addresses */
+      return result + peek_string( pid_, str_addr );
+    }
+
+    const char * end = static_cast<const char *>( memchr( buffer, '\0', bytes_read ) );
+
+    if ( end != nullptr ) {
+      return result.append( buffer, end - buffer );
+    }
+
+    result.append( buffer, bytes_read );
+    str_addr += bytes_read;
+  }
+}
+
+/* changes the argument in the tracee, and in our copy of its registers, so
+   that it reads back as the new value */
+void SystemCallInvocation::set_syscall_register( const uint8_t argnum, const long value )
+{
+  CheckSystemCall( "ptrace(POKEUSER)",
+                   ptrace( PTRACE_POKEUSER, pid_,
+                           sizeof( long ) * SYSCALL_ARG_REGS[ argnum ], value ) );
+
+  long * registers = reinterpret_cast<long *>( &registers_ );
+  registers[ SYSCALL_ARG_REGS[ argnum ] ] = value;
+}
+
 template<typename T>
-void SystemCallInvocation::set_syscall_arg( const uint8_t argnum, const T & value ) const
+void SystemCallInvocation::set_syscall_arg( const uint8_t argnum, const T & value )
 {
-  ptrace( PTRACE_POKEUSER, pid_,
-          sizeof( long ) * SYSCALL_ARG_REGS[ argnum ], &value );
+  set_syscall_register( argnum, static_cast<long>( value ) );
 }
 
 template<>
-void SystemCallInvocation::set_syscall_arg( const uint8_t argnum, const string & value ) const
+void SystemCallInvocation::set_syscall_arg( const uint8_t argnum, const string & value )
 {
   if ( value.length() >= PATH_MAX ) {
     throw runtime_error( "maximum string length for set_syscall_arg is PATH_MAX" );
@@ -90,7 +140,7 @@ void SystemCallInvocation::set_syscall_arg( const uint8_t argnum, const string &
     }
   }
 
-  ptrace( PTRACE_POKEUSER, pid_, sizeof( long ) * SYSCALL_ARG_REGS[ argnum ], str_addr );
+  set_syscall_register( argnum, reinterpret_cast<long>( str_addr ) );
 }
 
 /* Argument */
@@ -118,12 +168,12 @@ Argument::Argument( ArgumentInfo info, const long raw_value )
 /* SystemCallInvocation */
 
 SystemCallInvocation::SystemCallInvocation( const pid_t pid,
-                                            const long syscall_no )
-  : pid_( pid ), syscall_( syscall_no ), signature_(), arguments_(),
-    return_value_()
+                                            const user_regs_struct & registers )
+  : pid_( pid ), syscall_( registers.orig_rax ), registers_( registers ),
+    signature_(), arguments_(), return_value_()
 {
-  if ( syscall_signature( syscall_no ).complete() ) {
-    const SystemCallSignature & sig = syscall_signature( syscall_no );
+  if ( syscall_signature( syscall_ ).complete() ) {
+    const SystemCallSignature & sig = syscall_signature( syscall_ );
     signature_.reset( sig );
   }
 }
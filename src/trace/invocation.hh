@@ -5,6 +5,7 @@
 
 #include <string>
 #include <vector>
+#include <sys/user.h>
 
 #include "syscall.hh"
 #include "util/optional.hh"
@@ -46,6 +47,9 @@ private:
   /* syscall number */
   long syscall_;
 
+  /* registers of the calling process at syscall entry */
+  user_regs_struct registers_;
+
   /* signature of the invoked system call, if available */
   Optional<SystemCallSignature> signature_;
 
@@ -61,10 +65,12 @@ private:
   T get_syscall_arg( const uint8_t argnum ) const;
 
   template<typename T>
-  void set_syscall_arg( const uint8_t argnum, const T & value ) const;
+  void set_syscall_arg( const uint8_t argnum, const T & value );
+
+  void set_syscall_register( const uint8_t argnum, const long value );
 
 public:
-  SystemCallInvocation( const pid_t pid, const long syscall_no );
+  SystemCallInvocation( const pid_t pid, const user_regs_struct & registers );
 
   long syscall_no() const { return syscall_; }
   std::string name();
@@ -64,6 +64,13 @@ const SystemCallSignature & syscall_signature( const size_t syscall_no )
 out_end = '''\
   };
 
+  /* system calls that are newer than this table */
+  static const SystemCallSignature unknown_signature { -1, "unknown", {} };
+
+  if ( syscall_no >= sizeof( syscall_signatures ) / sizeof( syscall_signatures[ 0 ] ) ) {
+    return unknown_signature;
+  }
+
   return syscall_signatures[ syscall_no ];
 }
 '''
@@ -3581,5 +3581,12 @@ const SystemCallSignature & syscall_signature( const size_t syscall_no )
 
   };
 
+  /* system calls that are newer than this table */
+  static const SystemCallSignature unknown_signature { -1, "unknown", {} };
+
+  if ( syscall_no >= sizeof( syscall_signatures ) / sizeof( syscall_signatures[ 0 ] ) ) {
+    return unknown_signature;
+  }
+
   return syscall_signatures[ syscall_no ];
 }
@@ -7,12 +7,20 @@
 #include <sys/wait.h>
 #include <sys/user.h>
 #include <sys/stat.h>
+#include <sys/prctl.h>
+#include <sys/utsname.h>
 #include <linux/limits.h>
+#include <linux/seccomp.h>
+#include <linux/filter.h>
+#include <linux/audit.h>
 #include <signal.h>
 #include <errno.h>
+#include <cstdio>
 #include <cstring>
+#include <cstddef>
 #include <sstream>
 #include <exception>
+#include <unordered_set>
 
 #include "util/exception.hh"
 
@@ -21,9 +29,11 @@ using namespace std;
 template <typename T> void zero( T & x ) { memset( &x, 0, sizeof( x ) ); }
 
 TracerFlock::TracerFlock( const ProcessTracer::entry_type & before_entry_function,
-                          const ProcessTracer::exit_type & after_exit_function )
+                          const ProcessTracer::exit_type & after_exit_function,
+                          const bool syscall_filter )
   : before_entry_function_( before_entry_function ),
-    after_exit_function_( after_exit_function )
+    after_exit_function_( after_exit_function ),
+    syscall_filter_( syscall_filter )
 {}
 
 void TracerFlock::insert( const pid_t tracee_pid )
@@ -32,7 +42,8 @@ void TracerFlock::insert( const pid_t tracee_pid )
     throw runtime_error( "bad attempt to insert pid " + to_string( tracee_pid ) );
   }
 
-  tracers_.emplace( make_pair( tracee_pid, tracee_pid ) );
+  tracers_.emplace( piecewise_construct, forward_as_tuple( tracee_pid ),
+                    forward_as_tuple( tracee_pid, syscall_filter_ ) );
 }
 
 void TracerFlock::remove( const pid_t tracee_pid )
@@ -120,8 +131,8 @@ void TracerFlock::add_child_process( ChildProcess && child_process )
   children_.insert( make_pair( child_process.pid(), move( child_process ) ) );
 }
 
-ProcessTracer::ProcessTracer( const pid_t tracee_pid )
-  : tracee_pid_( tracee_pid )
+ProcessTracer::ProcessTracer( const pid_t tracee_pid, const bool syscall_filter )
+  : tracee_pid_( tracee_pid ), syscall_filter_( syscall_filter )
 {}
 
 void ProcessTracer::set_ptrace_options() const
@@ -134,7 +145,8 @@ void ProcessTracer::set_ptrace_options() const
                                                  PTRACE_O_TRACEFORK |
                                                  PTRACE_O_TRACEVFORK |
                                                  PTRACE_O_TRACECLONE |
-                                                 PTRACE_O_EXITKILL ) );
+                                                 PTRACE_O_EXITKILL |
+                                                 ( syscall_filter_ ? PTRACE_O_TRACESECCOMP : 0 ) ) );
 }
 
 /* blocking wait on one process */
@@ -185,6 +197,11 @@ bool ProcessTracer::handle_one_event( TracerFlock & flock,
       return true;
       break;
 
+    case PTRACE_EVENT_SECCOMP:
+      /* the filter trapped a syscall; since Linux 4.8, this stop comes
+         after the syscall entry, so the next PTRACE_SYSCALL stop is its exit */
+      return handle_syscall_entry( flock, before_entry_function );
+
     case PTRACE_EVENT_EXEC:
       {
         /* get former thread ID */
@@ -206,23 +223,7 @@ bool ProcessTracer::handle_one_event( TracerFlock & flock,
   } else if ( infop.si_status == (SIGTRAP | 0x80) ) {
     if ( not info_.syscall_invocation.initialized() ) {
       /* syscall entry */
-      errno = 0;
-      const long syscall_no = ptrace( PTRACE_PEEKUSER, tracee_pid_, sizeof( long ) * ORIG_RAX );
-      if ( errno ) { throw unix_error( "ptrace" ); }
-
-      info_.syscall_invocation.initialize( tracee_pid_, syscall_no );
-      before_entry_function( info_, flock );
-
-      if ( info_.detach ) {
-        /* set the process free */
-        return true;
-      }
-
-      if ( info_.pause ) {
-        /* process may be waiting on another process to first complete */
-        /* don't resume process with ptrace( PTRACE_SYSCALL ) */
-        return false;
-      }
+      return handle_syscall_entry( flock, before_entry_function );
     } else {
       /* syscall exit */
       errno = 0;
@@ -249,8 +250,39 @@ bool ProcessTracer::handle_one_event( TracerFlock & flock,
   return false;
 }
 
+bool ProcessTracer::handle_syscall_entry( TracerFlock & flock,
+                                          const entry_type & before_entry_function )
+{
+  user_regs_struct registers;
+  CheckSystemCall( "ptrace(GETREGS)",
+                   ptrace( PTRACE_GETREGS, tracee_pid_, nullptr, &registers ) );
+
+  info_.syscall_invocation.initialize( tracee_pid_, registers );
+  before_entry_function( info_, flock );
+
+  if ( info_.detach ) {
+    if ( syscall_filter_ ) {
+      /* without a tracer, the syscalls that the filter traps would fail */
+      throw runtime_error( "can't detach from filtered tracee " + to_string( tracee_pid_ ) );
+    }
+
+    /* set the process free */
+    return true;
+  }
+
+  if ( info_.pause ) {
+    /* process may be waiting on another process to first complete */
+    /* don't resume process with ptrace( PTRACE_SYSCALL ) */
+    return false;
+  }
+
+  resume( 0 );
+  return false;
+}
+
 ProcessTracer::ProcessTracer( ProcessTracer && pt )
   : tracee_pid_( pt.tracee_pid_ ),
+    syscall_filter_( pt.syscall_filter_ ),
     options_set_( pt.options_set_ ),
     info_( pt.info_ )
 {
@@ -264,19 +296,105 @@ ProcessTracer::~ProcessTracer()
   }
 }
 
+static long syscall_table_size()
+{
+  long table_size = 0;
+  while ( syscall_signature( table_size ).number() != -1 ) { table_size++; }
+  return table_size;
+}
+
+/* the tracer relies on the seccomp stop coming after the syscall entry,
+   which is only the case since Linux 4.8 */
+static bool syscall_filter_supported()
+{
+  utsname system_info;
+  unsigned int major = 0, minor = 0;
+
+  if ( uname( &system_info ) != 0 or
+       sscanf( system_info.release, "%u.%u", &major, &minor ) != 2 or
+       major < 4 or ( major == 4 and minor < 8 ) ) {
+    return false;
+  }
+
+  /* and the kernel has to have been built with seccomp */
+  return prctl( PR_GET_SECCOMP, 0, 0, 0, 0 ) >= 0;
+}
+
+/* without the filter, the tracee stops at every syscall, so the ones that
+   the filter wouldn't have trapped are skipped here */
+static function<bool( const TracedThreadInfo & )>
+is_traced( const vector<long> & traced_syscalls )
+{
+  const unordered_set<long> syscalls { traced_syscalls.begin(), traced_syscalls.end() };
+  const long table_size = syscall_table_size();
+
+  return [syscalls, table_size] ( const TracedThreadInfo & tcb )
+    {
+      const long syscall_no = tcb.syscall_invocation->syscall_no();
+      return syscall_no < 0 or syscall_no >= table_size or syscalls.count( syscall_no );
+    };
+}
+
+static ProcessTracer::entry_type
+traced_entries( const ProcessTracer::entry_type & before_entry_function,
+                const vector<long> & traced_syscalls, const bool syscall_filter )
+{
+  if ( traced_syscalls.empty() or syscall_filter ) {
+    return before_entry_function;
+  }
+
+  const auto traced = is_traced( traced_syscalls );
+
+  return [traced, before_entry_function] ( TracedThreadInfo & tcb, TracerFlock & flock )
+    {
+      if ( traced( tcb ) ) {
+        before_entry_function( tcb, flock );
+      }
+    };
+}
+
+static ProcessTracer::exit_type
+traced_exits( const ProcessTracer::exit_type & after_exit_function,
+              const vector<long> & traced_syscalls, const bool syscall_filter )
+{
+  if ( traced_syscalls.empty() or syscall_filter ) {
+    return after_exit_function;
+  }
+
+  const auto traced = is_traced( traced_syscalls );
+
+  return [traced, after_exit_function] ( const TracedThreadInfo & tcb )
+    {
+      if ( traced( tcb ) ) {
+        after_exit_function( tcb );
+      }
+    };
+}
+
 Tracer::Tracer( const std::string & name,
                 function<int()> && child_procedure,
                 const ProcessTracer::entry_type & before_entry_function,
                 const ProcessTracer::exit_type & after_exit_function,
-                function<void()> && preparation_procedure )
-  : flock_( before_entry_function, after_exit_function )
+                function<void()> && preparation_procedure,
+                const vector<long> & traced_syscalls )
+  : syscall_filter_( not traced_syscalls.empty() and syscall_filter_supported() ),
+    flock_( traced_entries( before_entry_function, traced_syscalls, syscall_filter_ ),
+            traced_exits( after_exit_function, traced_syscalls, syscall_filter_ ),
+            syscall_filter_ )
 {
+  const bool syscall_filter = syscall_filter_;
+
   /* create a ChildProcess that will be traced */
   ChildProcess tp { name,
-      [preparation_procedure, child_procedure]() {
+      [preparation_procedure, child_procedure, traced_syscalls, syscall_filter]() {
       preparation_procedure();
       CheckSystemCall( "ptrace(TRACEME)", ptrace( PTRACE_TRACEME ) );
       raise( SIGSTOP );
+
+      if ( syscall_filter ) {
+        install_syscall_filter( traced_syscalls );
+      }
+
       return child_procedure(); } };
 
   flock_.insert( tp.pid() );
@@ -305,5 +423,55 @@ void ProcessTracer::resume( const int signal )
 {
   info_.pause = false;
 
+  if ( syscall_filter_ and not info_.syscall_invocation.initialized() ) {
+    /* the filter will stop the tracee at the next syscall we care about */
+    CheckSystemCall( "ptrace(CONT)", ptrace( PTRACE_CONT, tracee_pid_, nullptr, signal ) );
+    return;
+  }
+
   CheckSystemCall( "ptrace(SYSCALL)", ptrace( PTRACE_SYSCALL, tracee_pid_, nullptr, signal ) );
 }
+
+vector<long> syscalls_with_flags( const int flags )
+{
+  vector<long> syscalls;
+
+  for ( long syscall_no = 0; syscall_signature( syscall_no ).number() != -1; syscall_no++ ) {
+    if ( syscall_signature( syscall_no ).flags() & flags ) {
+      syscalls.push_back( syscall_no );
+    }
+  }
+
+  return syscalls;
+}
+
+void install_syscall_filter( const vector<long> & syscalls )
+{
+  const long table_size = syscall_table_size();
+
+  vector<sock_filter> filter {
+    /* other ABIs: trap everything */
+    BPF_STMT( BPF_LD | BPF_W | BPF_ABS, offsetof( seccomp_data, arch ) ),
+    BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0 ),
+    BPF_STMT( BPF_RET | BPF_K, SECCOMP_RET_TRACE ),
+
+    /* syscalls we know nothing about (including x32 ones): trap them */
+    BPF_STMT( BPF_LD | BPF_W | BPF_ABS, offsetof( seccomp_data, nr ) ),
+    BPF_JUMP( BPF_JMP | BPF_JGE | BPF_K, static_cast<uint32_t>( table_size ), 0, 1 ),
+    BPF_STMT( BPF_RET | BPF_K, SECCOMP_RET_TRACE ),
+  };
+
+  for ( const long syscall_no : syscalls ) {
+    filter.push_back( BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K,
+                                static_cast<uint32_t>( syscall_no ), 0, 1 ) );
+    filter.push_back( BPF_STMT( BPF_RET | BPF_K, SECCOMP_RET_TRACE ) );
+  }
+
+  filter.push_back( BPF_STMT( BPF_RET | BPF_K, SECCOMP_RET_ALLOW ) );
+
+  sock_fprog program { static_cast<unsigned short>( filter.size() ), filter.data() };
+
+  CheckSystemCall( "prctl(PR_SET_NO_NEW_PRIVS)", prctl( PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0 ) );
+  CheckSystemCall( "prctl(PR_SET_SECCOMP)",
+                   prctl( PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program ) );
+}
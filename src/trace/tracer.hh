@@ -4,6 +4,7 @@
 #define TRACER_HH
 
 #include <map>
+#include <vector>
 #include <functional>
 
 #include "syscall.hh"
@@ -31,13 +32,19 @@ public:
 private:
   pid_t tracee_pid_;
 
+  /* the tracee only stops at the syscalls its seccomp filter traps */
+  bool syscall_filter_;
+
   bool options_set_ = false;
   void set_ptrace_options() const;
 
   TracedThreadInfo info_ { tracee_pid_ };
 
+  bool handle_syscall_entry( TracerFlock & flock,
+                             const entry_type & before_entry_function );
+
 public:
-  ProcessTracer( const pid_t tracee_pid );
+  ProcessTracer( const pid_t tracee_pid, const bool syscall_filter = false );
   ~ProcessTracer();
 
   /* handle one event from the tracee.
@@ -62,6 +69,7 @@ class TracerFlock
 private:
   ProcessTracer::entry_type before_entry_function_;
   ProcessTracer::exit_type after_exit_function_;
+  bool syscall_filter_;
 
   std::map<pid_t, ChildProcess> children_ {};
   std::map<pid_t, ProcessTracer> tracers_ {};
@@ -69,7 +77,8 @@ private:
 
 public:
   TracerFlock( const ProcessTracer::entry_type & before_entry_function,
-               const ProcessTracer::exit_type & after_exit_function );
+               const ProcessTracer::exit_type & after_exit_function,
+               const bool syscall_filter = false );
 
   void insert( const pid_t tracee_pid );
   void remove( const pid_t tracee_pid );
@@ -84,16 +93,34 @@ public:
 class Tracer
 {
 private:
+  /* the tracee installs a seccomp filter for the traced syscalls */
+  bool syscall_filter_;
+
   TracerFlock flock_;
 
 public:
+  /* with `traced_syscalls`, the before/after functions are only called for
+     those syscalls, and the tracee runs freely in between (if the kernel
+     can't filter its syscalls, it stops at all of them, and the rest are
+     skipped) */
   Tracer( const std::string & name,
           std::function<int()> && child_procedure,
           const ProcessTracer::entry_type & before_entry_function,
           const ProcessTracer::exit_type & after_exit_function,
-          std::function<void()> && preparation_procedure = [](){} );
+          std::function<void()> && preparation_procedure = [](){},
+          const std::vector<long> & traced_syscalls = {} );
 
   void loop_until_done() { flock_.loop_until_all_done(); }
 };
 
+/* the syscalls in the syscall table that have any of the given flags */
+std::vector<long> syscalls_with_flags( const int flags );
+
+/* installs a seccomp filter in the calling process, so that only the given
+   syscalls (and the ones that are newer than the syscall table) stop it.
+   the tracer must already be attached, with a TracerFlock that expects the
+   filter, or the trapped syscalls will fail with ENOSYS. a filtered tracee
+   can't be detached. */
+void install_syscall_filter( const std::vector<long> & syscalls );
+
 #endif /* TRACER_HH */
@@ -0,0 +1,73 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "bloom_filter.hh"
+
+#include <stdexcept>
+
+#include "sha256.hh"
+
+using namespace std;
+
+static uint64_t read_uint64( const string & data, const size_t offset )
+{
+  uint64_t value = 0;
+
+  for ( size_t i = 0; i < 8; i++ ) {
+    value |= static_cast<uint64_t>( static_cast<uint8_t>( data[ offset + i ] ) ) << ( 8 * i );
+  }
+
+  return value;
+}
+
+BloomFilter::BloomFilter( const size_t size_bytes )
+  : bits_( size_bytes, '\0' )
+{
+  if ( size_bytes == 0 ) {
+    throw runtime_error( "bloom filter cannot be empty" );
+  }
+}
+
+BloomFilter BloomFilter::from_bytes( const string & bits )
+{
+  BloomFilter filter { bits.length() };
+  filter.bits_ = bits;
+  return filter;
+}
+
+template<class Function>
+void BloomFilter::for_each_position( const string & key, Function && function ) const
+{
+  digest::SHA256 hasher;
+  hasher.update( key );
+  const string digest = hasher.digest();
+
+  const uint64_t h1 = read_uint64( digest, 0 );
+  const uint64_t h2 = read_uint64( digest, 8 );
+  const uint64_t bit_count = bits_.length() * 8;
+
+  for ( uint64_t i = 0; i < HASH_COUNT; i++ ) {
+    function( ( h1 + i * h2 ) % bit_count );
+  }
+}
+
+void BloomFilter::insert( const string & key )
+{
+  for_each_position( key,
+    [this] ( const uint64_t position )
+    {
+      bits_[ position / 8 ] |= 1 << ( position % 8 );
+    } );
+}
+
+bool BloomFilter::contains( const string & key ) const
+{
+  bool found = true;
+
+  for_each_position( key,
+    [this, &found] ( const uint64_t position )
+    {
+      found = found and ( bits_[ position / 8 ] & ( 1 << ( position % 8 ) ) );
+    } );
+
+  return found;
+}
@@ -0,0 +1,41 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef BLOOM_FILTER_HH
+#define BLOOM_FILTER_HH
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/* A Bloom filter over strings, meant to be sent over the wire: the bits are
+   its whole state. The positions for a key are h1 + i * h2 (mod 2^64, then
+   mod the number of bits), for i < HASH_COUNT, where h1 and h2 are the
+   first two little-endian 64-bit words of the key's SHA-256; bit n is
+   (1 << (n % 8)) in byte n / 8. Anything that follows these rules, like the
+   workers' Python code, can build a compatible filter. */
+
+class BloomFilter
+{
+public:
+  static constexpr size_t HASH_COUNT = 4;
+
+private:
+  std::string bits_;
+
+  template<class Function>
+  void for_each_position( const std::string & key, Function && function ) const;
+
+public:
+  /* an empty filter */
+  BloomFilter( const size_t size_bytes );
+
+  /* takes over the bits of a filter built somewhere else */
+  static BloomFilter from_bytes( const std::string & bits );
+
+  void insert( const std::string & key );
+  bool contains( const std::string & key ) const;
+
+  const std::string & bytes() const { return bits_; }
+};
+
+#endif /* BLOOM_FILTER_HH */
@@ -0,0 +1,111 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "cdc.hh"
+
+#include <array>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+  /* the gear table has to be the same everywhere chunks are computed, so
+     it's derived from a fixed seed rather than from anything random */
+  array<uint64_t, 256> make_gear_table()
+  {
+    array<uint64_t, 256> table;
+    uint64_t state = 0x6767636463686e6bULL;
+
+    for ( auto & entry : table ) {
+      /* splitmix64 */
+      uint64_t z = ( state += 0x9e3779b97f4a7c15ULL );
+      z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+      z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+      entry = z ^ ( z >> 31 );
+    }
+
+    return table;
+  }
+
+  const array<uint64_t, 256> GEAR = make_gear_table();
+
+  unsigned int log2_floor( size_t value )
+  {
+    unsigned int bits = 0;
+    while ( value >>= 1 ) { bits++; }
+    return bits;
+  }
+
+  /* the gear hash shifts left, so the high bits depend on the most bytes */
+  uint64_t top_bits_mask( const unsigned int bits )
+  {
+    return ~0ULL << ( 64 - bits );
+  }
+
+  /* the masks are derived from the average size, so the parameters have to
+     be checked before they're computed */
+  size_t checked_avg_size( const size_t min_size, const size_t avg_size,
+                           const size_t max_size )
+  {
+    if ( not ( 0 < min_size and min_size <= avg_size and avg_size <= max_size )
+         or avg_size < 16 or log2_floor( avg_size ) + 2 > 64 ) {
+      throw runtime_error( "invalid content-defined chunking parameters" );
+    }
+
+    return avg_size;
+  }
+
+}
+
+ContentDefinedChunker::ContentDefinedChunker( const size_t min_size,
+                                              const size_t avg_size,
+                                              const size_t max_size )
+  : min_size_( min_size ),
+    avg_size_( checked_avg_size( min_size, avg_size, max_size ) ),
+    max_size_( max_size ),
+    mask_small_( top_bits_mask( log2_floor( avg_size_ ) + 2 ) ),
+    mask_large_( top_bits_mask( log2_floor( avg_size_ ) - 2 ) )
+{}
+
+size_t ContentDefinedChunker::next_cut( const char * data, const size_t length ) const
+{
+  if ( length <= min_size_ ) {
+    return length;
+  }
+
+  const size_t limit = min( length, max_size_ );
+  const size_t normal = min( limit, avg_size_ );
+  const uint8_t * bytes = reinterpret_cast<const uint8_t *>( data );
+
+  uint64_t fingerprint = 0;
+  size_t i = min_size_;
+
+  for ( ; i < normal; i++ ) {
+    fingerprint = ( fingerprint << 1 ) + GEAR[ bytes[ i ] ];
+    if ( not ( fingerprint & mask_small_ ) ) {
+      return i + 1;
+    }
+  }
+
+  for ( ; i < limit; i++ ) {
+    fingerprint = ( fingerprint << 1 ) + GEAR[ bytes[ i ] ];
+    if ( not ( fingerprint & mask_large_ ) ) {
+      return i + 1;
+    }
+  }
+
+  return limit;
+}
+
+vector<size_t> ContentDefinedChunker::chunk( const char * data, const size_t size ) const
+{
+  vector<size_t> lengths;
+
+  for ( size_t offset = 0; offset < size; ) {
+    const size_t length = next_cut( data + offset, size - offset );
+    lengths.push_back( length );
+    offset += length;
+  }
+
+  return lengths;
+}
@@ -0,0 +1,41 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef CDC_HH
+#define CDC_HH
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "units.hh"
+
+/* FastCDC-style content-defined chunking: a gear rolling hash picks the cut
+   points, with a stricter mask before the average chunk size and a looser
+   one after it (normalized chunking), so the chunk boundaries only depend on
+   the surrounding bytes and survive insertions and deletions elsewhere. */
+class ContentDefinedChunker
+{
+private:
+  size_t min_size_;
+  size_t avg_size_;
+  size_t max_size_;
+
+  uint64_t mask_small_;
+  uint64_t mask_large_;
+
+public:
+  ContentDefinedChunker( const size_t min_size = 256_KiB,
+                         const size_t avg_size = 1_MiB,
+                         const size_t max_size = 4_MiB );
+
+  /* length of the chunk that starts at `data` */
+  size_t next_cut( const char * data, const size_t length ) const;
+
+  /* the lengths of all the chunks in `data`, in order */
+  std::vector<size_t> chunk( const char * data, const size_t length ) const;
+  std::vector<size_t> chunk( const std::string & data ) const
+  { return chunk( data.data(), data.size() ); }
+};
+
+#endif /* CDC_HH */
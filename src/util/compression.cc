@@ -0,0 +1,126 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "compression.hh"
+
+#include <memory>
+#include <stdexcept>
+#include <zstd.h>
+
+using namespace std;
+
+namespace {
+
+  size_t check_zstd( const string & operation, const size_t result )
+  {
+    if ( ZSTD_isError( result ) ) {
+      throw runtime_error( operation + ": " + ZSTD_getErrorName( result ) );
+    }
+
+    return result;
+  }
+
+  struct DStreamDeleter
+  {
+    void operator()( ZSTD_DStream * stream ) const { ZSTD_freeDStream( stream ); }
+  };
+
+  /* calls `consume` for every decompressed window */
+  template<class Consumer>
+  void decompress_stream( const char * input, const size_t length, Consumer && consume )
+  {
+    unique_ptr<ZSTD_DStream, DStreamDeleter> stream { ZSTD_createDStream() };
+
+    if ( not stream ) {
+      throw runtime_error( "ZSTD_createDStream failed" );
+    }
+
+    check_zstd( "ZSTD_initDStream", ZSTD_initDStream( stream.get() ) );
+
+    string window( ZSTD_DStreamOutSize(), '\0' );
+    ZSTD_inBuffer in_buffer { input, length, 0 };
+    size_t last_result = 0;
+
+    while ( in_buffer.pos < in_buffer.size ) {
+      ZSTD_outBuffer out_buffer { &window[ 0 ], window.size(), 0 };
+      last_result = check_zstd( "ZSTD_decompressStream",
+                                ZSTD_decompressStream( stream.get(), &out_buffer,
+                                                       &in_buffer ) );
+      consume( window, out_buffer.pos );
+    }
+
+    /* flush whatever the decoder is still holding on to */
+    while ( last_result != 0 ) {
+      ZSTD_outBuffer out_buffer { &window[ 0 ], window.size(), 0 };
+      last_result = check_zstd( "ZSTD_decompressStream",
+                                ZSTD_decompressStream( stream.get(), &out_buffer,
+                                                       &in_buffer ) );
+
+      if ( out_buffer.pos == 0 and last_result != 0 ) {
+        throw runtime_error( "truncated zstd stream" );
+      }
+
+      consume( window, out_buffer.pos );
+    }
+  }
+
+}
+
+bool compression::zstd_compress( const string & input, string & output,
+                                 const int level )
+{
+  output.clear();
+
+  if ( input.empty() ) {
+    return false;
+  }
+
+  string compressed( ZSTD_compressBound( input.size() ), '\0' );
+  const size_t compressed_size = check_zstd( "ZSTD_compress",
+    ZSTD_compress( &compressed[ 0 ], compressed.size(),
+                   input.data(), input.size(), level ) );
+
+  if ( compressed_size >= input.size() ) {
+    return false;
+  }
+
+  compressed.resize( compressed_size );
+  output = move( compressed );
+  return true;
+}
+
+void compression::zstd_decompress( const string & input, FileDescriptor & output )
+{
+  decompress_stream( input.data(), input.size(),
+    [&output] ( const string & window, const size_t length )
+    {
+      auto it = window.cbegin();
+      const auto end = window.cbegin() + length;
+
+      while ( it != end ) {
+        it = output.write( it, end );
+      }
+    } );
+}
+
+string compression::zstd_decompress( const string & input )
+{
+  string output;
+
+  decompress_stream( input.data(), input.size(),
+    [&output] ( const string & window, const size_t length )
+    {
+      output.append( window, 0, length );
+    } );
+
+  return output;
+}
+
+void compression::zstd_decompress( const char * input, const size_t length,
+                                   const function<void( const char *, size_t )> & consume )
+{
+  decompress_stream( input, length,
+    [&consume] ( const string & window, const size_t window_length )
+    {
+      consume( window.data(), window_length );
+    } );
+}
@@ -0,0 +1,35 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef COMPRESSION_HH
+#define COMPRESSION_HH
+
+#include <string>
+#include <functional>
+
+#include "file_descriptor.hh"
+
+namespace compression
+{
+  /* the value of the content-encoding marker for zstd-compressed objects */
+  static const std::string ZSTD_ENCODING = "zstd";
+
+  static constexpr int DEFAULT_ZSTD_LEVEL = 3;
+
+  /* compresses `input` into a single zstd frame. returns false (and leaves
+     `output` empty) if compression doesn't make the object any smaller, in
+     which case the object should be transferred as-is. */
+  bool zstd_compress( const std::string & input, std::string & output,
+                      const int level = DEFAULT_ZSTD_LEVEL );
+
+  /* decompresses a zstd stream into `output`, one output window at a time,
+     so the whole decompressed object is never held in memory */
+  void zstd_decompress( const std::string & input, FileDescriptor & output );
+
+  std::string zstd_decompress( const std::string & input );
+
+  /* hands the decompressed stream to `consume`, one window at a time */
+  void zstd_decompress( const char * input, const size_t length,
+                        const std::function<void( const char *, size_t )> & consume );
+}
+
+#endif /* COMPRESSION_HH */
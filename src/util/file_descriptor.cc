@@ -126,6 +126,23 @@ void FileDescriptor::block_for_exclusive_lock()
   CheckSystemCall( "flock", flock( fd_num(), LOCK_EX ) );
 }
 
+bool FileDescriptor::try_exclusive_lock()
+{
+  if ( flock( fd_num(), LOCK_EX | LOCK_NB ) == 0 ) {
+    return true;
+  }
+  else if ( errno == EWOULDBLOCK ) {
+    return false;
+  }
+
+  throw unix_error( "flock" );
+}
+
+void FileDescriptor::release_lock()
+{
+  CheckSystemCall( "flock", flock( fd_num(), LOCK_UN ) );
+}
+
 void FileDescriptor::set_blocking( const bool block )
 {
   int flags = CheckSystemCall( "fcntl F_GETFL", fcntl( fd_, F_GETFL ) );
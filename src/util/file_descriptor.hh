@@ -53,6 +53,11 @@ public:
   /* block on an exclusive lock */
   void block_for_exclusive_lock();
 
+  /* take an exclusive lock if nobody else is holding it */
+  bool try_exclusive_lock();
+
+  void release_lock();
+
   /* set nonblocking/blocking behavior */
   void set_blocking( const bool block );
 
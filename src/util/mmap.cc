@@ -0,0 +1,34 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "mmap.hh"
+
+#include <sys/mman.h>
+
+#include "exception.hh"
+
+using namespace std;
+
+MappedFile::MappedFile( const FileDescriptor & fd, const size_t size )
+  : size_( size )
+{
+  /* mmap doesn't take empty mappings */
+  if ( size_ == 0 ) {
+    return;
+  }
+
+  void * addr = mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, fd.fd_num(), 0 );
+
+  if ( addr == MAP_FAILED ) {
+    throw unix_error( "mmap" );
+  }
+
+  data_ = static_cast<char *>( addr );
+  madvise( data_, size_, MADV_SEQUENTIAL );
+}
+
+MappedFile::~MappedFile()
+{
+  if ( data_ != nullptr ) {
+    munmap( data_, size_ );
+  }
+}
@@ -0,0 +1,30 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef MMAP_HH
+#define MMAP_HH
+
+#include <string>
+#include <cstddef>
+
+#include "file_descriptor.hh"
+
+/* a read-only, private mapping of a whole file */
+class MappedFile
+{
+private:
+  char * data_ { nullptr };
+  size_t size_ { 0 };
+
+public:
+  MappedFile( const FileDescriptor & fd, const size_t size );
+  ~MappedFile();
+
+  const char * data() const { return data_; }
+  size_t size() const { return size_; }
+
+  /* forbid copying or assigning */
+  MappedFile( const MappedFile & other ) = delete;
+  MappedFile & operator=( const MappedFile & other ) = delete;
+};
+
+#endif /* MMAP_HH */
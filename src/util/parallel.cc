@@ -0,0 +1,63 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "parallel.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+void parallel_for( const size_t count,
+                   const function<void( const size_t )> & function,
+                   size_t thread_count )
+{
+  if ( thread_count == 0 ) {
+    thread_count = max( 1u, thread::hardware_concurrency() );
+  }
+
+  thread_count = min( thread_count, count );
+
+  if ( thread_count <= 1 ) {
+    for ( size_t i = 0; i < count; i++ ) {
+      function( i );
+    }
+
+    return;
+  }
+
+  atomic<size_t> next_index { 0 };
+  mutex error_mutex;
+  exception_ptr error;
+
+  vector<thread> threads;
+
+  for ( size_t i = 0; i < thread_count; i++ ) {
+    threads.emplace_back(
+      [&] ()
+      {
+        try {
+          for ( size_t index = next_index++; index < count; index = next_index++ ) {
+            function( index );
+          }
+        }
+        catch ( ... ) {
+          unique_lock<mutex> lock { error_mutex };
+          if ( not error ) { error = current_exception(); }
+          next_index = count; /* stop the others */
+        }
+      }
+    );
+  }
+
+  for ( auto & t : threads ) {
+    t.join();
+  }
+
+  if ( error ) {
+    rethrow_exception( error );
+  }
+}
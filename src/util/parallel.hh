@@ -0,0 +1,16 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef PARALLEL_HH
+#define PARALLEL_HH
+
+#include <cstddef>
+#include <functional>
+
+/* calls `function( i )` for every i in [0, count), on up to `thread_count`
+   threads (one per core by default). rethrows the first exception, after
+   all the threads are done. */
+void parallel_for( const size_t count,
+                   const std::function<void( const size_t )> & function,
+                   size_t thread_count = 0 );
+
+#endif /* PARALLEL_HH */
@@ -4,6 +4,9 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <dirent.h>
@@ -202,9 +205,56 @@ namespace roost {
     rename( tmp_file_name, dst.string() );
   }
 
-  void copy_then_rename( const path & src, const path & dst )
+  /* copies the data without passing it through userspace, if possible: the
+     blocks are shared if the file system can do that (reflinks), or else
+     copied by the kernel */
+  static void copy_contents( const FileDescriptor & src, const FileDescriptor & dst,
+                             const off_t size, const CopyMethod first_method )
+  {
+#ifdef FICLONE
+    if ( first_method == CopyMethod::Reflink and
+         ioctl( dst.fd_num(), FICLONE, src.fd_num() ) == 0 ) {
+      return;
+    }
+#endif
+
+    off_t copied = 0;
+
+    while ( first_method != CopyMethod::Sendfile and copied < size ) {
+      const ssize_t count = copy_file_range( src.fd_num(), nullptr, dst.fd_num(), nullptr,
+                                             size - copied, 0 );
+
+      if ( count < 0 and copied == 0 and
+           ( errno == EXDEV or errno == ENOSYS or errno == EINVAL or errno == EOPNOTSUPP ) ) {
+        break;
+      }
+      else if ( count < 0 ) {
+        throw unix_error( "copy_file_range" );
+      }
+      else if ( count == 0 ) {
+        throw runtime_error( "file shrank while being copied" );
+      }
+
+      copied += count;
+    }
+
+    /* the file systems don't support it (older kernels won't copy across
+       file systems) */
+    while ( copied < size ) {
+      const ssize_t count = CheckSystemCall( "sendfile",
+        sendfile( dst.fd_num(), src.fd_num(), nullptr, size - copied ) );
+
+      if ( count == 0 ) {
+        throw runtime_error( "file shrank while being copied" );
+      }
+
+      copied += count;
+    }
+  }
+
+  void copy_then_rename( const path & src, const path & dst,
+                         const CopyMethod first_method )
   {
-    /* read input file into memory */
     FileDescriptor src_file { CheckSystemCall( "open (" + src.string() + ")",
                               open( src.string().c_str(), O_RDONLY ) ) };
     struct stat src_info;
@@ -214,10 +264,24 @@ namespace roost {
       throw runtime_error( src.string() + " is not a regular file" );
     }
 
-    const string contents = src_file.read_exactly( src_info.st_size );
+    string tmp_file_name;
+
+    try {
+      UniqueFile tmp_file { dst.string() };
+      tmp_file_name = tmp_file.name();
+
+      copy_contents( src_file, tmp_file.fd(), src_info.st_size, first_method );
+      CheckSystemCall( "fchmod", fchmod( tmp_file.fd().fd_num(), src_info.st_mode ) );
+    }
+    catch ( const exception & ) {
+      if ( not tmp_file_name.empty() ) {
+        unlink( tmp_file_name.c_str() );
+      }
+
+      throw;
+    }
 
-    /* write out to new file */
-    atomic_create( contents, dst, true, src_info.st_mode );
+    rename( tmp_file_name, dst.string() );
   }
 
   path operator/( const path & prefix, const path & suffix )
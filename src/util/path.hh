@@ -43,7 +43,13 @@ namespace roost {
 
   bool exists( const path & pathn );
   off_t file_size( const path & pathn );
-  void copy_then_rename( const path & src, const path & dest );
+  /* the ways copy_then_rename can copy the data, from cheapest to most
+     expensive. it starts with the given one (normally the cheapest), and
+     falls back to the next one if the file systems don't support it. */
+  enum class CopyMethod { Reflink, CopyFileRange, Sendfile };
+
+  void copy_then_rename( const path & src, const path & dest,
+                         const CopyMethod first_method = CopyMethod::Reflink );
   void move_file( const path & src, const path & dest );
   path operator/( const path & prefix, const path & suffix );
   path canonical( const path & pathn );
@@ -0,0 +1,460 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "sha256.hh"
+
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HAVE_X86_SHA 1
+#endif
+
+using namespace std;
+using namespace digest;
+
+namespace {
+
+  const uint32_t INITIAL_STATE[ 8 ] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+  alignas( 16 ) const uint32_t K[ 64 ] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+  inline uint32_t rotr( const uint32_t x, const unsigned int n )
+  {
+    return ( x >> n ) | ( x << ( 32 - n ) );
+  }
+
+  inline uint32_t load_be32( const uint8_t * p )
+  {
+    return ( uint32_t( p[ 0 ] ) << 24 ) | ( uint32_t( p[ 1 ] ) << 16 ) |
+           ( uint32_t( p[ 2 ] ) << 8 ) | uint32_t( p[ 3 ] );
+  }
+
+  void process_blocks_portable( uint32_t state[ 8 ], const uint8_t * data,
+                                size_t block_count )
+  {
+    uint32_t w[ 64 ];
+
+    for ( ; block_count > 0; block_count--, data += SHA256::BLOCK_SIZE ) {
+      for ( size_t i = 0; i < 16; i++ ) {
+        w[ i ] = load_be32( data + 4 * i );
+      }
+
+      for ( size_t i = 16; i < 64; i++ ) {
+        const uint32_t s0 = rotr( w[ i - 15 ], 7 ) ^ rotr( w[ i - 15 ], 18 ) ^ ( w[ i - 15 ] >> 3 );
+        const uint32_t s1 = rotr( w[ i - 2 ], 17 ) ^ rotr( w[ i - 2 ], 19 ) ^ ( w[ i - 2 ] >> 10 );
+        w[ i ] = w[ i - 16 ] + s0 + w[ i - 7 ] + s1;
+      }
+
+      uint32_t a = state[ 0 ], b = state[ 1 ], c = state[ 2 ], d = state[ 3 ];
+      uint32_t e = state[ 4 ], f = state[ 5 ], g = state[ 6 ], h = state[ 7 ];
+
+      for ( size_t i = 0; i < 64; i++ ) {
+        const uint32_t S1 = rotr( e, 6 ) ^ rotr( e, 11 ) ^ rotr( e, 25 );
+        const uint32_t ch = ( e & f ) ^ ( ~e & g );
+        const uint32_t temp1 = h + S1 + ch + K[ i ] + w[ i ];
+        const uint32_t S0 = rotr( a, 2 ) ^ rotr( a, 13 ) ^ rotr( a, 22 );
+        const uint32_t maj = ( a & b ) ^ ( a & c ) ^ ( b & c );
+        const uint32_t temp2 = S0 + maj;
+
+        h = g; g = f; f = e; e = d + temp1;
+        d = c; c = b; b = a; a = temp1 + temp2;
+      }
+
+      state[ 0 ] += a; state[ 1 ] += b; state[ 2 ] += c; state[ 3 ] += d;
+      state[ 4 ] += e; state[ 5 ] += f; state[ 6 ] += g; state[ 7 ] += h;
+    }
+  }
+
+#ifdef HAVE_X86_SHA
+  __attribute__(( target( "sha,sse4.1" ) ))
+  void process_blocks_shani( uint32_t state[ 8 ], const uint8_t * data,
+                             size_t block_count )
+  {
+    const __m128i byte_swap = _mm_set_epi64x( 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL );
+
+    /* the instructions want the state as ABEF and CDGH */
+    __m128i tmp = _mm_shuffle_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i *>( state ) ), 0xB1 );
+    __m128i state1 = _mm_shuffle_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i *>( state + 4 ) ), 0x1B );
+    __m128i state0 = _mm_alignr_epi8( tmp, state1, 8 );
+    state1 = _mm_blend_epi16( state1, tmp, 0xF0 );
+
+    for ( ; block_count > 0; block_count--, data += SHA256::BLOCK_SIZE ) {
+      const __m128i abef_save = state0;
+      const __m128i cdgh_save = state1;
+
+      __m128i w[ 4 ];
+
+      for ( size_t i = 0; i < 4; i++ ) {
+        w[ i ] = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i *>( data + 16 * i ) ),
+                                   byte_swap );
+      }
+
+      /* four rounds at a time; w[] holds a sliding window of the message
+         schedule */
+      for ( size_t i = 0; i < 16; i++ ) {
+        __m128i message = _mm_add_epi32( w[ i % 4 ],
+                                         _mm_load_si128( reinterpret_cast<const __m128i *>( K + 4 * i ) ) );
+        state1 = _mm_sha256rnds2_epu32( state1, state0, message );
+
+        if ( i < 12 ) {
+          __m128i next = _mm_sha256msg1_epu32( w[ i % 4 ], w[ ( i + 1 ) % 4 ] );
+          next = _mm_add_epi32( next, _mm_alignr_epi8( w[ ( i + 3 ) % 4 ], w[ ( i + 2 ) % 4 ], 4 ) );
+          w[ i % 4 ] = _mm_sha256msg2_epu32( next, w[ ( i + 3 ) % 4 ] );
+        }
+
+        message = _mm_shuffle_epi32( message, 0x0E );
+        state0 = _mm_sha256rnds2_epu32( state0, state1, message );
+      }
+
+      state0 = _mm_add_epi32( state0, abef_save );
+      state1 = _mm_add_epi32( state1, cdgh_save );
+    }
+
+    tmp = _mm_shuffle_epi32( state0, 0x1B );
+    state1 = _mm_shuffle_epi32( state1, 0xB1 );
+    state0 = _mm_blend_epi16( tmp, state1, 0xF0 );
+    state1 = _mm_alignr_epi8( state1, tmp, 8 );
+
+    _mm_storeu_si128( reinterpret_cast<__m128i *>( state ), state0 );
+    _mm_storeu_si128( reinterpret_cast<__m128i *>( state + 4 ), state1 );
+  }
+#endif
+
+#ifdef HAVE_X86_SHA
+  template<int n>
+  __attribute__(( target( "avx2" ) ))
+  inline __m256i rotr8( const __m256i x )
+  {
+    return _mm256_or_si256( _mm256_srli_epi32( x, n ), _mm256_slli_epi32( x, 32 - n ) );
+  }
+
+  /* message + padding, as a whole number of blocks */
+  string pad_message( const string & message )
+  {
+    const uint64_t bit_length = message.length() * 8;
+    string padded = message;
+    padded += static_cast<char>( 0x80 );
+    padded.append( ( SHA256::BLOCK_SIZE - ( padded.length() + 8 ) % SHA256::BLOCK_SIZE )
+                   % SHA256::BLOCK_SIZE, '\0' );
+
+    for ( int i = 7; i >= 0; i-- ) {
+      padded += static_cast<char>( bit_length >> ( 8 * i ) );
+    }
+
+    return padded;
+  }
+
+  /* eight messages at a time, one in each 32-bit lane. when a lane is done
+     with its message, it picks up the next one. */
+  __attribute__(( target( "avx2" ) ))
+  void digest_many_avx2( const vector<string> & messages, vector<string> & digests )
+  {
+    constexpr size_t LANES = 8;
+
+    struct Lane
+    {
+      string padded {};
+      size_t message { 0 };
+      size_t block { 0 };
+      bool active { false };
+    };
+
+    Lane lanes[ LANES ];
+    alignas( 32 ) uint32_t state[ 8 ][ LANES ];
+    size_t next_message = 0;
+
+    auto start_lane = [&] ( const size_t lane )
+    {
+      if ( next_message == messages.size() ) {
+        lanes[ lane ].active = false;
+        return;
+      }
+
+      lanes[ lane ] = { pad_message( messages[ next_message ] ), next_message, 0, true };
+      next_message++;
+
+      for ( size_t k = 0; k < 8; k++ ) {
+        state[ k ][ lane ] = INITIAL_STATE[ k ];
+      }
+    };
+
+    for ( size_t lane = 0; lane < LANES; lane++ ) {
+      start_lane( lane );
+    }
+
+    while ( any_of( begin( lanes ), end( lanes ), [] ( const Lane & l ) { return l.active; } ) ) {
+      __m256i w[ 64 ];
+      alignas( 32 ) uint32_t words[ LANES ];
+
+      for ( size_t t = 0; t < 16; t++ ) {
+        for ( size_t lane = 0; lane < LANES; lane++ ) {
+          words[ lane ] = lanes[ lane ].active
+                          ? load_be32( reinterpret_cast<const uint8_t *>( lanes[ lane ].padded.data() )
+                                       + lanes[ lane ].block * SHA256::BLOCK_SIZE + 4 * t )
+                          : 0;
+        }
+
+        w[ t ] = _mm256_load_si256( reinterpret_cast<const __m256i *>( words ) );
+      }
+
+      for ( size_t t = 16; t < 64; t++ ) {
+        const __m256i s0 = _mm256_xor_si256( _mm256_xor_si256( rotr8<7>( w[ t - 15 ] ), rotr8<18>( w[ t - 15 ] ) ),
+                                             _mm256_srli_epi32( w[ t - 15 ], 3 ) );
+        const __m256i s1 = _mm256_xor_si256( _mm256_xor_si256( rotr8<17>( w[ t - 2 ] ), rotr8<19>( w[ t - 2 ] ) ),
+                                             _mm256_srli_epi32( w[ t - 2 ], 10 ) );
+        w[ t ] = _mm256_add_epi32( _mm256_add_epi32( w[ t - 16 ], s0 ),
+                                   _mm256_add_epi32( w[ t - 7 ], s1 ) );
+      }
+
+      __m256i v[ 8 ];
+      for ( size_t k = 0; k < 8; k++ ) {
+        v[ k ] = _mm256_load_si256( reinterpret_cast<const __m256i *>( state[ k ] ) );
+      }
+
+      __m256i a = v[ 0 ], b = v[ 1 ], c = v[ 2 ], d = v[ 3 ];
+      __m256i e = v[ 4 ], f = v[ 5 ], g = v[ 6 ], h = v[ 7 ];
+
+      for ( size_t t = 0; t < 64; t++ ) {
+        const __m256i S1 = _mm256_xor_si256( _mm256_xor_si256( rotr8<6>( e ), rotr8<11>( e ) ), rotr8<25>( e ) );
+        const __m256i ch = _mm256_xor_si256( _mm256_and_si256( e, f ), _mm256_andnot_si256( e, g ) );
+        const __m256i temp1 = _mm256_add_epi32( _mm256_add_epi32( h, S1 ),
+                                                _mm256_add_epi32( _mm256_add_epi32( ch, w[ t ] ),
+                                                                  _mm256_set1_epi32( K[ t ] ) ) );
+        const __m256i S0 = _mm256_xor_si256( _mm256_xor_si256( rotr8<2>( a ), rotr8<13>( a ) ), rotr8<22>( a ) );
+        const __m256i maj = _mm256_xor_si256( _mm256_xor_si256( _mm256_and_si256( a, b ), _mm256_and_si256( a, c ) ),
+                                              _mm256_and_si256( b, c ) );
+        const __m256i temp2 = _mm256_add_epi32( S0, maj );
+
+        h = g; g = f; f = e; e = _mm256_add_epi32( d, temp1 );
+        d = c; c = b; b = a; a = _mm256_add_epi32( temp1, temp2 );
+      }
+
+      const __m256i result[ 8 ] = { a, b, c, d, e, f, g, h };
+
+      for ( size_t k = 0; k < 8; k++ ) {
+        _mm256_store_si256( reinterpret_cast<__m256i *>( state[ k ] ),
+                            _mm256_add_epi32( v[ k ], result[ k ] ) );
+      }
+
+      for ( size_t lane = 0; lane < LANES; lane++ ) {
+        Lane & current = lanes[ lane ];
+
+        if ( not current.active or
+             ++current.block < current.padded.length() / SHA256::BLOCK_SIZE ) {
+          continue;
+        }
+
+        string & output = digests[ current.message ];
+        output.resize( SHA256::DIGEST_SIZE );
+
+        for ( size_t k = 0; k < 8; k++ ) {
+          output[ 4 * k ] = static_cast<char>( state[ k ][ lane ] >> 24 );
+          output[ 4 * k + 1 ] = static_cast<char>( state[ k ][ lane ] >> 16 );
+          output[ 4 * k + 2 ] = static_cast<char>( state[ k ][ lane ] >> 8 );
+          output[ 4 * k + 3 ] = static_cast<char>( state[ k ][ lane ] );
+        }
+
+        start_lane( lane );
+      }
+    }
+  }
+#endif
+
+}
+
+SHA256::SHA256( const Implementation implementation )
+  : process_blocks_( process_blocks_portable ), state_(), buffer_()
+{
+  if ( not is_supported( implementation ) ) {
+    throw runtime_error( "SHA-256 implementation not supported on this CPU" );
+  }
+
+#ifdef HAVE_X86_SHA
+  if ( implementation == Implementation::SHANI ) {
+    process_blocks_ = process_blocks_shani;
+  }
+#endif
+
+  memcpy( state_, INITIAL_STATE, sizeof( state_ ) );
+}
+
+bool SHA256::is_supported( const Implementation implementation )
+{
+  switch ( implementation ) {
+  case Implementation::Portable:
+    return true;
+
+  case Implementation::SHANI:
+#ifdef HAVE_X86_SHA
+    {
+      unsigned int eax, ebx, ecx, edx;
+
+      if ( not __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) or
+           not ( ecx & bit_SSE4_1 ) or not ( ecx & bit_SSSE3 ) ) {
+        return false;
+      }
+
+      if ( not __get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) ) {
+        return false;
+      }
+
+      return ebx & bit_SHA;
+    }
+#else
+    return false;
+#endif
+  }
+
+  return false;
+}
+
+SHA256::Implementation SHA256::best_implementation()
+{
+  static const Implementation best = is_supported( Implementation::SHANI )
+                                     ? Implementation::SHANI
+                                     : Implementation::Portable;
+  return best;
+}
+
+void SHA256::update( const char * input, size_t length )
+{
+  const uint8_t * data = reinterpret_cast<const uint8_t *>( input );
+  total_length_ += length;
+
+  if ( buffer_length_ > 0 ) {
+    const size_t to_copy = min( length, BLOCK_SIZE - buffer_length_ );
+    memcpy( buffer_ + buffer_length_, data, to_copy );
+    buffer_length_ += to_copy;
+    data += to_copy;
+    length -= to_copy;
+
+    if ( buffer_length_ < BLOCK_SIZE ) {
+      return;
+    }
+
+    process_blocks_( state_, buffer_, 1 );
+    buffer_length_ = 0;
+  }
+
+  if ( length >= BLOCK_SIZE ) {
+    process_blocks_( state_, data, length / BLOCK_SIZE );
+    data += length - length % BLOCK_SIZE;
+    length %= BLOCK_SIZE;
+  }
+
+  memcpy( buffer_, data, length );
+  buffer_length_ = length;
+}
+
+string SHA256::digest()
+{
+  const uint64_t bit_length = total_length_ * 8;
+
+  /* the padding is a one bit, zeros, and the message length in bits */
+  buffer_[ buffer_length_++ ] = 0x80;
+
+  if ( buffer_length_ > BLOCK_SIZE - 8 ) {
+    memset( buffer_ + buffer_length_, 0, BLOCK_SIZE - buffer_length_ );
+    process_blocks_( state_, buffer_, 1 );
+    buffer_length_ = 0;
+  }
+
+  memset( buffer_ + buffer_length_, 0, BLOCK_SIZE - 8 - buffer_length_ );
+
+  for ( size_t i = 0; i < 8; i++ ) {
+    buffer_[ BLOCK_SIZE - 1 - i ] = static_cast<uint8_t>( bit_length >> ( 8 * i ) );
+  }
+
+  process_blocks_( state_, buffer_, 1 );
+  buffer_length_ = 0;
+
+  string output( DIGEST_SIZE, '\0' );
+
+  for ( size_t i = 0; i < 8; i++ ) {
+    output[ 4 * i ] = static_cast<char>( state_[ i ] >> 24 );
+    output[ 4 * i + 1 ] = static_cast<char>( state_[ i ] >> 16 );
+    output[ 4 * i + 2 ] = static_cast<char>( state_[ i ] >> 8 );
+    output[ 4 * i + 3 ] = static_cast<char>( state_[ i ] );
+  }
+
+  return output;
+}
+
+bool SHA256::multi_buffer_supported()
+{
+#ifdef HAVE_X86_SHA
+  unsigned int eax, ebx, ecx, edx;
+
+  /* the OS has to save the AVX registers too */
+  if ( not __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) or
+       not ( ecx & bit_OSXSAVE ) or not ( ecx & bit_AVX ) ) {
+    return false;
+  }
+
+  uint32_t xcr0, xcr0_high;
+  asm volatile ( "xgetbv" : "=a" ( xcr0 ), "=d" ( xcr0_high ) : "c" ( 0 ) );
+
+  if ( ( xcr0 & 0x6 ) != 0x6 ) {
+    return false;
+  }
+
+  if ( not __get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) ) {
+    return false;
+  }
+
+  return ebx & bit_AVX2;
+#else
+  return false;
+#endif
+}
+
+bool SHA256::multi_buffer_preferred()
+{
+  static const bool preferred = multi_buffer_supported() and
+                                best_implementation() == Implementation::Portable;
+  return preferred;
+}
+
+vector<string> SHA256::digest_many( const vector<string> & messages,
+                                    const bool multi_buffer )
+{
+  vector<string> digests( messages.size() );
+
+#ifdef HAVE_X86_SHA
+  if ( multi_buffer ) {
+    if ( not multi_buffer_supported() ) {
+      throw runtime_error( "multi-buffer SHA-256 not supported on this CPU" );
+    }
+
+    digest_many_avx2( messages, digests );
+    return digests;
+  }
+#else
+  if ( multi_buffer ) {
+    throw runtime_error( "multi-buffer SHA-256 not supported on this CPU" );
+  }
+#endif
+
+  for ( size_t i = 0; i < messages.size(); i++ ) {
+    SHA256 hasher;
+    hasher.update( messages[ i ] );
+    digests[ i ] = hasher.digest();
+  }
+
+  return digests;
+}
@@ -0,0 +1,59 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef SHA256_HH
+#define SHA256_HH
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace digest
+{
+  /* incremental SHA-256. the block function is picked at runtime: the x86 SHA
+     extensions when the CPU has them, portable code otherwise. */
+  class SHA256
+  {
+  public:
+    static constexpr size_t BLOCK_SIZE = 64;
+    static constexpr size_t DIGEST_SIZE = 32;
+
+    enum class Implementation { Portable, SHANI };
+
+    typedef void ( *BlockFunction )( uint32_t state[ 8 ], const uint8_t * data,
+                                     size_t block_count );
+
+  private:
+    BlockFunction process_blocks_;
+
+    uint32_t state_[ 8 ];
+    uint8_t buffer_[ BLOCK_SIZE ];
+    size_t buffer_length_ { 0 };
+    uint64_t total_length_ { 0 };
+
+  public:
+    SHA256( const Implementation implementation = best_implementation() );
+
+    void update( const char * data, const size_t length );
+    void update( const std::string & data ) { update( data.data(), data.length() ); }
+
+    /* the raw 32-byte digest. the object can't be updated after this. */
+    std::string digest();
+
+    uint64_t length() const { return total_length_; }
+
+    static Implementation best_implementation();
+    static bool is_supported( const Implementation implementation );
+
+    /* hashes many (short) messages. with AVX2, the multi-buffer version
+       runs eight of them side by side through the vector unit; it's only
+       preferred when the SHA extensions aren't there. */
+    static std::vector<std::string> digest_many( const std::vector<std::string> & messages,
+                                                 const bool multi_buffer = multi_buffer_preferred() );
+
+    static bool multi_buffer_supported();
+    static bool multi_buffer_preferred();
+  };
+}
+
+#endif /* SHA256_HH */
@@ -25,3 +25,17 @@ string safe_getenv_or( const string & key, const string & def_val )
   }
   return value;
 }
+
+size_t parse_size( const string & str )
+{
+  size_t pos = 0;
+  const size_t value = stoull( str, &pos );
+  const string suffix = str.substr( pos );
+
+  if ( suffix.empty() ) { return value; }
+  else if ( suffix == "K" ) { return value * 1024; }
+  else if ( suffix == "M" ) { return value * 1024 * 1024; }
+  else if ( suffix == "G" ) { return value * 1024 * 1024 * 1024; }
+
+  throw runtime_error( "invalid size: " + str );
+}
@@ -4,10 +4,14 @@
 #define UTIL_HH
 
 #include <string>
+#include <cstddef>
 
 std::string safe_getenv( const std::string & key );
 std::string safe_getenv_or( const std::string & key, const std::string & def_val );
 
+/* sizes can be given in bytes, or with a K, M or G suffix */
+size_t parse_size( const std::string & str );
+
 template <typename E>
 constexpr auto to_underlying( E e ) noexcept
 {